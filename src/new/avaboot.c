@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+
+/* Bootstrap stub that a parent spawn proc starts on a child host
+ * instead of the launcher, see boot.h:
+ *
+ *   avaboot <host>:<port> <path> [args ...]
+ *
+ * connects to the parent at host:port, writes the launcher it sends
+ * to path, and execs it with args.  It links only libc, so it is
+ * small and cheap to start from wherever it is installed. */
+
+#include <boot.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#define BOOT_BUF_SIZE (1024*1024)
+
+static void
+boot_die (const char * msg, const char * arg)
+{
+    fprintf(stderr, "avaboot: %s `%s' (%s)\n", msg, arg, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+/* connect to host:port in addr, returns socket or exits */
+static int
+boot_connect (const char * addr)
+{
+    char host[256];
+    const char* port = strrchr(addr, ':');
+    if (port == NULL || (size_t) (port - addr) >= sizeof(host)) {
+        errno = EINVAL;
+        boot_die("Invalid address", addr);
+    }
+    memcpy(host, addr, (size_t) (port - addr));
+    host[port - addr] = '\0';
+    port++;
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* list;
+    int rc = getaddrinfo(host, port, &hints, &list);
+    if (rc != 0) {
+        fprintf(stderr, "avaboot: Failed to look up `%s' (%s)\n", host, gai_strerror(rc));
+        exit(EXIT_FAILURE);
+    }
+
+    int fd = -1;
+    struct addrinfo* ai;
+    for (ai = list; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(list);
+
+    if (fd < 0) {
+        boot_die("Failed to connect to", addr);
+    }
+    return fd;
+}
+
+/* read len bytes from fd into buf, returns 0 on success */
+static int
+boot_read (int fd, void * buf, size_t len)
+{
+    char* ptr = (char*) buf;
+    while (len > 0) {
+        ssize_t rc = read(fd, ptr, len);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            if (rc == 0) {
+                errno = EPIPE;
+            }
+            return 1;
+        }
+        ptr += rc;
+        len -= (size_t) rc;
+    }
+    return 0;
+}
+
+/* write len bytes from buf to fd, returns 0 on success */
+static int
+boot_write (int fd, const char * buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t rc = write(fd, buf, len);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc < 0) {
+            return 1;
+        }
+        buf += rc;
+        len -= (size_t) rc;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: avaboot <host>:<port> <path> [args ...]\n");
+        return EXIT_FAILURE;
+    }
+    const char* addr = argv[1];
+    const char* path = argv[2];
+
+    int fd = boot_connect(addr);
+
+    boot_header hdr;
+    if (boot_read(fd, &hdr, sizeof(hdr)) != 0) {
+        boot_die("Failed to read header from", addr);
+    }
+    if (ntohl(hdr.magic) != BOOT_MAGIC) {
+        errno = EPROTO;
+        boot_die("Bad header from", addr);
+    }
+    uint64_t size = ((uint64_t) ntohl(hdr.size_hi) << 32) | (uint64_t) ntohl(hdr.size_lo);
+
+    /* write to a temporary name and rename it into place, so a
+     * launcher already running from path is not clobbered */
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid()) >= (int) sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        boot_die("Path too long", path);
+    }
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, S_IRWXU);
+    if (out < 0) {
+        boot_die("Failed to open", tmp);
+    }
+
+    char* buf = (char*) malloc(BOOT_BUF_SIZE);
+    if (buf == NULL) {
+        boot_die("Failed to allocate buffer for", path);
+    }
+    while (size > 0) {
+        size_t len = (size > BOOT_BUF_SIZE) ? BOOT_BUF_SIZE : (size_t) size;
+        if (boot_read(fd, buf, len) != 0) {
+            unlink(tmp);
+            boot_die("Failed to read launcher from", addr);
+        }
+        if (boot_write(out, buf, len) != 0) {
+            unlink(tmp);
+            boot_die("Failed to write", tmp);
+        }
+        size -= len;
+    }
+    free(buf);
+    close(fd);
+
+    if (close(out) != 0) {
+        unlink(tmp);
+        boot_die("Failed to write", tmp);
+    }
+    if (rename(tmp, path) != 0) {
+        unlink(tmp);
+        boot_die("Failed to rename to", path);
+    }
+
+    /* launcher sees its own path as argv[0] */
+    argv[2] = (char*) path;
+    execv(path, &argv[2]);
+    boot_die("Failed to exec", path);
+    return EXIT_FAILURE;
+}
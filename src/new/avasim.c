@@ -0,0 +1,940 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* Offline launch simulator: fits the cost of launch primitives to
+ * timings recorded by avalaunch (MV2_SPAWN_BENCH_CSV, or a sweep from
+ * avabench), then predicts unfurl, bcast, and gather times for k-ary
+ * and k-nomial trees of each degree at a given node count.  Choices
+ * are ranked with the deterministic launch_model, and the best few
+ * are then run through a discrete-event simulation of every spawn
+ * proc with per-launch variance drawn from the measured tails, and
+ * the one with the best mean is recommended. */
+
+#include <launch_model.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+/* cap on chunks per bcast in the discrete-event simulation, which
+ * costs one event per chunk per rank */
+#define SIM_MAX_CHUNKS (256)
+
+/* 99th percentile of the standard normal distribution */
+#define Z_P99 (2.326)
+
+/****************************
+ * Fit params to measured timings
+ ***************************/
+
+/* timings we pull from one launch */
+typedef struct sim_run_t {
+    char* key;      /* run parameters preceding phase column */
+    int failed;
+    double unfurl;  /* secs to unfurl tree */
+    launch_model_sample sample;
+} sim_run;
+
+/* split a CSV line into fields in place, strips quotes, returns
+ * number of fields */
+static int
+csv_split (char * line, char ** fields, int max)
+{
+    int count = 0;
+    char* ptr = line;
+    while (count < max) {
+        if (*ptr == '"') {
+            /* labels never hold quotes, but may hold commas */
+            ptr++;
+            fields[count++] = ptr;
+            char* end = strchr(ptr, '"');
+            if (end == NULL) {
+                break;
+            }
+            *end = '\0';
+            ptr = end + 1;
+        } else {
+            fields[count++] = ptr;
+            ptr += strcspn(ptr, ",");
+        }
+
+        if (*ptr != ',') {
+            *ptr = '\0';
+            break;
+        }
+        *ptr = '\0';
+        ptr++;
+    }
+    return count;
+}
+
+static int
+csv_column (char ** fields, int count, const char * name)
+{
+    int i;
+    for (i = 0; i < count; i++) {
+        if (strcmp(fields[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static double
+csv_double (char ** fields, int count, int col)
+{
+    if (col < 0 || col >= count || fields[col][0] == '\0') {
+        return 0.0;
+    }
+    return atof(fields[col]);
+}
+
+/* read runs from a CSV written by avalaunch or avabench, nodes,
+ * degree, and bytes are used for files that don't record them,
+ * appends to runs and returns updated count */
+static int
+read_runs (const char * file, int nodes, int degree, double bytes,
+        sim_run ** runs, int count)
+{
+    FILE* fp = fopen(file, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "avasim: failed to open `%s'\n", file);
+        exit(1);
+    }
+
+    char line[4096];
+    char* fields[64];
+    int phase_col = -1, secs_col, p99_col, nodes_col, degree_col, file_col, status_col;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        /* first line names the columns */
+        if (phase_col < 0) {
+            int n = csv_split(line, fields, 64);
+            phase_col  = csv_column(fields, n, "phase");
+            secs_col   = csv_column(fields, n, "secs");
+            p99_col    = csv_column(fields, n, "p99");
+            nodes_col  = csv_column(fields, n, "nodes");
+            degree_col = csv_column(fields, n, "degree");
+            file_col   = csv_column(fields, n, "file_mb");
+            status_col = csv_column(fields, n, "status");
+            if (phase_col < 0 || secs_col < 0) {
+                fprintf(stderr, "avasim: `%s' has no phase and secs columns\n", file);
+                exit(1);
+            }
+            continue;
+        }
+
+        /* columns before phase identify the run */
+        char key[4096];
+        char* comma = line;
+        int i;
+        for (i = 0; i < phase_col && comma != NULL; i++) {
+            comma = strchr(comma, ',');
+            if (comma != NULL) {
+                comma++;
+            }
+        }
+        size_t keylen = (comma != NULL) ? (size_t) (comma - line) : 0;
+        memcpy(key, line, keylen);
+        key[keylen] = '\0';
+
+        int n = csv_split(line, fields, 64);
+        if (n <= secs_col) {
+            continue;
+        }
+
+        /* start a new run when the key changes */
+        if (count == 0 || strcmp((*runs)[count - 1].key, key) != 0) {
+            *runs = (sim_run*) realloc(*runs, (count + 1) * sizeof(sim_run));
+            sim_run* r = &(*runs)[count++];
+            memset(r, 0, sizeof(sim_run));
+            r->key    = strdup(key);
+            r->failed = (status_col >= 0 && strcmp(fields[status_col], "ok") != 0);
+
+            /* avabench runs used k-ary trees and whole-file bcast */
+            launch_model_sample* m = &r->sample;
+            m->nodes       = (nodes_col  >= 0) ? atoi(fields[nodes_col])  : nodes;
+            m->shape       = LAUNCH_SHAPE_KARY;
+            m->degree      = (degree_col >= 0) ? atoi(fields[degree_col]) : degree;
+            m->bcast_bytes = (file_col   >= 0) ? atof(fields[file_col]) * 1024.0 * 1024.0 : bytes;
+        }
+        sim_run* r = &(*runs)[count - 1];
+        launch_model_sample* m = &r->sample;
+
+        const char* phase = fields[phase_col];
+        double usecs = csv_double(fields, n, secs_col) * 1e6;
+        double p99   = csv_double(fields, n, p99_col)  * 1e6;
+        if (strcmp(phase, "launch children") == 0) {
+            m->launch_usecs = usecs;
+            m->launch_p99   = p99;
+        } else if (strcmp(phase, "accept children") == 0) {
+            m->accept_usecs = usecs;
+            m->accept_p99   = p99;
+        } else if (strcmp(phase, "send params to children") == 0) {
+            m->params_usecs = usecs;
+        } else if (strcmp(phase, "signal costs x1000 **") == 0) {
+            m->signal_usecs = usecs;
+        } else if (strcmp(phase, "pack/unpack strmap x1000 **") == 0) {
+            m->pack_usecs = usecs;
+        } else if (strcmp(phase, "bcast app binary") == 0) {
+            m->bcast_usecs = usecs;
+        } else if (strcmp(phase, "unfurl tree") == 0) {
+            r->unfurl = usecs / 1e6;
+        }
+    }
+
+    fclose(fp);
+    return count;
+}
+
+/* fit params to runs that succeeded */
+static void
+fit_params (const sim_run * runs, int count, launch_model_params * p)
+{
+    launch_model_sample* samples = (launch_model_sample*) malloc((count + 1) * sizeof(launch_model_sample));
+    int num = 0;
+    int i;
+    for (i = 0; i < count; i++) {
+        const sim_run* r = &runs[i];
+        if (! r->failed && r->sample.nodes >= 2 && r->sample.degree >= 1) {
+            samples[num++] = r->sample;
+        }
+    }
+    launch_model_fit(samples, num, p);
+    free(samples);
+}
+
+/****************************
+ * Discrete-event simulation
+ ***************************/
+
+enum {
+    EV_PARAMS = 0, /* spawn proc gets params from parent */
+    EV_CONNECT,    /* child connects back to spawn proc */
+    EV_UP,         /* child signals its subtree is up */
+    EV_CHUNK,      /* spawn proc gets a bcast chunk */
+    EV_GSIZE,      /* spawn proc gets gather size from a child */
+    EV_GDATA,      /* spawn proc gets gather data from a child */
+};
+
+typedef struct sim_event_t {
+    double t;
+    uint64_t seq; /* breaks ties in the order events were queued */
+    int type;
+    int node;
+    int arg;
+} sim_event;
+
+typedef struct sim_queue_t {
+    sim_event* heap;
+    size_t count;
+    size_t size;
+    uint64_t seq;
+} sim_queue;
+
+static int
+event_before (const sim_event * a, const sim_event * b)
+{
+    if (a->t != b->t) {
+        return a->t < b->t;
+    }
+    return a->seq < b->seq;
+}
+
+static void
+queue_push (sim_queue * q, double t, int type, int node, int arg)
+{
+    if (q->count == q->size) {
+        q->size = (q->size > 0) ? q->size * 2 : 1024;
+        q->heap = (sim_event*) realloc(q->heap, q->size * sizeof(sim_event));
+    }
+
+    sim_event ev = { t, q->seq++, type, node, arg };
+    size_t i = q->count++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!event_before(&ev, &q->heap[parent])) {
+            break;
+        }
+        q->heap[i] = q->heap[parent];
+        i = parent;
+    }
+    q->heap[i] = ev;
+}
+
+static int
+queue_pop (sim_queue * q, sim_event * ev)
+{
+    if (q->count == 0) {
+        return 0;
+    }
+
+    *ev = q->heap[0];
+    sim_event last = q->heap[--q->count];
+    size_t i = 0;
+    while (1) {
+        size_t child = 2 * i + 1;
+        if (child >= q->count) {
+            break;
+        }
+        if (child + 1 < q->count && event_before(&q->heap[child + 1], &q->heap[child])) {
+            child++;
+        }
+        if (!event_before(&q->heap[child], &last)) {
+            break;
+        }
+        q->heap[i] = q->heap[child];
+        i = child;
+    }
+    q->heap[i] = last;
+    return 1;
+}
+
+/* state of one spawn proc */
+typedef struct sim_node_t {
+    double busy;   /* time proc finishes what it has been asked to do */
+    double latest; /* latest arrival from children for current wave */
+    int children;
+    int arrived;   /* children heard from in current wave */
+    double data_latest; /* latest gather data arrival from children */
+    int data_arrived;   /* children we have gather data from */
+    int* order;    /* children in the order they connected */
+    double sent_size; /* time gather size was sent, -1 until then */
+} sim_node;
+
+typedef struct sim_t {
+    const launch_model_params* p;
+    launch_shape shape;
+    int degree;
+    int ranks;
+    sim_node* nodes;
+    int* kids;     /* scratch space to list children */
+    sim_queue q;
+    uint64_t rng;
+} sim;
+
+static double
+sim_uniform (sim * s)
+{
+    /* xorshift64* */
+    s->rng ^= s->rng >> 12;
+    s->rng ^= s->rng << 25;
+    s->rng ^= s->rng >> 27;
+    uint64_t val = s->rng * 2685821657736338717ULL;
+    return ((double) (val >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/* sample a log-normal cost with given median and 99th percentile */
+static double
+sim_sample (sim * s, double median, double p99)
+{
+    if (p99 <= median || median <= 0.0) {
+        return median;
+    }
+    double sigma = log(p99 / median) / Z_P99;
+    double z = sqrt(-2.0 * log(sim_uniform(s))) * cos(2.0 * M_PI * sim_uniform(s));
+    return median * exp(sigma * z);
+}
+
+static double
+sim_msg (const launch_model_params * p, double bytes)
+{
+    return p->send_usecs + bytes / p->bw_mbs;
+}
+
+static void
+sim_init (sim * s, const launch_model_params * p, launch_shape shape,
+        int degree, int ranks, uint64_t seed)
+{
+    s->p      = p;
+    s->shape  = shape;
+    s->degree = degree;
+    s->ranks  = ranks;
+    s->nodes  = (sim_node*) calloc(ranks, sizeof(sim_node));
+    s->kids   = (int*) malloc((launch_model_max_children(shape, ranks, degree) + 1) * sizeof(int));
+    memset(&s->q, 0, sizeof(sim_queue));
+    s->rng    = seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    int i;
+    for (i = 0; i < ranks; i++) {
+        s->nodes[i].children = launch_model_children(shape, i, ranks, degree, NULL);
+    }
+}
+
+/* clear per-wave state before simulating the next phase */
+static void
+sim_reset (sim * s)
+{
+    int i;
+    for (i = 0; i < s->ranks; i++) {
+        sim_node* n = &s->nodes[i];
+        n->busy      = 0.0;
+        n->latest    = 0.0;
+        n->arrived   = 0;
+        n->sent_size = -1.0;
+        n->data_latest  = 0.0;
+        n->data_arrived = 0;
+    }
+    s->q.count = 0;
+}
+
+static void
+sim_free (sim * s)
+{
+    int i;
+    for (i = 0; i < s->ranks; i++) {
+        free(s->nodes[i].order);
+    }
+    free(s->nodes);
+    free(s->kids);
+    free(s->q.heap);
+}
+
+/* simulate tree unfurl, returns usecs until root hears all are up */
+static double
+sim_unfurl (sim * s)
+{
+    const launch_model_params* p = s->p;
+    double done = 0.0;
+
+    sim_reset(s);
+    queue_push(&s->q, 0.0, EV_PARAMS, 0, -1);
+
+    sim_event ev;
+    while (queue_pop(&s->q, &ev)) {
+        sim_node* n = &s->nodes[ev.node];
+        int parent = launch_model_parent(s->shape, ev.node, s->degree);
+        int i;
+
+        switch (ev.type) {
+        case EV_PARAMS:
+            /* fork remote shell for each child in turn */
+            n->busy = ev.t;
+            launch_model_children(s->shape, ev.node, s->ranks, s->degree, s->kids);
+            for (i = 0; i < n->children; i++) {
+                n->busy += sim_sample(s, p->fork_usecs, p->fork_p99);
+                double connect = n->busy + sim_sample(s, p->rsh_usecs, p->rsh_p99);
+                queue_push(&s->q, connect, EV_CONNECT, ev.node, s->kids[i]);
+            }
+            if (n->children == 0) {
+                if (parent >= 0) {
+                    queue_push(&s->q, ev.t + p->hop_usecs, EV_UP, parent, ev.node);
+                } else {
+                    done = ev.t;
+                }
+            } else {
+                n->order = (int*) malloc(n->children * sizeof(int));
+            }
+            break;
+
+        case EV_CONNECT:
+            /* accept children as they connect, once all are in,
+             * send params to each in the order they connected */
+            if (ev.t > n->busy) {
+                n->busy = ev.t;
+            }
+            n->busy += p->accept_usecs;
+            n->order[n->arrived++] = ev.arg;
+            if (n->arrived == n->children) {
+                for (i = 0; i < n->children; i++) {
+                    /* child gets the hosts of its subtree */
+                    int size = launch_model_subtree_size(s->shape,
+                        n->order[i], s->ranks, s->degree);
+                    n->busy += sim_msg(p, (double) size * p->host_bytes);
+                    queue_push(&s->q, n->busy + p->hop_usecs, EV_PARAMS, n->order[i], ev.node);
+                }
+                free(n->order);
+                n->order   = NULL;
+                n->arrived = 0;
+            }
+            break;
+
+        case EV_UP:
+            if (ev.t > n->latest) {
+                n->latest = ev.t;
+            }
+            n->arrived++;
+            if (n->arrived == n->children) {
+                double t = (n->latest > n->busy) ? n->latest : n->busy;
+                if (parent >= 0) {
+                    queue_push(&s->q, t + p->hop_usecs, EV_UP, parent, ev.node);
+                } else {
+                    done = t;
+                }
+            }
+            break;
+        }
+    }
+
+    return done;
+}
+
+/* simulate bcast of bytes in chunks from root, returns usecs until
+ * last chunk arrives at last proc */
+static double
+sim_bcast (sim * s, size_t bytes, size_t chunk)
+{
+    const launch_model_params* p = s->p;
+    if (bytes == 0) {
+        return 0.0;
+    }
+    if (chunk == 0 || chunk > bytes) {
+        chunk = bytes;
+    }
+    int chunks = (int) ((bytes + chunk - 1) / chunk);
+    double done = 0.0;
+
+    sim_reset(s);
+    int j;
+    for (j = 0; j < chunks; j++) {
+        queue_push(&s->q, 0.0, EV_CHUNK, 0, j);
+    }
+
+    sim_event ev;
+    while (queue_pop(&s->q, &ev)) {
+        sim_node* n = &s->nodes[ev.node];
+        if (ev.t > done) {
+            done = ev.t;
+        }
+
+        /* forward chunk to each child in turn */
+        size_t offset = (size_t) ev.arg * chunk;
+        size_t len = (bytes - offset < chunk) ? bytes - offset : chunk;
+        double cost = sim_msg(p, (double) len);
+        if (ev.t > n->busy) {
+            n->busy = ev.t;
+        }
+        launch_model_children(s->shape, ev.node, s->ranks, s->degree, s->kids);
+        int i;
+        for (i = 0; i < n->children; i++) {
+            n->busy += cost;
+            queue_push(&s->q, n->busy + p->hop_usecs, EV_CHUNK, s->kids[i], ev.arg);
+        }
+    }
+
+    return done;
+}
+
+/* proc has all gather sizes from its children, send its own size */
+static void
+sim_gather_size (sim * s, int node, double t)
+{
+    sim_node* n = &s->nodes[node];
+    n->sent_size = t + sim_msg(s->p, sizeof(uint64_t));
+    n->busy      = n->sent_size + s->p->pack_usecs;
+
+    int parent = launch_model_parent(s->shape, node, s->degree);
+    if (parent >= 0) {
+        queue_push(&s->q, n->sent_size + s->p->hop_usecs, EV_GSIZE, parent, node);
+    }
+}
+
+/* proc has all gather data from its children at time t, returns
+ * time it is ready to forward it, or time it is done if root */
+static double
+sim_gather_data (sim * s, int node, double t)
+{
+    sim_node* n = &s->nodes[node];
+    if (n->busy > t) {
+        t = n->busy;
+    }
+
+    /* root unpacks every entry */
+    int parent = launch_model_parent(s->shape, node, s->degree);
+    if (parent < 0) {
+        t += (double) s->ranks * s->p->pack_usecs;
+    }
+    return t;
+}
+
+/* simulate gather_strmap of one entry of given size from each proc */
+static double
+sim_gather (sim * s, size_t entry_bytes)
+{
+    const launch_model_params* p = s->p;
+    double done = 0.0;
+
+    sim_reset(s);
+
+    /* leaves have nothing to wait for */
+    int i;
+    for (i = 0; i < s->ranks; i++) {
+        if (s->nodes[i].children == 0) {
+            sim_gather_size(s, i, 0.0);
+            int parent = launch_model_parent(s->shape, i, s->degree);
+            double t = s->nodes[i].busy + sim_msg(p, (double) entry_bytes);
+            if (parent >= 0) {
+                queue_push(&s->q, t + p->hop_usecs, EV_GDATA, parent, i);
+            } else {
+                done = sim_gather_data(s, i, 0.0);
+            }
+        }
+    }
+
+    sim_event ev;
+    while (queue_pop(&s->q, &ev)) {
+        sim_node* n = &s->nodes[ev.node];
+        if (ev.type == EV_GSIZE) {
+            if (ev.t > n->latest) {
+                n->latest = ev.t;
+            }
+            n->arrived++;
+            if (n->arrived == n->children) {
+                sim_gather_size(s, ev.node, n->latest);
+            }
+        } else {
+            /* each child sends its data after its size, so we have
+             * all sizes by the time we have all data */
+            if (ev.t > n->data_latest) {
+                n->data_latest = ev.t;
+            }
+            n->data_arrived++;
+            if (n->data_arrived == n->children) {
+                double t = sim_gather_data(s, ev.node, n->data_latest);
+                int parent = launch_model_parent(s->shape, ev.node, s->degree);
+                if (parent >= 0) {
+                    int size = launch_model_subtree_size(s->shape, ev.node, s->ranks, s->degree);
+                    t += sim_msg(p, (double) size * (double) entry_bytes);
+                    queue_push(&s->q, t + p->hop_usecs, EV_GDATA, parent, ev.node);
+                } else {
+                    done = t;
+                }
+            }
+        }
+    }
+
+    return done;
+}
+
+/****************************
+ * Search and report
+ ***************************/
+
+typedef struct sim_choice_t {
+    launch_shape shape;
+    int degree;
+    size_t chunk;
+    double unfurl;
+    double bcast;
+    double gather;
+    double total;     /* model unfurl + bcast */
+    double sim_mean;  /* mean simulated unfurl + bcast */
+    double sim_max;   /* worst simulated unfurl + bcast */
+} sim_choice;
+
+static int
+choice_cmp (const void * a, const void * b)
+{
+    const sim_choice* x = (const sim_choice*) a;
+    const sim_choice* y = (const sim_choice*) b;
+    if (x->total != y->total) {
+        return (x->total < y->total) ? -1 : 1;
+    }
+    return 0;
+}
+
+static int
+choice_sim_cmp (const void * a, const void * b)
+{
+    const sim_choice* x = (const sim_choice*) a;
+    const sim_choice* y = (const sim_choice*) b;
+    if (x->sim_mean != y->sim_mean) {
+        return (x->sim_mean < y->sim_mean) ? -1 : 1;
+    }
+    return 0;
+}
+
+/* rank every shape, degree, and chunk size with the model, fills in
+ * choices and returns count, caller frees */
+static int
+model_choices (const launch_model_params * p, int ranks, size_t bytes,
+        size_t entry_bytes, int max_degree, sim_choice ** choices)
+{
+    int count = 0;
+    *choices = NULL;
+
+    int shape;
+    for (shape = LAUNCH_SHAPE_KARY; shape <= LAUNCH_SHAPE_KNOMIAL; shape++) {
+        int degree;
+        for (degree = 2; degree <= max_degree; degree++) {
+            if (degree > 2 && degree > ranks - 1) {
+                break;
+            }
+
+            launch_shape sh = (launch_shape) shape;
+            double unfurl = launch_model_unfurl(p, ranks, sh, degree);
+            double gather = launch_model_gather(p, ranks, sh, degree, entry_bytes);
+
+            /* whole file, then chunks of powers of two MB */
+            size_t chunk = 0;
+            while (1) {
+                if (chunk == 0 || (bytes + chunk - 1) / chunk <= 4096) {
+                    *choices = (sim_choice*) realloc(*choices, (count + 1) * sizeof(sim_choice));
+                    sim_choice* c = &(*choices)[count++];
+                    c->shape    = sh;
+                    c->degree   = degree;
+                    c->chunk    = chunk;
+                    c->unfurl   = unfurl;
+                    c->bcast    = launch_model_bcast(p, ranks, sh, degree, bytes, chunk);
+                    c->gather   = gather;
+                    c->total    = c->unfurl + c->bcast;
+                    c->sim_mean = 0.0;
+                    c->sim_max  = 0.0;
+                }
+
+                chunk = (chunk == 0) ? 1024 * 1024 : chunk * 2;
+                if (chunk >= bytes) {
+                    break;
+                }
+            }
+        }
+    }
+
+    qsort(*choices, count, sizeof(sim_choice), choice_cmp);
+    return count;
+}
+
+static void
+print_choice (const sim_choice * c, int simulated)
+{
+    char chunk[32];
+    if (c->chunk == 0) {
+        strcpy(chunk, "whole");
+    } else {
+        snprintf(chunk, sizeof(chunk), "%zuMB", c->chunk / (1024 * 1024));
+    }
+    printf("  %-8s %6d %8s %12.3f %12.3f %12.3f %12.3f",
+        launch_model_shape_name(c->shape), c->degree, chunk,
+        c->unfurl / 1000.0, c->bcast / 1000.0, c->gather / 1000.0,
+        c->total / 1000.0);
+    if (simulated) {
+        printf(" %12.3f %12.3f", c->sim_mean / 1000.0, c->sim_max / 1000.0);
+    }
+    printf("\n");
+}
+
+static void
+usage (void)
+{
+    printf("Usage: avasim [options]\n");
+    printf("  -c FILE   fit params to timings in CSV from avalaunch or avabench (repeatable)\n");
+    printf("  -N NUM    node count of runs in CSV files that don't record it\n");
+    printf("  -D NUM    tree degree of runs in CSV files that don't record it\n");
+    printf("  -B BYTES  bcast file size of runs in CSV files that don't record it\n");
+    printf("  -P FILE   read params from profile file\n");
+    printf("  -p K=V    set param K to V, e.g., -p rsh_usecs=20000 (repeatable)\n");
+    printf("  -w FILE   write params to profile file\n");
+    printf("  -n LIST   node counts to predict, including root (default: \"1024\")\n");
+    printf("  -s MB     size of file to bcast (default: 0)\n");
+    printf("  -e BYTES  size of each entry in gather (default: 64)\n");
+    printf("  -d NUM    largest degree to consider (default: 64)\n");
+    printf("  -t NUM    number of best choices to simulate (default: 5)\n");
+    printf("  -r NUM    simulations of each choice (default: 5)\n");
+    printf("  -R SEED   random seed (default: 1)\n");
+}
+
+int
+main (int argc, char * argv[])
+{
+    launch_model_params p;
+    launch_model_defaults(&p);
+
+    char** csv_files = NULL;
+    int num_csv = 0;
+    char** sets = NULL;
+    int num_sets = 0;
+    const char* profile_in = NULL;
+    sim_run* runs = NULL;
+    int num_runs = 0;
+    int run_nodes = 0, run_degree = 0;
+    double run_bytes = 0.0;
+    const char* profile_out = NULL;
+    const char* nodes_list = "1024";
+    double file_mb = 0.0;
+    size_t entry_bytes = 64;
+    int max_degree = 64;
+    int top = 5;
+    int reps = 5;
+    uint64_t seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:N:D:B:P:p:w:n:s:e:d:t:r:R:h")) != -1) {
+        switch (opt) {
+        case 'c':
+            csv_files = (char**) realloc(csv_files, (num_csv + 1) * sizeof(char*));
+            csv_files[num_csv++] = optarg;
+            break;
+        case 'N': run_nodes  = atoi(optarg); break;
+        case 'D': run_degree = atoi(optarg); break;
+        case 'B': run_bytes  = atof(optarg); break;
+        case 'P': profile_in = optarg; break;
+        case 'p':
+            if (strchr(optarg, '=') == NULL) {
+                usage();
+                return 1;
+            }
+            sets = (char**) realloc(sets, (num_sets + 1) * sizeof(char*));
+            sets[num_sets++] = optarg;
+            break;
+        case 'w': profile_out = optarg; break;
+        case 'n': nodes_list  = optarg; break;
+        case 's': file_mb     = atof(optarg); break;
+        case 'e': entry_bytes = (size_t) atol(optarg); break;
+        case 'd': max_degree  = atoi(optarg); break;
+        case 't': top         = atoi(optarg); break;
+        case 'r': reps        = atoi(optarg); break;
+        case 'R': seed        = (uint64_t) atoll(optarg); break;
+        default:
+            usage();
+            return (opt == 'h') ? 0 : 1;
+        }
+    }
+    if (max_degree < 2) {
+        max_degree = 2;
+    }
+    if (top < 1) {
+        top = 1;
+    }
+    if (reps < 1) {
+        reps = 1;
+    }
+    size_t bytes = (size_t) (file_mb * 1024.0 * 1024.0);
+
+    /* start from profile, fit to measured runs, then apply -p */
+    if (profile_in != NULL && launch_model_read(profile_in, &p) != 0) {
+        fprintf(stderr, "avasim: failed to read profile `%s'\n", profile_in);
+        return 1;
+    }
+
+    int i;
+    for (i = 0; i < num_csv; i++) {
+        num_runs = read_runs(csv_files[i], run_nodes, run_degree, run_bytes, &runs, num_runs);
+    }
+    fit_params(runs, num_runs, &p);
+
+    for (i = 0; i < num_sets; i++) {
+        char* eq = strchr(sets[i], '=');
+        *eq = '\0';
+        if (launch_model_set(&p, sets[i], eq + 1) != 0) {
+            fprintf(stderr, "avasim: bad param `%s'\n", sets[i]);
+            return 1;
+        }
+    }
+
+    printf("params (usecs, MB/s):\n");
+    printf("  fork %.1f (p99 %.1f), rsh %.1f (p99 %.1f), accept %.1f\n",
+        p.fork_usecs, p.fork_p99, p.rsh_usecs, p.rsh_p99, p.accept_usecs);
+    printf("  send %.1f, hop %.1f, bw %.1f, host bytes %.1f, pack %.3f\n",
+        p.send_usecs, p.hop_usecs, p.bw_mbs, p.host_bytes, p.pack_usecs);
+
+    /* show how well the model matches the runs it was fit to */
+    if (num_runs > 0) {
+        printf("\nfit check, unfurl tree in msecs:\n");
+        printf("  %-40s %12s %12s\n", "run", "measured", "model");
+        for (i = 0; i < num_runs; i++) {
+            sim_run* r = &runs[i];
+            if (r->failed || r->sample.nodes < 1 || r->sample.degree < 1 || r->unfurl <= 0.0) {
+                continue;
+            }
+            double model = launch_model_unfurl(&p, r->sample.nodes, r->sample.shape, r->sample.degree);
+            printf("  %-40s %12.3f %12.3f\n", (r->key[0] != '\0') ? r->key : "(run)",
+                r->unfurl * 1000.0, model / 1000.0);
+        }
+    }
+
+    if (profile_out != NULL) {
+        if (launch_model_write(profile_out, &p) != 0) {
+            return 1;
+        }
+        printf("\nwrote profile to %s\n", profile_out);
+    }
+
+    char* list = strdup(nodes_list);
+    char* tok;
+    for (tok = strtok(list, " ,"); tok != NULL; tok = strtok(NULL, " ,")) {
+        int ranks = atoi(tok);
+        if (ranks < 1) {
+            continue;
+        }
+
+        sim_choice* choices;
+        int count = model_choices(&p, ranks, bytes, entry_bytes, max_degree, &choices);
+        if (count == 0) {
+            continue;
+        }
+
+        printf("\nnodes=%d file=%.1fMB, best choices by model (msecs):\n", ranks, file_mb);
+        printf("  %-8s %6s %8s %12s %12s %12s %12s %12s %12s\n",
+            "shape", "degree", "chunk", "unfurl", "bcast", "gather", "total",
+            "sim mean", "sim max");
+
+        /* run the best few through the event simulation */
+        int sims = (count < top) ? count : top;
+        int c;
+        for (c = 0; c < sims; c++) {
+            sim_choice* ch = &choices[c];
+
+            /* bcast with too many chunks is left to the model */
+            size_t chunks = (ch->chunk > 0) ? (bytes + ch->chunk - 1) / ch->chunk : 1;
+            int bcast_sim = (chunks <= SIM_MAX_CHUNKS);
+
+            sim s;
+            sim_init(&s, &p, ch->shape, ch->degree, ranks, seed);
+            double sum = 0.0;
+            double max = 0.0;
+            int rep;
+            for (rep = 0; rep < reps; rep++) {
+                s.rng = (seed + rep) * 0x9E3779B97F4A7C15ULL + 1;
+                double t = sim_unfurl(&s);
+                t += bcast_sim ? sim_bcast(&s, bytes, ch->chunk) : ch->bcast;
+                sum += t;
+                if (t > max) {
+                    max = t;
+                }
+            }
+            ch->sim_mean = sum / (double) reps;
+            ch->sim_max  = max;
+
+            /* gather has no variance, so one run will do */
+            ch->gather = sim_gather(&s, entry_bytes);
+            sim_free(&s);
+        }
+
+        qsort(choices, sims, sizeof(sim_choice), choice_sim_cmp);
+        for (c = 0; c < sims; c++) {
+            print_choice(&choices[c], 1);
+        }
+
+        sim_choice* best = &choices[0];
+        printf("recommend: MV2_SPAWN_TREE=%s MV2_SPAWN_DEGREE=%d",
+            launch_model_shape_name(best->shape), best->degree);
+        if (best->chunk > 0) {
+            printf(" MV2_SPAWN_BIN_CHUNK_SIZE=%zu", best->chunk / (1024 * 1024));
+        }
+        printf("\n");
+
+        free(choices);
+    }
+    free(list);
+
+    for (i = 0; i < num_runs; i++) {
+        free(runs[i].key);
+    }
+    free(runs);
+    free(sets);
+    free(csv_files);
+
+    return 0;
+}
@@ -0,0 +1,542 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* PMI microbenchmark: each rank puts a number of keys, commits,
+ * fences, and then gets keys following a pattern, repeating for a
+ * number of fences.  Every rank times each operation and records
+ * the times in a log-scale histogram, at the end ranks publish their
+ * histograms through PMI and rank 0 merges them and prints a latency
+ * distribution for each operation across all ranks.
+ *
+ * PMI limits values to PMI_KVS_Get_value_length_max bytes, a larger
+ * value is split across that many keys, and a put or get of such a
+ * value is timed as one operation covering all of its pieces. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "pmi.h"
+
+/* operations we time */
+enum {
+  OP_PUT = 0,
+  OP_COMMIT,
+  OP_FENCE,
+  OP_GET,
+  OP_COUNT,
+};
+
+static const char* op_names[OP_COUNT] = { "put", "commit", "fence", "get" };
+
+/* get patterns */
+enum {
+  PATTERN_NEIGHBORS = 0, /* all keys of left and right rank */
+  PATTERN_RANDOM,        /* randomly chosen keys of random ranks */
+  PATTERN_ALL,           /* all keys of all ranks */
+};
+
+/* histogram has 4 buckets per power of two nsecs, up to 2^40 nsecs */
+#define HIST_SUB     (4)
+#define HIST_BUCKETS (40 * HIST_SUB)
+
+typedef struct {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  int max_rank; /* rank that recorded max, filled in on merge */
+  uint64_t hist[HIST_BUCKETS];
+} op_stats;
+
+static char* kvs;    /* name of our kvs */
+static int key_len;  /* max key length */
+static int val_len;  /* max value length */
+
+static uint64_t
+now_nsecs (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static int
+hist_bucket (uint64_t nsecs)
+{
+  if (nsecs < HIST_SUB) {
+    return (int) nsecs;
+  }
+
+  /* find leading bit, then use next bits to pick sub-bucket */
+  int bit = 63 - __builtin_clzll(nsecs);
+  int sub = (int) ((nsecs >> (bit - 2)) & (HIST_SUB - 1));
+  int bucket = (bit - 1) * HIST_SUB + sub;
+  if (bucket >= HIST_BUCKETS) {
+    bucket = HIST_BUCKETS - 1;
+  }
+  return bucket;
+}
+
+/* returns lower edge of bucket in nsecs */
+static uint64_t
+hist_value (int bucket)
+{
+  if (bucket < HIST_SUB) {
+    return (uint64_t) bucket;
+  }
+  int bit = bucket / HIST_SUB + 1;
+  uint64_t sub = (uint64_t) (bucket % HIST_SUB);
+  return (1ULL << bit) + (sub << (bit - 2));
+}
+
+static void
+stats_init (op_stats* st)
+{
+  memset(st, 0, sizeof(op_stats));
+  st->min = UINT64_MAX;
+  st->max_rank = -1;
+}
+
+static void
+stats_add (op_stats* st, uint64_t nsecs)
+{
+  st->count++;
+  st->sum += nsecs;
+  if (nsecs < st->min) {
+    st->min = nsecs;
+  }
+  if (nsecs > st->max) {
+    st->max = nsecs;
+  }
+  st->hist[hist_bucket(nsecs)]++;
+}
+
+static void
+stats_merge (op_stats* dst, const op_stats* src, int rank)
+{
+  if (src->count == 0) {
+    return;
+  }
+  dst->count += src->count;
+  dst->sum   += src->sum;
+  if (src->min < dst->min) {
+    dst->min = src->min;
+  }
+  if (src->max > dst->max || dst->max_rank < 0) {
+    dst->max = src->max;
+    dst->max_rank = rank;
+  }
+  int i;
+  for (i = 0; i < HIST_BUCKETS; i++) {
+    dst->hist[i] += src->hist[i];
+  }
+}
+
+/* returns estimate of the given percentile from histogram */
+static uint64_t
+stats_percentile (const op_stats* st, double pct)
+{
+  uint64_t target = (uint64_t) ((double) st->count * pct / 100.0);
+  if (target >= st->count) {
+    target = st->count - 1;
+  }
+  uint64_t seen = 0;
+  int i;
+  for (i = 0; i < HIST_BUCKETS; i++) {
+    seen += st->hist[i];
+    if (seen > target) {
+      /* clamp bucket edge to the range we actually saw */
+      uint64_t val = hist_value(i);
+      if (val < st->min) {
+        val = st->min;
+      }
+      if (val > st->max) {
+        val = st->max;
+      }
+      return val;
+    }
+  }
+  return st->max;
+}
+
+/* encode stats as "count sum min max b:c b:c ...", caller frees */
+static char*
+stats_encode (const op_stats* st)
+{
+  size_t len = 64 + HIST_BUCKETS * 32;
+  char* str = malloc(len);
+  size_t pos = snprintf(str, len, "%llu %llu %llu %llu",
+    (unsigned long long) st->count, (unsigned long long) st->sum,
+    (unsigned long long) st->min, (unsigned long long) st->max);
+  int i;
+  for (i = 0; i < HIST_BUCKETS; i++) {
+    if (st->hist[i] > 0) {
+      pos += snprintf(str + pos, len - pos, " %d:%llu", i,
+        (unsigned long long) st->hist[i]);
+    }
+  }
+  return str;
+}
+
+static void
+stats_decode (const char* str, op_stats* st)
+{
+  stats_init(st);
+  unsigned long long count, sum, min, max;
+  int n;
+  if (sscanf(str, "%llu %llu %llu %llu%n", &count, &sum, &min, &max, &n) != 4) {
+    return;
+  }
+  st->count = count;
+  st->sum   = sum;
+  st->min   = min;
+  st->max   = max;
+  str += n;
+
+  int bucket;
+  unsigned long long c;
+  while (sscanf(str, " %d:%llu%n", &bucket, &c, &n) == 2) {
+    if (bucket >= 0 && bucket < HIST_BUCKETS) {
+      st->hist[bucket] = c;
+    }
+    str += n;
+  }
+}
+
+/* number of keys needed to hold a value of given size */
+static int
+num_pieces (int size)
+{
+  int piece = val_len - 1;
+  if (size <= piece) {
+    return 1;
+  }
+  return (size + piece - 1) / piece;
+}
+
+/* fill buf with a value of given size that identifies its owner */
+static void
+make_value (char* buf, int size, int rank, int fence, int id)
+{
+  int i;
+  char c = (char) ('a' + (rank + fence + id) % 26);
+  for (i = 0; i < size; i++) {
+    buf[i] = c;
+  }
+  buf[size] = '\0';
+}
+
+/* put value under key, splitting into pieces if it's too long */
+static int
+put_value (const char* key, const char* value)
+{
+  int size = (int) strlen(value);
+  int pieces = num_pieces(size);
+  if (pieces == 1) {
+    return PMI_KVS_Put(kvs, key, value);
+  }
+
+  int rc = PMI_SUCCESS;
+  char* piece_key = malloc(key_len);
+  char* piece_val = malloc(val_len);
+  int i;
+  for (i = 0; i < pieces; i++) {
+    int offset = i * (val_len - 1);
+    int len = size - offset;
+    if (len > val_len - 1) {
+      len = val_len - 1;
+    }
+    snprintf(piece_key, key_len, "%s.%d", key, i);
+    memcpy(piece_val, value + offset, len);
+    piece_val[len] = '\0';
+    if (PMI_KVS_Put(kvs, piece_key, piece_val) != PMI_SUCCESS) {
+      rc = PMI_FAIL;
+    }
+  }
+  free(piece_val);
+  free(piece_key);
+  return rc;
+}
+
+/* get one piece under key into buf, from the rank that put it with
+ * PMIX_Get if owner is set, which a fence without collect requires */
+static int
+get_piece (const char* key, int owner, char* buf)
+{
+  if (owner >= 0) {
+    return PMIX_Get(owner, key, buf, val_len);
+  }
+  return PMI_KVS_Get(kvs, key, buf, val_len);
+}
+
+/* get value of given size under key into buf, reassembling pieces,
+ * owner is the rank that put it or -1 if the key was collected */
+static int
+get_value (const char* key, int owner, char* buf, int size)
+{
+  int pieces = num_pieces(size);
+  if (pieces == 1) {
+    return get_piece(key, owner, buf);
+  }
+
+  int rc = PMI_SUCCESS;
+  char* piece_key = malloc(key_len);
+  int i;
+  for (i = 0; i < pieces; i++) {
+    snprintf(piece_key, key_len, "%s.%d", key, i);
+    if (get_piece(piece_key, owner, buf + i * (val_len - 1)) != PMI_SUCCESS) {
+      rc = PMI_FAIL;
+    }
+  }
+  free(piece_key);
+  return rc;
+}
+
+static void
+usage (void)
+{
+  printf("Usage: pmi_bench [options]\n");
+  printf("  -k NUM    keys each rank puts per fence (default 1)\n");
+  printf("  -s BYTES  size of each value (default 64)\n");
+  printf("  -f NUM    number of fences (default 1)\n");
+  printf("  -g PAT    get pattern: neighbors, random, or all (default neighbors)\n");
+  printf("  -n NUM    gets per rank per fence for random pattern (default keys)\n");
+  printf("  -c 0|1    fence collects data (1) or not (0, direct modex) (default 1)\n");
+  printf("  -r SEED   seed for random pattern (default 1)\n");
+}
+
+int main(int argc, char* argv[])
+{
+  int i, j, f;
+
+  int keys    = 1;
+  int size    = 64;
+  int fences  = 1;
+  int pattern = PATTERN_NEIGHBORS;
+  int gets    = -1;
+  int collect = 1;
+  unsigned int seed = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "k:s:f:g:n:c:r:h")) != -1) {
+    switch (opt) {
+    case 'k': keys    = atoi(optarg); break;
+    case 's': size    = atoi(optarg); break;
+    case 'f': fences  = atoi(optarg); break;
+    case 'n': gets    = atoi(optarg); break;
+    case 'c': collect = atoi(optarg); break;
+    case 'r': seed    = (unsigned int) atoi(optarg); break;
+    case 'g':
+      if (strcmp(optarg, "neighbors") == 0) {
+        pattern = PATTERN_NEIGHBORS;
+      } else if (strcmp(optarg, "random") == 0) {
+        pattern = PATTERN_RANDOM;
+      } else if (strcmp(optarg, "all") == 0) {
+        pattern = PATTERN_ALL;
+      } else {
+        usage();
+        return 1;
+      }
+      break;
+    default:
+      usage();
+      return (opt == 'h') ? 0 : 1;
+    }
+  }
+  if (gets < 0) {
+    gets = keys;
+  }
+  if (size < 1) {
+    size = 1;
+  }
+
+  int spawned;
+  PMI_Init(&spawned);
+
+  int rank, ranks;
+  PMI_Get_rank(&rank);
+  PMI_Get_size(&ranks);
+
+  int kvs_len;
+  PMI_KVS_Get_name_length_max(&kvs_len);
+  PMI_KVS_Get_key_length_max(&key_len);
+  PMI_KVS_Get_value_length_max(&val_len);
+
+  kvs = malloc(kvs_len);
+  PMI_KVS_Get_my_name(kvs, kvs_len);
+
+  char* key    = malloc(key_len);
+  char* val    = malloc(size + 1);
+  char* expect = malloc(size + 1);
+  char* got    = malloc(num_pieces(size) * val_len + 1);
+
+  op_stats stats[OP_COUNT];
+  for (i = 0; i < OP_COUNT; i++) {
+    stats_init(&stats[i]);
+  }
+
+  srand(seed + (unsigned int) rank);
+
+  uint64_t errors = 0;
+  for (f = 0; f < fences; f++) {
+    /* put our keys */
+    for (i = 0; i < keys; i++) {
+      snprintf(key, key_len, "b%d-%d-%d", f, rank, i);
+      make_value(val, size, rank, f, i);
+      uint64_t start = now_nsecs();
+      if (put_value(key, val) != PMI_SUCCESS) {
+        errors++;
+      }
+      stats_add(&stats[OP_PUT], now_nsecs() - start);
+    }
+
+    uint64_t start = now_nsecs();
+    PMI_KVS_Commit(kvs);
+    stats_add(&stats[OP_COMMIT], now_nsecs() - start);
+
+    start = now_nsecs();
+    if (collect) {
+      PMI_Barrier();
+    } else {
+      PMIX_Fence(0);
+    }
+    stats_add(&stats[OP_FENCE], now_nsecs() - start);
+
+    /* count number of gets for this pattern */
+    int count;
+    if (pattern == PATTERN_NEIGHBORS) {
+      count = 2 * keys;
+    } else if (pattern == PATTERN_RANDOM) {
+      count = (keys > 0) ? gets : 0;
+    } else {
+      count = ranks * keys;
+    }
+
+    for (j = 0; j < count; j++) {
+      /* pick rank and key id to fetch */
+      int target, id;
+      if (pattern == PATTERN_NEIGHBORS) {
+        int left  = (rank + ranks - 1) % ranks;
+        int right = (rank + 1) % ranks;
+        target = (j < keys) ? left : right;
+        id = j % keys;
+      } else if (pattern == PATTERN_RANDOM) {
+        target = rand() % ranks;
+        id = rand() % keys;
+      } else {
+        target = j / keys;
+        id = j % keys;
+      }
+
+      snprintf(key, key_len, "b%d-%d-%d", f, target, id);
+      start = now_nsecs();
+      int rc = get_value(key, collect ? -1 : target, got, size);
+      stats_add(&stats[OP_GET], now_nsecs() - start);
+
+      /* check that we got what the owner put */
+      make_value(expect, size, target, f, id);
+      if (rc != PMI_SUCCESS || strncmp(got, expect, size) != 0) {
+        errors++;
+      }
+    }
+  }
+
+  /* publish our stats and error count, then rank 0 merges them */
+  for (i = 0; i < OP_COUNT; i++) {
+    char* str = stats_encode(&stats[i]);
+    snprintf(key, key_len, "stats-%s-%d", op_names[i], rank);
+    put_value(key, str);
+    snprintf(key, key_len, "stats-%s-%d-len", op_names[i], rank);
+    char lenstr[32];
+    snprintf(lenstr, sizeof(lenstr), "%d", (int) strlen(str));
+    PMI_KVS_Put(kvs, key, lenstr);
+    free(str);
+  }
+  char errstr[32];
+  snprintf(key, key_len, "stats-errors-%d", rank);
+  snprintf(errstr, sizeof(errstr), "%llu", (unsigned long long) errors);
+  PMI_KVS_Put(kvs, key, errstr);
+  PMI_KVS_Commit(kvs);
+  PMI_Barrier();
+
+  if (rank == 0) {
+    op_stats all[OP_COUNT];
+    for (i = 0; i < OP_COUNT; i++) {
+      stats_init(&all[i]);
+    }
+
+    uint64_t total_errors = 0;
+    char* lenstr = malloc(val_len);
+    for (j = 0; j < ranks; j++) {
+      for (i = 0; i < OP_COUNT; i++) {
+        snprintf(key, key_len, "stats-%s-%d-len", op_names[i], j);
+        if (PMI_KVS_Get(kvs, key, lenstr, val_len) != PMI_SUCCESS) {
+          continue;
+        }
+        int len = atoi(lenstr);
+        char* str = malloc(num_pieces(len) * val_len + 1);
+        snprintf(key, key_len, "stats-%s-%d", op_names[i], j);
+        if (get_value(key, -1, str, len) == PMI_SUCCESS) {
+          str[len] = '\0';
+          op_stats st;
+          stats_decode(str, &st);
+          stats_merge(&all[i], &st, j);
+        }
+        free(str);
+      }
+
+      snprintf(key, key_len, "stats-errors-%d", j);
+      if (PMI_KVS_Get(kvs, key, lenstr, val_len) == PMI_SUCCESS) {
+        total_errors += strtoull(lenstr, NULL, 10);
+      }
+    }
+    free(lenstr);
+
+    const char* pattern_names[] = { "neighbors", "random", "all" };
+    printf("PMI benchmark: ranks=%d keys=%d value_size=%d (%d pieces) fences=%d pattern=%s collect=%d\n",
+      ranks, keys, size, num_pieces(size), fences, pattern_names[pattern], collect);
+    printf("%-8s %10s %12s %12s %12s %12s %12s %12s %8s\n",
+      "op", "count", "min (us)", "mean (us)", "p50 (us)", "p90 (us)",
+      "p99 (us)", "max (us)", "max rank");
+    for (i = 0; i < OP_COUNT; i++) {
+      op_stats* st = &all[i];
+      if (st->count == 0) {
+        printf("%-8s %10d\n", op_names[i], 0);
+        continue;
+      }
+      printf("%-8s %10llu %12.3f %12.3f %12.3f %12.3f %12.3f %12.3f %8d\n",
+        op_names[i], (unsigned long long) st->count,
+        (double) st->min / 1000.0,
+        (double) st->sum / (double) st->count / 1000.0,
+        (double) stats_percentile(st, 50.0) / 1000.0,
+        (double) stats_percentile(st, 90.0) / 1000.0,
+        (double) stats_percentile(st, 99.0) / 1000.0,
+        (double) st->max / 1000.0,
+        st->max_rank);
+    }
+    printf("errors: %llu\n", (unsigned long long) total_errors);
+    fflush(stdout);
+  }
+
+  free(got);
+  free(expect);
+  free(val);
+  free(key);
+  free(kvs);
+
+  PMI_Finalize();
+
+  return 0;
+}
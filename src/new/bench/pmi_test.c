@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "pmi.h"
 
@@ -34,6 +35,30 @@ int main(int argc, char* argv[])
   //printf("Rank %d, Name %s\n", rank, kvs);
   //fflush(stdout);
 
+  /* to measure exchange volume, each rank may put an extra number
+   * of keys given by argv[1], whose values have size given by argv[2],
+   * usage: pmi_test [keys [value_size]] */
+  int nkeys   = (argc > 1) ? atoi(argv[1]) : 0;
+  int valsize = (argc > 2) ? atoi(argv[2]) : 8;
+  if (valsize > val_len - 1) {
+    valsize = val_len - 1;
+  }
+  if (valsize < 0) {
+    valsize = 0;
+  }
+
+  int i;
+  memset(val, 'x', valsize);
+  val[valsize] = '\0';
+  for (i = 0; i < nkeys; i++) {
+    snprintf(key, key_len, "bench-%d-%d", rank, i);
+    rc = PMI_KVS_Put(kvs, key, val);
+    if (rc != PMI_SUCCESS) {
+      printf("Rank %d PMI_KVS_Put rc=%d\n", rank, rc);
+      fflush(stdout);
+    }
+  }
+
   /* create key and value */
   snprintf(key, key_len, "%d", rank);
   snprintf(val, val_len, "value=%dof%d", rank, ranks);
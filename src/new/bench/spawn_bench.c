@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* Process start microbenchmark: grows its heap to each of a list of
+ * sizes, touching every page as the launcher does when it fills in
+ * strmaps and file buffers, and then times starting a program and
+ * waiting for it to exit, once with fork and exec as avalaunch used
+ * to, and once with vfork and exec as it does now.  The fork cost
+ * grows with the heap since fork copies page tables, while the vfork
+ * cost should stay flat.  This runs on its own, not under avalaunch:
+ *
+ *   ./spawn_bench -n 200 -m "0 256 1024 4096"
+ *
+ * prints one line per heap size with the mean usecs per start. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+static uint64_t
+now_nsecs (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/* start exe count times with fork or vfork and wait for each,
+ * returns mean nsecs per start or 0 on error */
+static uint64_t
+time_starts (const char* exe, int count, int use_vfork)
+{
+  char* argv[] = { (char*) exe, NULL };
+  uint64_t start = now_nsecs();
+  int i;
+  for (i = 0; i < count; i++) {
+    pid_t pid = use_vfork ? vfork() : fork();
+    if (pid == 0) {
+      execv(exe, argv);
+      _exit(127);
+    }
+    if (pid < 0) {
+      fprintf(stderr, "spawn_bench: %s failed: %s\n",
+        use_vfork ? "vfork" : "fork", strerror(errno));
+      return 0;
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) != pid ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+      fprintf(stderr, "spawn_bench: `%s' did not exit cleanly\n", exe);
+      return 0;
+    }
+  }
+  return (now_nsecs() - start) / (uint64_t) count;
+}
+
+static void
+usage (void)
+{
+  printf("Usage: spawn_bench [options]\n");
+  printf("  -n NUM    starts to time for each heap size and method (default 100)\n");
+  printf("  -m LIST   heap sizes in MB (default \"0 64 256 1024\")\n");
+  printf("  -e EXE    program to start (default /bin/true)\n");
+}
+
+int main(int argc, char* argv[])
+{
+  int count = 100;
+  const char* sizes = "0 64 256 1024";
+  const char* exe = "/bin/true";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:m:e:h")) != -1) {
+    switch (opt) {
+    case 'n': count = atoi(optarg); break;
+    case 'm': sizes = optarg; break;
+    case 'e': exe   = optarg; break;
+    default:
+      usage();
+      return (opt == 'h') ? 0 : 1;
+    }
+  }
+  if (count < 1) {
+    count = 1;
+  }
+
+  printf("%8s %12s %12s\n", "heap_mb", "fork_usec", "vfork_usec");
+
+  /* the heap only grows, so list sizes in increasing order */
+  char* heap = NULL;
+  size_t heap_bytes = 0;
+  char* list = strdup(sizes);
+  char* tok;
+  for (tok = strtok(list, " ,"); tok != NULL; tok = strtok(NULL, " ,")) {
+    size_t bytes = (size_t) atol(tok) << 20;
+    if (bytes > heap_bytes) {
+      char* grown = (char*) realloc(heap, bytes);
+      if (grown == NULL) {
+        fprintf(stderr, "spawn_bench: failed to grow heap to %s MB\n", tok);
+        break;
+      }
+      heap = grown;
+
+      /* touch every page so the child would have to map it */
+      size_t off;
+      for (off = heap_bytes; off < bytes; off += 4096) {
+        heap[off] = (char) off;
+      }
+      heap_bytes = bytes;
+    }
+
+    uint64_t fork_nsecs  = time_starts(exe, count, 0);
+    uint64_t vfork_nsecs = time_starts(exe, count, 1);
+    if (fork_nsecs == 0 || vfork_nsecs == 0) {
+      break;
+    }
+    printf("%8lu %12.1f %12.1f\n", (unsigned long) (heap_bytes >> 20),
+      (double) fork_nsecs / 1000.0, (double) vfork_nsecs / 1000.0);
+    fflush(stdout);
+  }
+
+  free(list);
+  free(heap);
+  return 0;
+}
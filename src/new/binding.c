@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+#define _GNU_SOURCE
+#include <binding.h>
+#include <hostlist.h>
+
+#include "spawn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define BINDING_CPU_DIR  "/sys/devices/system/cpu"
+#define BINDING_NODE_DIR "/sys/devices/system/node"
+
+/* largest numa node id we can name in a memory policy */
+#define BINDING_MAX_NUMA (1024)
+
+/* from linux/mempolicy.h, which not all systems install */
+#ifndef MPOL_BIND
+#define MPOL_BIND (2)
+#endif
+
+/*******************************
+ * Topology
+ ******************************/
+
+/* reads first line of a sysfs file into buf without its newline,
+ * returns 0 on success */
+static int
+read_line (const char * path, char * buf, size_t size)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return 1;
+    }
+    char* line = fgets(buf, (int) size, fp);
+    fclose(fp);
+    if (line == NULL) {
+        return 1;
+    }
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+/* reads integer from sysfs file, returns dflt if it can't */
+static int
+read_int (const char * path, int dflt)
+{
+    char buf[64];
+    if (read_line(path, buf, sizeof(buf)) != 0) {
+        return dflt;
+    }
+    return atoi(buf);
+}
+
+/* returns array of count integers in a sysfs cpu or node list like
+ * "0-31,64-95", or NULL if it can't be read */
+static int *
+read_list (const char * path, int * count)
+{
+    char buf[4096];
+    if (read_line(path, buf, sizeof(buf)) != 0 || buf[0] == '\0') {
+        *count = 0;
+        return NULL;
+    }
+    return hostlist_expand_ints(buf, count);
+}
+
+/* one online cpu while we sort them */
+typedef struct binding_cpu_t {
+    int id;      /* os id of cpu */
+    int package; /* os id of its socket */
+    int core;    /* os id of its core, unique within socket */
+    int node;    /* os id of its numa node */
+} binding_cpu;
+
+static int
+binding_cpu_cmp (const void * a, const void * b)
+{
+    const binding_cpu* x = (const binding_cpu*) a;
+    const binding_cpu* y = (const binding_cpu*) b;
+    if (x->package != y->package) {
+        return (x->package < y->package) ? -1 : 1;
+    }
+    if (x->core != y->core) {
+        return (x->core < y->core) ? -1 : 1;
+    }
+    return (x->id < y->id) ? -1 : (x->id > y->id);
+}
+
+binding_topo *
+binding_topo_read (void)
+{
+    char path[256];
+
+    /* get cpus that are online */
+    int online;
+    int* ids = read_list(BINDING_CPU_DIR "/online", &online);
+    if (ids == NULL) {
+        SPAWN_ERR("Failed to read online cpus from `%s'", BINDING_CPU_DIR "/online");
+        return NULL;
+    }
+
+    /* only consider cpus we may run on ourself, a resource manager
+     * may have given us part of the node */
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        SPAWN_ERR("Failed to read cpu affinity (sched_getaffinity errno=%d %s)",
+            errno, strerror(errno));
+        spawn_free(&ids);
+        return NULL;
+    }
+
+    binding_cpu* cpus = (binding_cpu*) SPAWN_MALLOC(online * sizeof(binding_cpu));
+    int count = 0;
+    int i;
+    for (i = 0; i < online; i++) {
+        int id = ids[i];
+        if (id < 0 || id >= CPU_SETSIZE || !CPU_ISSET(id, &allowed)) {
+            continue;
+        }
+        binding_cpu* c = &cpus[count];
+        c->id = id;
+        snprintf(path, sizeof(path), BINDING_CPU_DIR "/cpu%d/topology/physical_package_id", id);
+        c->package = read_int(path, 0);
+        snprintf(path, sizeof(path), BINDING_CPU_DIR "/cpu%d/topology/core_id", id);
+        c->core = read_int(path, id);
+        c->node = -1;
+        count++;
+    }
+    spawn_free(&ids);
+
+    if (count == 0) {
+        SPAWN_ERR("No online cpus in our affinity mask");
+        spawn_free(&cpus);
+        return NULL;
+    }
+
+    /* assign numa node of each cpu, a kernel without numa support
+     * has no node directory so all cpus are on node 0 */
+    int nodes;
+    int* node_ids = read_list(BINDING_NODE_DIR "/online", &nodes);
+    int n;
+    for (n = 0; n < nodes; n++) {
+        int node_cpus;
+        snprintf(path, sizeof(path), BINDING_NODE_DIR "/node%d/cpulist", node_ids[n]);
+        int* list = read_list(path, &node_cpus);
+        int j;
+        for (j = 0; j < node_cpus; j++) {
+            for (i = 0; i < count; i++) {
+                if (cpus[i].id == list[j]) {
+                    cpus[i].node = node_ids[n];
+                    break;
+                }
+            }
+        }
+        spawn_free(&list);
+    }
+    spawn_free(&node_ids);
+
+    qsort(cpus, count, sizeof(binding_cpu), binding_cpu_cmp);
+
+    /* number sockets, cores, and numa nodes in the order we meet
+     * them, numa nodes without any of our cpus are left out */
+    binding_topo* topo = (binding_topo*) SPAWN_MALLOC(sizeof(binding_topo));
+    topo->cpus    = count;
+    topo->cpu     = (int*) SPAWN_MALLOC(count * sizeof(int));
+    topo->socket  = (int*) SPAWN_MALLOC(count * sizeof(int));
+    topo->core    = (int*) SPAWN_MALLOC(count * sizeof(int));
+    topo->numa    = (int*) SPAWN_MALLOC(count * sizeof(int));
+    topo->numa_id = (int*) SPAWN_MALLOC(count * sizeof(int));
+    topo->sockets = 0;
+    topo->cores   = 0;
+    topo->numas   = 0;
+    for (i = 0; i < count; i++) {
+        binding_cpu* c = &cpus[i];
+        if (c->node < 0) {
+            c->node = 0;
+        }
+        if (i == 0 || c->package != cpus[i - 1].package) {
+            topo->sockets++;
+            topo->cores++;
+        } else if (c->core != cpus[i - 1].core) {
+            topo->cores++;
+        }
+
+        for (n = 0; n < topo->numas; n++) {
+            if (topo->numa_id[n] == c->node) {
+                break;
+            }
+        }
+        if (n == topo->numas) {
+            topo->numa_id[n] = c->node;
+            topo->numas++;
+        }
+
+        topo->cpu[i]    = c->id;
+        topo->socket[i] = topo->sockets - 1;
+        topo->core[i]   = topo->cores - 1;
+        topo->numa[i]   = n;
+    }
+
+    spawn_free(&cpus);
+    return topo;
+}
+
+void
+binding_topo_free (binding_topo ** ptopo)
+{
+    if (ptopo == NULL || *ptopo == NULL) {
+        return;
+    }
+
+    binding_topo* topo = *ptopo;
+    spawn_free(&topo->cpu);
+    spawn_free(&topo->socket);
+    spawn_free(&topo->core);
+    spawn_free(&topo->numa);
+    spawn_free(&topo->numa_id);
+    spawn_free(ptopo);
+}
+
+/*******************************
+ * Bindings
+ ******************************/
+
+int
+binding_policy_parse (const char * str)
+{
+    if (strcmp(str, "none") == 0) {
+        return BINDING_NONE;
+    } else if (strcmp(str, "core") == 0) {
+        return BINDING_CORE;
+    } else if (strcmp(str, "socket") == 0) {
+        return BINDING_SOCKET;
+    } else if (strcmp(str, "numa") == 0) {
+        return BINDING_NUMA;
+    }
+    return -1;
+}
+
+void
+binding_block (int index, int count, int parts, int * part, int * slot)
+{
+    int q   = count / parts;
+    int rem = count % parts;
+    if (index < rem * (q + 1)) {
+        *part = index / (q + 1);
+        *slot = index % (q + 1);
+    } else {
+        *part = rem + (index - rem * (q + 1)) / q;
+        *slot = (index - rem * (q + 1)) % q;
+    }
+}
+
+/* add each cpu whose entry in field equals value to binding */
+static void
+add_cpus (const binding_topo * topo, const int * field, int value, binding * b)
+{
+    int i;
+    for (i = 0; i < topo->cpus; i++) {
+        if (field[i] == value) {
+            CPU_SET(topo->cpu[i], &b->cpus);
+            b->cpu_count++;
+        }
+    }
+}
+
+int
+binding_compute (const binding_topo * topo, binding_policy policy,
+    int index, int count, binding * b)
+{
+    CPU_ZERO(&b->cpus);
+    b->cpu_count = 0;
+    b->mem = -1;
+
+    if (topo == NULL || policy == BINDING_NONE || count <= 0) {
+        return 1;
+    }
+
+    int part, slot;
+    switch (policy) {
+    case BINDING_CORE:
+    {
+        /* spread procs over sockets, then take the next core of the
+         * socket, wrapping around if a socket has more procs than
+         * cores */
+        binding_block(index, count, topo->sockets, &part, &slot);
+        int first = -1;
+        int last  = -1;
+        int i;
+        for (i = 0; i < topo->cpus; i++) {
+            if (topo->socket[i] == part) {
+                if (first < 0) {
+                    first = topo->core[i];
+                }
+                last = topo->core[i];
+            }
+        }
+        int core = first + slot % (last - first + 1);
+        add_cpus(topo, topo->core, core, b);
+        break;
+    }
+    case BINDING_SOCKET:
+        binding_block(index, count, topo->sockets, &part, &slot);
+        add_cpus(topo, topo->socket, part, b);
+        break;
+    case BINDING_NUMA:
+        binding_block(index, count, topo->numas, &part, &slot);
+        add_cpus(topo, topo->numa, part, b);
+        b->mem = topo->numa_id[part];
+        break;
+    default:
+        return 1;
+    }
+
+    return 0;
+}
+
+int
+binding_apply (const binding * b)
+{
+    /* make only system calls, this runs in a vforked child */
+    if (sched_setaffinity(0, sizeof(b->cpus), &b->cpus) != 0) {
+        return errno;
+    }
+
+    if (b->mem >= 0 && b->mem < BINDING_MAX_NUMA) {
+        /* the kernel reads one bit less than maxnode */
+        unsigned long mask[BINDING_MAX_NUMA / (8 * sizeof(unsigned long))];
+        memset(mask, 0, sizeof(mask));
+        mask[b->mem / (8 * sizeof(unsigned long))] |=
+            1UL << (b->mem % (8 * sizeof(unsigned long)));
+        if (syscall(SYS_set_mempolicy, MPOL_BIND, mask, BINDING_MAX_NUMA + 1) != 0) {
+            return errno;
+        }
+    }
+
+    return 0;
+}
+
+char *
+binding_string (const binding * b)
+{
+    /* list cpus in id order */
+    int* ids = (int*) SPAWN_MALLOC((b->cpu_count + 1) * sizeof(int));
+    int count = 0;
+    int id;
+    for (id = 0; id < CPU_SETSIZE && count < b->cpu_count; id++) {
+        if (CPU_ISSET(id, &b->cpus)) {
+            ids[count++] = id;
+        }
+    }
+    char* list = hostlist_encode_ints(ids, count);
+    spawn_free(&ids);
+
+    char* str;
+    if (b->mem >= 0) {
+        str = SPAWN_STRDUPF("cpus %s mem %d", list, b->mem);
+    } else {
+        str = SPAWN_STRDUPF("cpus %s", list);
+    }
+    spawn_free(&list);
+    return str;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* CPU and memory binding of app procs.  The spawn proc reads the
+ * node topology from sysfs once, limited to the cpus it may run on
+ * itself, computes a binding for each app proc it starts, and the
+ * child applies it between fork and exec.  The local procs on a node
+ * are spread over sockets (or NUMA nodes) in blocks, the first procs
+ * on the first socket, so a socket rank map and a core binding agree
+ * on where each proc runs:
+ *
+ *   core   - one core, and all of its hardware threads, per proc
+ *   socket - all cpus of one socket
+ *   numa   - all cpus of one NUMA node, and memory only from it
+ *   none   - leave procs with the affinity of the spawn proc
+ *
+ * Core and socket bindings leave the memory policy at the default,
+ * which allocates from the node of the cpu a proc runs on. */
+
+#ifndef SPAWN_BINDING_H
+#define SPAWN_BINDING_H 1
+
+#include <sched.h>
+
+typedef enum binding_policy_types {
+    BINDING_NONE = 0,
+    BINDING_CORE,
+    BINDING_SOCKET,
+    BINDING_NUMA,
+} binding_policy;
+
+typedef struct binding_topo_t {
+    int cpus;      /* number of cpus we may run on */
+    int* cpu;      /* os id of each cpu, ordered by socket, core, then id */
+    int* socket;   /* socket of each cpu, numbered from 0 */
+    int* core;     /* core of each cpu, numbered from 0 across sockets */
+    int* numa;     /* numa node of each cpu, numbered from 0 */
+    int sockets;   /* number of sockets */
+    int cores;     /* number of cores */
+    int numas;     /* number of numa nodes */
+    int* numa_id;  /* os id of each numa node */
+} binding_topo;
+
+typedef struct binding_t {
+    cpu_set_t cpus; /* cpus proc may run on */
+    int cpu_count;  /* number of cpus in set */
+    int mem;        /* os id of numa node to allocate from, -1 for default */
+} binding;
+
+/* reads topology of this node from sysfs, returns NULL after printing
+ * an error if it can't be read, free with binding_topo_free */
+binding_topo* binding_topo_read (void);
+
+void binding_topo_free (binding_topo ** topo);
+
+/* returns policy named by str, or -1 if str is not a policy name */
+int binding_policy_parse (const char * str);
+
+/* spreads count items over parts in blocks, the first count % parts
+ * parts take one extra item, sets part and slot within part of item
+ * index */
+void binding_block (int index, int count, int parts, int * part, int * slot);
+
+/* computes binding of local proc index of count procs on node,
+ * returns 1 if policy leaves the proc unbound, 0 otherwise */
+int binding_compute (const binding_topo * topo, binding_policy policy,
+    int index, int count, binding * b);
+
+/* applies binding to calling process, the memory policy is kept
+ * across exec, returns 0 on success or errno of the call that failed,
+ * prints nothing so it is safe to call in a vforked child */
+int binding_apply (const binding * b);
+
+/* returns description of binding like "cpus 0-7,64-71 mem 0",
+ * caller should free with spawn_free */
+char* binding_string (const binding * b);
+
+#endif
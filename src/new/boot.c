@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+
+#define _GNU_SOURCE
+#include <boot.h>
+
+#include "spawn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+
+/* how long server thread waits for a client before checking
+ * whether it should exit, in msecs */
+#define BOOT_POLL_MSECS (250)
+
+static int listen_fd = -1;      /* socket clients connect to */
+static char* boot_address = NULL; /* host:port of socket */
+static char* boot_buf = NULL;   /* contents of launcher */
+static size_t boot_size = 0;    /* size of launcher in bytes */
+static pthread_t boot_thread;   /* thread serving the socket */
+static int boot_running = 0;    /* set to 0 to stop the thread */
+static in_addr_t* boot_peers = NULL; /* addresses we serve, net order */
+static int boot_peer_count = 0; /* number of entries in boot_peers */
+
+/* appends every IPv4 address host resolves to onto boot_peers, if
+ * bind_addr is not NULL also sets it to the first one, returns 0 on
+ * success */
+static int
+boot_resolve (const char * host, struct in_addr * bind_addr)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* list;
+    int rc = getaddrinfo(host, NULL, &hints, &list);
+    if (rc != 0) {
+        SPAWN_ERR("Failed to resolve boot host `%s' (%s)", host, gai_strerror(rc));
+        return 1;
+    }
+
+    struct addrinfo* ai;
+    for (ai = list; ai != NULL; ai = ai->ai_next) {
+        struct in_addr a = ((struct sockaddr_in*) ai->ai_addr)->sin_addr;
+        if (bind_addr != NULL) {
+            *bind_addr = a;
+            break;
+        }
+        boot_peers = (in_addr_t*) realloc(boot_peers,
+            (boot_peer_count + 1) * sizeof(in_addr_t));
+        boot_peers[boot_peer_count++] = a.s_addr;
+    }
+
+    freeaddrinfo(list);
+    return 0;
+}
+
+/* returns 1 if addr belongs to one of the hosts we boot */
+static int
+boot_peer_ok (const struct sockaddr_in * addr)
+{
+    int i;
+    for (i = 0; i < boot_peer_count; i++) {
+        if (boot_peers[i] == addr->sin_addr.s_addr) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* write len bytes from buf to fd, returns 0 on success */
+static int
+boot_write (int fd, const char * buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t rc = write(fd, buf, len);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        buf += rc;
+        len -= (size_t) rc;
+    }
+    return 0;
+}
+
+/* reads file at path into boot_buf, returns 0 on success */
+static int
+boot_read_file (const char * path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        SPAWN_ERR("Failed to open launcher `%s' (open() errno=%d %s)",
+            path, errno, strerror(errno));
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        SPAWN_ERR("Failed to stat launcher `%s' (fstat() errno=%d %s)",
+            path, errno, strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    boot_size = (size_t) st.st_size;
+    boot_buf  = (char*) SPAWN_MALLOC(boot_size + 1);
+
+    size_t got = 0;
+    while (got < boot_size) {
+        ssize_t rc = read(fd, boot_buf + got, boot_size - got);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            SPAWN_ERR("Failed to read launcher `%s' (read() errno=%d %s)",
+                path, errno, strerror(errno));
+            close(fd);
+            spawn_free(&boot_buf);
+            return 1;
+        }
+        got += (size_t) rc;
+    }
+
+    close(fd);
+    return 0;
+}
+
+/* accept clients and write each one the launcher until told to stop */
+static void *
+boot_thread_main (void * arg)
+{
+    boot_header hdr;
+    hdr.magic   = htonl(BOOT_MAGIC);
+    hdr.size_hi = htonl((uint32_t) ((uint64_t) boot_size >> 32));
+    hdr.size_lo = htonl((uint32_t) boot_size);
+
+    while (__atomic_load_n(&boot_running, __ATOMIC_ACQUIRE)) {
+        /* wait a bit for a client so we notice when to stop */
+        struct pollfd pfd;
+        pfd.fd      = listen_fd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        int rc = poll(&pfd, 1, BOOT_POLL_MSECS);
+        if (rc <= 0) {
+            continue;
+        }
+
+        /* children are forked while we serve, keep clients out of them */
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        int fd = accept4(listen_fd, (struct sockaddr*) &peer, &peer_len, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+
+        /* only hand the launcher to hosts we are booting */
+        if (peer.sin_family != AF_INET || !boot_peer_ok(&peer)) {
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
+            SPAWN_ERR("Refused launcher to unexpected boot client %s", ip);
+            close(fd);
+            continue;
+        }
+
+        /* a client that goes away gets nothing to exec, and so never
+         * connects back to its parent */
+        if (boot_write(fd, (const char*) &hdr, sizeof(hdr)) != 0 ||
+            boot_write(fd, boot_buf, boot_size) != 0)
+        {
+            SPAWN_ERR("Failed to send launcher to boot client (%s)", strerror(errno));
+        }
+        close(fd);
+    }
+
+    return NULL;
+}
+
+int
+boot_start (const char * path, const char * host,
+        const char ** peers, int count)
+{
+    /* listen only on the interface children reach us by, and note
+     * the addresses of the children so we can turn away others */
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = 0;
+    if (boot_resolve(host, &addr.sin_addr) != 0) {
+        return 1;
+    }
+    int i;
+    for (i = 0; i < count; i++) {
+        if (boot_resolve(peers[i], NULL) != 0) {
+            spawn_free(&boot_peers);
+            boot_peer_count = 0;
+            return 1;
+        }
+    }
+
+    if (boot_read_file(path) != 0) {
+        spawn_free(&boot_peers);
+        boot_peer_count = 0;
+        return 1;
+    }
+
+    /* close on exec so rsh/ssh procs we start for children don't
+     * inherit the socket and keep it listening after boot_stop */
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        SPAWN_ERR("Failed to create boot socket (%s)", strerror(errno));
+        spawn_free(&boot_buf);
+        spawn_free(&boot_peers);
+        boot_peer_count = 0;
+        return 1;
+    }
+
+    /* let the kernel pick the port */
+    socklen_t len = sizeof(addr);
+    if (bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, 128) != 0 ||
+        getsockname(listen_fd, (struct sockaddr*) &addr, &len) != 0)
+    {
+        SPAWN_ERR("Failed to open boot socket (%s)", strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        spawn_free(&boot_buf);
+        spawn_free(&boot_peers);
+        boot_peer_count = 0;
+        return 1;
+    }
+
+    boot_address = SPAWN_STRDUPF("%s:%d", host, (int) ntohs(addr.sin_port));
+
+    __atomic_store_n(&boot_running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&boot_thread, NULL, boot_thread_main, NULL) != 0) {
+        SPAWN_ERR("Failed to start boot thread");
+        boot_running = 0;
+        close(listen_fd);
+        listen_fd = -1;
+        spawn_free(&boot_address);
+        spawn_free(&boot_buf);
+        spawn_free(&boot_peers);
+        boot_peer_count = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+const char *
+boot_addr (void)
+{
+    return boot_address;
+}
+
+void
+boot_stop (void)
+{
+    if (listen_fd < 0) {
+        return;
+    }
+
+    /* shutting down the socket wakes the thread from poll, or else
+     * it notices within one poll interval */
+    __atomic_store_n(&boot_running, 0, __ATOMIC_RELEASE);
+    shutdown(listen_fd, SHUT_RDWR);
+    pthread_join(boot_thread, NULL);
+    close(listen_fd);
+    listen_fd = -1;
+    spawn_free(&boot_address);
+    spawn_free(&boot_buf);
+    boot_size = 0;
+    spawn_free(&boot_peers);
+    boot_peer_count = 0;
+    return;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+
+/* Launcher boot: rather than rcp or scp the launcher to /tmp on each
+ * child host before starting it, a parent starts avaboot on the child
+ * host, which connects back to a TCP socket the parent serves, reads
+ * the launcher into /tmp, and execs it.  Each spawn proc then serves
+ * its own copy to its children in turn, so staging the launcher
+ * follows the tree as it unfurls, and no host needs a second remote
+ * shell session.
+ *
+ * The server writes a boot_header followed by size bytes of the
+ * launcher and closes the connection.  The fields of the header are
+ * in network byte order.  avaboot only uses libc, so this header
+ * must not pull in anything else. */
+
+#ifndef SPAWN_BOOT_H
+#define SPAWN_BOOT_H 1
+
+#include <stdint.h>
+
+#define BOOT_MAGIC (0x41564142) /* "AVAB" */
+
+typedef struct boot_header_t {
+    uint32_t magic;   /* BOOT_MAGIC */
+    uint32_t size_hi; /* high 32 bits of launcher size in bytes */
+    uint32_t size_lo; /* low 32 bits of launcher size in bytes */
+} boot_header;
+
+/* read file at path into memory, open a TCP socket on any port of
+ * the interface host names, and start thread to serve the file to
+ * each client connecting from one of the count hosts in peers,
+ * returns 0 on success */
+int boot_start (const char * path, const char * host,
+        const char ** peers, int count);
+
+/* returns "host:port" that avaboot connects to, valid until
+ * boot_stop */
+const char * boot_addr (void);
+
+/* stop thread, close socket, and free the file */
+void boot_stop (void);
+
+#endif
@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+#include <hostfile/hostfile.h>
+
+#include "spawn.h"
+#include "hostlist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* most fields on a line: hostname, slots, hca, port */
+#define HOSTFILE_MAX_FIELDS (4)
+
+/* While parsing, records refer to strings by their offset in the pool
+ * plus one, with 0 for none, since the pool moves as it grows.  The
+ * intern table is an open-addressed hash of those same offsets. */
+typedef struct hostfile_rec_t {
+    size_t name;
+    size_t hca;
+    int port;
+    int slots;
+} hostfile_rec;
+
+typedef struct hostfile_builder_t {
+    const char* file;     /* name of hostfile for error messages */
+    int lineno;           /* line we're parsing */
+    hostfile_rec* recs;   /* records parsed so far */
+    int count;            /* number of records */
+    int alloc;            /* number of records we have room for */
+    char* pool;           /* interned strings, each null terminated */
+    size_t used;          /* bytes used in pool */
+    size_t size;          /* bytes allocated for pool */
+    size_t* table;        /* hash table of pool offsets plus one */
+    size_t table_size;    /* number of slots, a power of two */
+    size_t table_count;   /* number of slots in use */
+} hostfile_builder;
+
+/* grow buffer to hold at least count items of given size, doubling
+ * its capacity in items in alloc */
+static void
+grow (void ** buf, size_t * alloc, size_t count, size_t size)
+{
+    if (count <= *alloc) {
+        return;
+    }
+
+    size_t new_alloc = (*alloc > 0) ? *alloc : 256;
+    while (new_alloc < count) {
+        new_alloc <<= 1;
+    }
+
+    void* new_buf = realloc(*buf, new_alloc * size);
+    if (new_buf == NULL) {
+        SPAWN_ERR("Failed to allocate %lu bytes for hostfile (%s)",
+            (unsigned long) (new_alloc * size), strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+
+    *buf = new_buf;
+    *alloc = new_alloc;
+}
+
+static size_t
+hash_str (const char * str, size_t len)
+{
+    /* FNV-1a */
+    size_t hash = (size_t) 2166136261u;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char) str[i];
+        hash *= (size_t) 16777619u;
+    }
+    return hash;
+}
+
+/* returns pool offset plus one of a copy of len bytes at str, adding
+ * one if we don't have it yet */
+static size_t
+intern (hostfile_builder * b, const char * str, size_t len)
+{
+    /* keep table at most half full */
+    if (2 * (b->table_count + 1) > b->table_size) {
+        size_t old_size = b->table_size;
+        size_t* old_table = b->table;
+
+        b->table_size = (old_size > 0) ? 2 * old_size : 1024;
+        b->table = (size_t*) SPAWN_MALLOC(b->table_size * sizeof(size_t));
+        memset(b->table, 0, b->table_size * sizeof(size_t));
+
+        size_t i;
+        for (i = 0; i < old_size; i++) {
+            size_t off = old_table[i];
+            if (off != 0) {
+                const char* s = b->pool + off - 1;
+                size_t slot = hash_str(s, strlen(s)) & (b->table_size - 1);
+                while (b->table[slot] != 0) {
+                    slot = (slot + 1) & (b->table_size - 1);
+                }
+                b->table[slot] = off;
+            }
+        }
+        spawn_free(&old_table);
+    }
+
+    /* look for string in table */
+    size_t slot = hash_str(str, len) & (b->table_size - 1);
+    while (b->table[slot] != 0) {
+        const char* s = b->pool + b->table[slot] - 1;
+        if (strncmp(s, str, len) == 0 && s[len] == '\0') {
+            return b->table[slot];
+        }
+        slot = (slot + 1) & (b->table_size - 1);
+    }
+
+    /* not found, append it to pool */
+    grow((void**) &b->pool, &b->size, b->used + len + 1, 1);
+    memcpy(b->pool + b->used, str, len);
+    b->pool[b->used + len] = '\0';
+    size_t off = b->used + 1;
+    b->used += len + 1;
+
+    b->table[slot] = off;
+    b->table_count++;
+
+    return off;
+}
+
+static void
+add_rec (hostfile_builder * b, size_t name, size_t hca, int port,
+        int slots)
+{
+    size_t alloc = (size_t) b->alloc;
+    grow((void**) &b->recs, &alloc, (size_t) b->count + 1, sizeof(hostfile_rec));
+    b->alloc = (int) alloc;
+
+    hostfile_rec* rec = &b->recs[b->count++];
+    rec->name       = name;
+    rec->hca        = hca;
+    rec->port       = port;
+    rec->slots      = slots;
+}
+
+static int
+is_space (char c)
+{
+    return (c == ' ' || c == '\t' || c == '\r');
+}
+
+/* returns 1 if len bytes at str are all digits */
+static int
+is_decimal (const char * str, size_t len)
+{
+    size_t i;
+    for (i = 0; i < len; i++) {
+        if (str[i] < '0' || str[i] > '9') {
+            return 0;
+        }
+    }
+    return (len > 0);
+}
+
+/* returns value of len digits at str, or -1 if it does not fit an int */
+static int
+decimal_value (const char * str, size_t len)
+{
+    long val = 0;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        val = val * 10 + (str[i] - '0');
+        if (val > 0x7fffffffL) {
+            return -1;
+        }
+    }
+    return (int) val;
+}
+
+static int
+parse_error (hostfile_builder * b, const char * msg)
+{
+    SPAWN_ERR("Error parsing hostfile `%s' line %d - %s", b->file, b->lineno, msg);
+    return -1;
+}
+
+/* parse one line of len bytes at line, returns 0 on success */
+static int
+parse_line (hostfile_builder * b, const char * line, size_t len)
+{
+    /* drop comment */
+    const char* hash = memchr(line, '#', len);
+    if (hash != NULL) {
+        len = (size_t) (hash - line);
+    }
+
+    /* pick off a trailing slots=N */
+    int slots = 0;
+    const char* end = line + len;
+    while (end > line && is_space(end[-1])) {
+        end--;
+    }
+    const char* digits = end;
+    while (digits > line && digits[-1] >= '0' && digits[-1] <= '9') {
+        digits--;
+    }
+    const char* key = digits - 6;
+    if (digits < end && digits - line > 6 && strncmp(key, "slots=", 6) == 0 &&
+        is_space(key[-1]))
+    {
+        slots = decimal_value(digits, (size_t) (end - digits));
+        if (slots < 1) {
+            return parse_error(b, "slots must be at least 1");
+        }
+        end = key;
+    }
+
+    /* split line into fields on ':', trimming whitespace */
+    const char* field[HOSTFILE_MAX_FIELDS];
+    size_t field_len[HOSTFILE_MAX_FIELDS];
+    int fields = 0;
+    const char* p = line;
+    while (1) {
+        const char* colon = memchr(p, ':', (size_t) (end - p));
+        const char* field_end = (colon != NULL) ? colon : end;
+
+        const char* start = p;
+        while (start < field_end && is_space(*start)) {
+            start++;
+        }
+        const char* stop = field_end;
+        while (stop > start && is_space(stop[-1])) {
+            stop--;
+        }
+
+        /* blank line */
+        if (fields == 0 && colon == NULL && start == stop) {
+            return 0;
+        }
+
+        if (fields == HOSTFILE_MAX_FIELDS) {
+            return parse_error(b, "too many fields");
+        }
+        if (start == stop) {
+            return parse_error(b, "empty field");
+        }
+        size_t i;
+        for (i = 0; i < (size_t) (stop - start); i++) {
+            if (is_space(start[i])) {
+                return parse_error(b, "whitespace within field");
+            }
+        }
+
+        field[fields]     = start;
+        field_len[fields] = (size_t) (stop - start);
+        fields++;
+
+        if (colon == NULL) {
+            break;
+        }
+        p = colon + 1;
+    }
+
+    /* hostname comes first, then an optional number of slots */
+    int f = 1;
+    if (f < fields && is_decimal(field[f], field_len[f])) {
+        if (slots != 0) {
+            return parse_error(b, "slots given twice");
+        }
+        slots = decimal_value(field[f], field_len[f]);
+        if (slots < 1) {
+            return parse_error(b, "slots must be at least 1");
+        }
+        f++;
+    }
+
+    /* then an optional hca and port */
+    size_t hca = 0;
+    int port = -1;
+    if (f < fields) {
+        if (is_decimal(field[f], field_len[f])) {
+            return parse_error(b, "expected hca name");
+        }
+        hca = intern(b, field[f], field_len[f]);
+        f++;
+        if (f < fields) {
+            if (! is_decimal(field[f], field_len[f])) {
+                return parse_error(b, "expected hca port");
+            }
+            port = decimal_value(field[f], field_len[f]);
+            f++;
+        }
+    }
+    if (f < fields) {
+        return parse_error(b, "unexpected field after hca port");
+    }
+
+    /* add a record for each host the hostname names */
+    if (memchr(field[0], '[', field_len[0]) == NULL) {
+        size_t name = intern(b, field[0], field_len[0]);
+        add_rec(b, name, hca, port, slots);
+        return 0;
+    }
+
+    char* range = SPAWN_STRDUPF("%.*s", (int) field_len[0], field[0]);
+    int count;
+    char** hosts = hostlist_expand(range, &count);
+    spawn_free(&range);
+    if (hosts == NULL) {
+        return parse_error(b, "malformed host range");
+    }
+
+    int i;
+    for (i = 0; i < count; i++) {
+        size_t name = intern(b, hosts[i], strlen(hosts[i]));
+        add_rec(b, name, hca, port, slots);
+    }
+    hostlist_free(&hosts, count);
+
+    return 0;
+}
+
+hostfile *
+hostfile_parse (const char * buf, size_t size, const char * name)
+{
+    hostfile_builder b;
+    memset(&b, 0, sizeof(b));
+    b.file = name;
+    b.lineno = 1;
+
+    /* parse each line */
+    int rc = 0;
+    const char* p = buf;
+    const char* end = buf + size;
+    while (p < end && rc == 0) {
+        const char* nl = memchr(p, '\n', (size_t) (end - p));
+        const char* line_end = (nl != NULL) ? nl : end;
+        rc = parse_line(&b, p, (size_t) (line_end - p));
+        p = line_end + 1;
+        b.lineno++;
+    }
+
+    if (rc == 0 && b.count == 0) {
+        SPAWN_ERR("No host found in hostfile `%s'", name);
+        rc = -1;
+    }
+
+    spawn_free(&b.table);
+    if (rc != 0) {
+        spawn_free(&b.recs);
+        spawn_free(&b.pool);
+        return NULL;
+    }
+
+    /* now that the pool is done moving, point records into it */
+    hostfile* hf = (hostfile*) SPAWN_MALLOC(sizeof(hostfile));
+    hf->hosts = (hostfile_host*) SPAWN_MALLOC(b.count * sizeof(hostfile_host));
+    hf->count = b.count;
+    hf->pool  = b.pool;
+
+    int i;
+    for (i = 0; i < b.count; i++) {
+        const hostfile_rec* rec = &b.recs[i];
+        hostfile_host* host = &hf->hosts[i];
+        host->name       = b.pool + rec->name - 1;
+        host->hca        = (rec->hca != 0) ? b.pool + rec->hca - 1 : NULL;
+        host->port       = rec->port;
+        host->slots      = rec->slots;
+    }
+    spawn_free(&b.recs);
+
+    return hf;
+}
+
+hostfile *
+hostfile_read (const char * path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        SPAWN_ERR("Can't open hostfile `%s' (%s)", path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        SPAWN_ERR("Can't stat hostfile `%s' (%s)", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t) st.st_size;
+    if (size == 0) {
+        SPAWN_ERR("No host found in hostfile `%s'", path);
+        close(fd);
+        return NULL;
+    }
+
+    /* map file and parse it in place */
+    void* buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buf == MAP_FAILED) {
+        SPAWN_ERR("Can't map hostfile `%s' (%s)", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    madvise(buf, size, MADV_SEQUENTIAL);
+
+    hostfile* hf = hostfile_parse((const char*) buf, size, path);
+
+    munmap(buf, size);
+    close(fd);
+
+    return hf;
+}
+
+void
+hostfile_free (hostfile ** hf)
+{
+    if (hf == NULL || *hf == NULL) {
+        return;
+    }
+
+    spawn_free(&(*hf)->hosts);
+    spawn_free(&(*hf)->pool);
+    spawn_free(hf);
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* Hostfile reader: each line names a host, optionally followed by
+ * the number of app procs to run on it, an HCA, and an HCA port,
+ *
+ *   hostname[:slots][:hca[:port]]
+ *
+ * where hostname may name a range of hosts like node[001-128] (see
+ * hostlist.h), and everything after a '#' is a comment.  The number
+ * of procs may also be given as "slots=N" after the other fields,
+ * separated by whitespace, e.g., "node1 slots=4".  Each host runs a
+ * single spawn proc no matter how many slots or lines it has.
+ *
+ * The file is mapped and parsed in one pass into a flat array of
+ * host records.  Strings in the records are interned in a single
+ * pool owned by the hostfile, so a name repeated on many lines, like
+ * an HCA, is stored once, and the whole hostfile is freed at once. */
+
+#ifndef SPAWN_HOSTFILE_H
+#define SPAWN_HOSTFILE_H 1
+
+#include <stddef.h>
+
+typedef struct hostfile_host_t {
+    const char* name; /* hostname */
+    const char* hca;  /* HCA name, NULL if not given */
+    int port;         /* HCA port, -1 if not given */
+    int slots;        /* number of app procs to run, 0 if not given */
+} hostfile_host;
+
+typedef struct hostfile_t {
+    hostfile_host* hosts; /* one record per host in file order */
+    int count;            /* number of records */
+    char* pool;           /* interned strings the records point into */
+} hostfile;
+
+/* reads hostfile at path, returns NULL after printing an error if the
+ * file can't be read, has a malformed line, or lists no hosts, caller
+ * should free hostfile with hostfile_free */
+hostfile* hostfile_read (const char * path);
+
+/* parses size bytes of hostfile text in buf, name is used in error
+ * messages, returns NULL on error as hostfile_read does */
+hostfile* hostfile_parse (const char * buf, size_t size, const char * name);
+
+void hostfile_free (hostfile ** hf);
+
+#endif
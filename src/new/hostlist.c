@@ -0,0 +1,481 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+#include <hostlist.h>
+
+#include "spawn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* longest numeric suffix we treat as a number, longer suffixes are
+ * left as part of the name so values fit in a long */
+#define HOSTLIST_MAX_DIGITS (9)
+
+/*******************************
+ * Decoding
+ ******************************/
+
+/* parse an unsigned decimal at *str of at most HOSTLIST_MAX_DIGITS
+ * digits, advance *str past it and set width to its number of
+ * digits, returns -1 if there is no number */
+static long
+parse_value (const char ** str, int * width)
+{
+    const char* p = *str;
+    long val = 0;
+    int digits = 0;
+    while (isdigit((unsigned char) *p)) {
+        if (digits == HOSTLIST_MAX_DIGITS) {
+            return -1;
+        }
+        val = val * 10 + (*p - '0');
+        digits++;
+        p++;
+    }
+    if (digits == 0) {
+        return -1;
+    }
+    *str = p;
+    *width = digits;
+    return val;
+}
+
+/* walk one list item of the form prefix or prefix[ranges]suffix
+ * starting at str, if hosts is not NULL write each name to hosts
+ * starting at index, returns number of names in item or -1 if it is
+ * malformed, sets *end to the character following the item */
+static int
+expand_item (const char * str, const char ** end, char ** hosts, int index)
+{
+    /* find end of prefix */
+    const char* open = str;
+    while (*open != '\0' && *open != ',' && *open != '[') {
+        open++;
+    }
+    int prefix_len = (int) (open - str);
+
+    /* plain hostname */
+    if (*open != '[') {
+        if (prefix_len == 0) {
+            return -1;
+        }
+        if (hosts != NULL) {
+            hosts[index] = SPAWN_STRDUPF("%.*s", prefix_len, str);
+        }
+        *end = open;
+        return 1;
+    }
+
+    /* find text following the closing bracket */
+    const char* close = strchr(open, ']');
+    if (close == NULL) {
+        return -1;
+    }
+    const char* suffix = close + 1;
+    const char* suffix_end = suffix;
+    while (*suffix_end != '\0' && *suffix_end != ',') {
+        suffix_end++;
+    }
+    int suffix_len = (int) (suffix_end - suffix);
+
+    /* walk each range between the brackets */
+    int count = 0;
+    const char* p = open + 1;
+    while (p < close) {
+        int width, width2;
+        long first = parse_value(&p, &width);
+        if (first < 0) {
+            return -1;
+        }
+        long last = first;
+        if (*p == '-') {
+            p++;
+            last = parse_value(&p, &width2);
+            if (last < first) {
+                return -1;
+            }
+        }
+        if (*p == ',') {
+            p++;
+        } else if (p != close) {
+            return -1;
+        }
+
+        long val;
+        for (val = first; val <= last; val++) {
+            if (hosts != NULL) {
+                hosts[index + count] = SPAWN_STRDUPF("%.*s%0*ld%.*s",
+                    prefix_len, str, width, val, suffix_len, suffix);
+            }
+            count++;
+        }
+    }
+    if (count == 0) {
+        return -1;
+    }
+
+    *end = suffix_end;
+    return count;
+}
+
+/* walk list, returns number of names and fills in hosts if not NULL,
+ * returns -1 if list is malformed */
+static int
+expand_list (const char * list, char ** hosts)
+{
+    int count = 0;
+    const char* p = list;
+    while (*p != '\0') {
+        const char* end;
+        int n = expand_item(p, &end, hosts, count);
+        if (n < 0) {
+            SPAWN_ERR("Malformed host list `%s'", list);
+            return -1;
+        }
+        count += n;
+        p = end;
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return count;
+}
+
+int
+hostlist_count (const char * list)
+{
+    return expand_list(list, NULL);
+}
+
+char **
+hostlist_expand (const char * list, int * count)
+{
+    /* count names, then allocate and fill in array */
+    int n = expand_list(list, NULL);
+    *count = n;
+    if (n <= 0) {
+        return NULL;
+    }
+
+    char** hosts = (char**) SPAWN_MALLOC(n * sizeof(char*));
+    expand_list(list, hosts);
+    return hosts;
+}
+
+void
+hostlist_free (char *** hosts, int count)
+{
+    if (hosts == NULL || *hosts == NULL) {
+        return;
+    }
+
+    int i;
+    for (i = 0; i < count; i++) {
+        spawn_free(&(*hosts)[i]);
+    }
+    spawn_free(hosts);
+}
+
+/* parse one term of an integer list, value, first-last, or
+ * value*repeat, starting at *str, sets *str to the start of the next
+ * term, returns 0 on success or 1 if the term is malformed */
+static int
+parse_int_term (const char ** str, long * first, long * last, long * repeat)
+{
+    const char* p = *str;
+    int width;
+    *first  = parse_value(&p, &width);
+    *last   = *first;
+    *repeat = 1;
+    if (*first >= 0 && *p == '-') {
+        p++;
+        *last = parse_value(&p, &width);
+    } else if (*first >= 0 && *p == '*') {
+        p++;
+        *repeat = parse_value(&p, &width);
+    }
+    if (*first < 0 || *last < *first || *repeat < 1 ||
+        (*p != ',' && *p != '\0'))
+    {
+        return 1;
+    }
+    if (*p == ',') {
+        p++;
+    }
+    *str = p;
+    return 0;
+}
+
+int *
+hostlist_expand_ints (const char * list, int * count)
+{
+    /* count values, then allocate and fill in array */
+    int pass;
+    int n = 0;
+    int* vals = NULL;
+    for (pass = 0; pass < 2; pass++) {
+        n = 0;
+        const char* p = list;
+        while (*p != '\0') {
+            long first, last, repeat;
+            if (parse_int_term(&p, &first, &last, &repeat) != 0) {
+                SPAWN_ERR("Malformed integer list `%s'", list);
+                spawn_free(&vals);
+                *count = -1;
+                return NULL;
+            }
+
+            long val, j;
+            for (val = first; val <= last; val++) {
+                for (j = 0; j < repeat; j++) {
+                    if (vals != NULL) {
+                        vals[n] = (int) val;
+                    }
+                    n++;
+                }
+            }
+        }
+
+        if (pass == 0) {
+            if (n == 0) {
+                break;
+            }
+            vals = (int*) SPAWN_MALLOC(n * sizeof(int));
+        }
+    }
+
+    *count = n;
+    return vals;
+}
+
+int
+hostlist_expand_int_runs (const char * list, int * count, int ** firsts,
+        int ** vals)
+{
+    /* count runs, then allocate and fill in arrays */
+    int pass;
+    int runs = 0;
+    int n = 0;
+    int* run_first = NULL;
+    int* run_val   = NULL;
+    for (pass = 0; pass < 2; pass++) {
+        runs = 0;
+        n = 0;
+        long prev = -1;
+        const char* p = list;
+        while (*p != '\0') {
+            long first, last, repeat;
+            if (parse_int_term(&p, &first, &last, &repeat) != 0) {
+                SPAWN_ERR("Malformed integer list `%s'", list);
+                spawn_free(&run_first);
+                spawn_free(&run_val);
+                runs = -1;
+                n = -1;
+                break;
+            }
+
+            /* a repeated value extends the current run, a range
+             * starts a new run for each value */
+            long val;
+            for (val = first; val <= last; val++) {
+                if (val != prev) {
+                    if (run_first != NULL) {
+                        run_first[runs] = n;
+                        run_val[runs]   = (int) val;
+                    }
+                    runs++;
+                    prev = val;
+                }
+                n += (int) repeat;
+            }
+        }
+
+        if (pass == 0) {
+            if (runs <= 0) {
+                break;
+            }
+            run_first = (int*) SPAWN_MALLOC(runs * sizeof(int));
+            run_val   = (int*) SPAWN_MALLOC(runs * sizeof(int));
+        }
+    }
+
+    *count  = n;
+    *firsts = run_first;
+    *vals   = run_val;
+    return runs;
+}
+
+/*******************************
+ * Encoding
+ ******************************/
+
+/* splits a hostname into a non-empty prefix and a numeric suffix,
+ * returns length of prefix and sets value and width of suffix,
+ * returns -1 if name does not end with a number */
+static int
+split_name (const char * name, long * value, int * width)
+{
+    int len = (int) strlen(name);
+    int start = len;
+    while (start > 0 && isdigit((unsigned char) name[start - 1])) {
+        start--;
+    }
+
+    int digits = len - start;
+    if (start == 0 || digits == 0 || digits > HOSTLIST_MAX_DIGITS) {
+        return -1;
+    }
+
+    *value = strtol(name + start, NULL, 10);
+    *width = digits;
+    return start;
+}
+
+/* returns number of characters in value padded with zeros to width */
+static int
+padded_width (long value, int width)
+{
+    int digits = 1;
+    while (value >= 10) {
+        value /= 10;
+        digits++;
+    }
+    return (digits > width) ? digits : width;
+}
+
+char *
+hostlist_encode (const char * const * hosts, int count)
+{
+    /* each name is written at most once with a separator, a group
+     * of n names writes its prefix once, its digits, n-1 commas, and
+     * a pair of brackets, so allowing each name two extra characters
+     * covers a group of two names with a one-character prefix, like
+     * a1,a3 giving a[1,3], which needs one more than the names */
+    size_t size = 1;
+    int i;
+    for (i = 0; i < count; i++) {
+        size += strlen(hosts[i]) + 2;
+    }
+    char* list = (char*) SPAWN_MALLOC(size);
+    char* ptr = list;
+    *ptr = '\0';
+
+    i = 0;
+    while (i < count) {
+        if (ptr != list) {
+            *ptr++ = ',';
+        }
+
+        /* names without a numeric suffix are written as is */
+        long value;
+        int width;
+        int prefix_len = split_name(hosts[i], &value, &width);
+        if (prefix_len < 0) {
+            ptr += sprintf(ptr, "%s", hosts[i]);
+            i++;
+            continue;
+        }
+
+        /* find run of names that share this prefix */
+        int j = i + 1;
+        while (j < count) {
+            long v;
+            int w;
+            int len = split_name(hosts[j], &v, &w);
+            if (len != prefix_len || strncmp(hosts[i], hosts[j], len) != 0) {
+                break;
+            }
+            j++;
+        }
+
+        /* a lone name needs no brackets */
+        if (j == i + 1) {
+            ptr += sprintf(ptr, "%s", hosts[i]);
+            i++;
+            continue;
+        }
+
+        /* write prefix and merge consecutive values into ranges,
+         * a value only joins a range if padding it to the width of
+         * the first value reproduces its name, so node9 and node10
+         * merge but node09 and node10 do not */
+        ptr += sprintf(ptr, "%.*s[", prefix_len, hosts[i]);
+        while (i < j) {
+            split_name(hosts[i], &value, &width);
+            int k = i + 1;
+            while (k < j) {
+                long v;
+                int w;
+                split_name(hosts[k], &v, &w);
+                if (v != value + (k - i) || w != padded_width(v, width)) {
+                    break;
+                }
+                k++;
+            }
+
+            ptr += sprintf(ptr, "%0*ld", width, value);
+            if (k > i + 1) {
+                ptr += sprintf(ptr, "-%ld", value + (k - i - 1));
+            }
+            if (k < j) {
+                *ptr++ = ',';
+            }
+            i = k;
+        }
+        *ptr++ = ']';
+        *ptr = '\0';
+    }
+
+    return list;
+}
+
+char *
+hostlist_encode_ints (const int * vals, int count)
+{
+    /* each value takes at most 11 characters and a separator */
+    size_t size = (size_t) count * 12 + 1;
+    char* list = (char*) SPAWN_MALLOC(size);
+    char* ptr = list;
+    *ptr = '\0';
+
+    int i = 0;
+    while (i < count) {
+        if (ptr != list) {
+            *ptr++ = ',';
+        }
+        ptr += sprintf(ptr, "%d", vals[i]);
+
+        /* write a run of repeated values as value*count */
+        int k = i + 1;
+        while (k < count && vals[k] == vals[i]) {
+            k++;
+        }
+        if (k > i + 1) {
+            ptr += sprintf(ptr, "*%d", k - i);
+            i = k;
+            continue;
+        }
+
+        /* and a run of consecutive values as first-last */
+        while (k < count && vals[k] == vals[i] + (k - i)) {
+            k++;
+        }
+        if (k > i + 1) {
+            ptr += sprintf(ptr, "-%d", vals[k - 1]);
+        }
+        i = k;
+    }
+
+    return list;
+}
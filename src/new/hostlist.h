@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* Compressed host lists in the range syntax used by SLURM, e.g.,
+ *
+ *   node[001-004,010],login1
+ *
+ * names node001, node002, node003, node004, node010, and login1, in
+ * that order.  A range pads each value with zeros to the width of its
+ * first value.  Integer lists use the same range syntax without the
+ * brackets, and may also repeat a value, e.g., "0-3,9,4*100" names
+ * 0, 1, 2, 3, 9, and then 4 a hundred times.
+ *
+ * Encoding keeps the order of the input, it only merges runs of
+ * neighboring entries, so a list decodes to exactly what was encoded.
+ * Strings and arrays returned by these functions are allocated and
+ * should be freed with spawn_free, or hostlist_free for host arrays. */
+
+#ifndef SPAWN_HOSTLIST_H
+#define SPAWN_HOSTLIST_H 1
+
+/* returns number of hosts in list, or -1 if list is malformed */
+int hostlist_count (const char * list);
+
+/* returns array of count hostnames named by list, or NULL with
+ * count set to -1 if list is malformed */
+char ** hostlist_expand (const char * list, int * count);
+
+/* frees array of count hostnames returned by hostlist_expand */
+void hostlist_free (char *** hosts, int count);
+
+/* returns list naming count hosts in given order */
+char * hostlist_encode (const char * const * hosts, int count);
+
+/* returns array of count integers named by list, or NULL with count
+ * set to -1 if list is malformed */
+int * hostlist_expand_ints (const char * list, int * count);
+
+/* decodes list into runs of equal values without expanding it, sets
+ * count to the number of values, and allocates firsts and vals to
+ * hold the index of the first value of each run and its value,
+ * returns number of runs, or -1 with count set to -1 if list is
+ * malformed */
+int hostlist_expand_int_runs (const char * list, int * count,
+    int ** firsts, int ** vals);
+
+/* returns list naming count integers in given order */
+char * hostlist_encode_ints (const int * vals, int count);
+
+#endif
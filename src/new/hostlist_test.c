@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* checks that host lists encode to the expected string and decode
+ * back to the names they came from, and that integer lists decode to
+ * the same runs as their expansion, run by "make check" */
+
+#include <hostlist.h>
+
+#include "spawn.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+/* encodes count hosts, compares result to expect, then expands
+ * the result and compares it to hosts */
+static void
+check_encode (const char * const * hosts, int count, const char * expect)
+{
+    char* list = hostlist_encode(hosts, count);
+    if (strcmp(list, expect) != 0) {
+        printf("FAIL: encoded `%s', expected `%s'\n", list, expect);
+        failures++;
+    }
+
+    int n;
+    char** names = hostlist_expand(list, &n);
+    if (n != count) {
+        printf("FAIL: `%s' expanded to %d hosts, expected %d\n", list, n, count);
+        failures++;
+    } else {
+        int i;
+        for (i = 0; i < n; i++) {
+            if (strcmp(names[i], hosts[i]) != 0) {
+                printf("FAIL: `%s' host %d is `%s', expected `%s'\n",
+                    list, i, names[i], hosts[i]);
+                failures++;
+            }
+        }
+    }
+    if (names != NULL) {
+        hostlist_free(&names, n);
+    }
+
+    spawn_free(&list);
+}
+
+/* decodes list into runs and checks them against its expansion */
+static void
+check_int_runs (const char * list, int expect_runs)
+{
+    int count;
+    int* vals = hostlist_expand_ints(list, &count);
+
+    int n;
+    int* firsts;
+    int* run_vals;
+    int runs = hostlist_expand_int_runs(list, &n, &firsts, &run_vals);
+    if (runs != expect_runs || n != count) {
+        printf("FAIL: `%s' decoded to %d runs of %d values, expected %d of %d\n",
+            list, runs, n, expect_runs, count);
+        failures++;
+    } else {
+        int run, i;
+        for (run = 0; run < runs; run++) {
+            int end = (run + 1 < runs) ? firsts[run + 1] : n;
+            for (i = firsts[run]; i < end; i++) {
+                if (vals[i] != run_vals[run]) {
+                    printf("FAIL: `%s' value %d is %d in run %d, expected %d\n",
+                        list, i, run_vals[run], run, vals[i]);
+                    failures++;
+                }
+            }
+        }
+    }
+
+    spawn_free(&firsts);
+    spawn_free(&run_vals);
+    spawn_free(&vals);
+}
+
+int
+main (int argc, char * argv[])
+{
+    /* a two-name group with a one-character prefix encodes longer
+     * than the names it replaces */
+    const char* short_prefix[] = { "a1", "a3", "b1", "b3" };
+    check_encode(short_prefix, 4, "a[1,3],b[1,3]");
+
+    const char* ranges[] = { "node001", "node002", "node003", "node010", "login1" };
+    check_encode(ranges, 5, "node[001-3,010],login1");
+
+    const char* widths[] = { "node9", "node10", "node09" };
+    check_encode(widths, 3, "node[9-10,09]");
+
+    const char* plain[] = { "login", "a1" };
+    check_encode(plain, 2, "login,a1");
+
+    /* repeats of one value merge into a run, even across terms */
+    check_int_runs("8,4*1023", 2);
+    check_int_runs("4*2,4,2*3", 2);
+    check_int_runs("0-3,3*2,9", 5);
+
+    if (failures > 0) {
+        printf("%d hostlist checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,841 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+#include <launch_model.h>
+
+/* we only use libc here so that avasim builds without spawnnet */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* largest degree and number of bcast chunks we consider */
+#define MODEL_MAX_DEGREE (64)
+#define MODEL_MAX_CHUNKS (4096)
+
+/* smallest bcast chunk we consider, bcast_file takes chunk sizes
+ * in whole MB */
+#define MODEL_MIN_CHUNK (1024 * 1024)
+
+/* table of param names and where they live in the struct */
+static const struct {
+    const char* name;
+    size_t offset;
+} param_table[] = {
+    { "fork_usecs",   offsetof(launch_model_params, fork_usecs)   },
+    { "fork_p99",     offsetof(launch_model_params, fork_p99)     },
+    { "rsh_usecs",    offsetof(launch_model_params, rsh_usecs)    },
+    { "rsh_p99",      offsetof(launch_model_params, rsh_p99)      },
+    { "accept_usecs", offsetof(launch_model_params, accept_usecs) },
+    { "send_usecs",   offsetof(launch_model_params, send_usecs)   },
+    { "hop_usecs",    offsetof(launch_model_params, hop_usecs)    },
+    { "bw_mbs",       offsetof(launch_model_params, bw_mbs)       },
+    { "host_bytes",   offsetof(launch_model_params, host_bytes)   },
+    { "pack_usecs",   offsetof(launch_model_params, pack_usecs)   },
+};
+
+#define PARAM_COUNT (sizeof(param_table) / sizeof(param_table[0]))
+
+void
+launch_model_defaults (launch_model_params * p)
+{
+    p->fork_usecs   = 1000.0;
+    p->fork_p99     = 2000.0;
+    p->rsh_usecs    = 30000.0;
+    p->rsh_p99      = 60000.0;
+    p->accept_usecs = 20.0;
+    p->send_usecs   = 5.0;
+    p->hop_usecs    = 20.0;
+    p->bw_mbs       = 1000.0;
+    p->host_bytes   = 24.0;
+    p->pack_usecs   = 0.5;
+}
+
+int
+launch_model_set (launch_model_params * p, const char * key,
+        const char * value)
+{
+    size_t i;
+    for (i = 0; i < PARAM_COUNT; i++) {
+        if (strcmp(key, param_table[i].name) == 0) {
+            char* end;
+            double val = strtod(value, &end);
+            if (end == value || val < 0.0) {
+                return 1;
+            }
+            *(double*) ((char*) p + param_table[i].offset) = val;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int
+launch_model_read (const char * file, launch_model_params * p)
+{
+    FILE* fp = fopen(file, "r");
+    if (fp == NULL) {
+        return 1;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        /* skip comments and blank lines */
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') {
+            continue;
+        }
+
+        /* split key=value, ignore keys we don't know so newer
+         * profiles can still be read */
+        char* eq = strchr(line, '=');
+        if (eq == NULL) {
+            continue;
+        }
+        *eq = '\0';
+        launch_model_set(p, line, eq + 1);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+int
+launch_model_write (const char * file, const launch_model_params * p)
+{
+    /* write to a temp file next to file and rename it into place, so
+     * concurrent jobs reading the profile see the old one or the new
+     * one but never a partly written one */
+    size_t len = strlen(file) + strlen(".XXXXXX") + 1;
+    char* tmp = (char*) malloc(len);
+    snprintf(tmp, len, "%s.XXXXXX", file);
+
+    FILE* fp = NULL;
+    int fd = mkstemp(tmp);
+    if (fd >= 0) {
+        fp = fdopen(fd, "w");
+    }
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open launch profile: `%s' (%s)\n",
+            file, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        free(tmp);
+        return 1;
+    }
+
+    fprintf(fp, "# avalaunch launch profile, times in usecs, bandwidth in MB/s\n");
+    size_t i;
+    for (i = 0; i < PARAM_COUNT; i++) {
+        double val = *(const double*) ((const char*) p + param_table[i].offset);
+        fprintf(fp, "%s=%.3f\n", param_table[i].name, val);
+    }
+
+    int rc = 0;
+    if (fclose(fp) != 0 || rename(tmp, file) != 0) {
+        unlink(tmp);
+        rc = 1;
+    }
+    free(tmp);
+    return rc;
+}
+
+/* running average of a param over the samples that measure it */
+typedef struct model_fit_t {
+    double sum;
+    int count;
+} model_fit;
+
+static void
+fit_add (model_fit * f, double val)
+{
+    f->sum += val;
+    f->count++;
+}
+
+static int
+fit_apply (const model_fit * f, double * param)
+{
+    if (f->count > 0) {
+        *param = f->sum / (double) f->count;
+        return 1;
+    }
+    return 0;
+}
+
+/* find bandwidth at which the model predicts the measured bcast time,
+ * bcast time only goes down as bandwidth goes up */
+static double
+fit_bandwidth (const launch_model_params * base, const launch_model_sample * s)
+{
+    /* bisect on usecs per byte, between 1 TB/s and 1 MB/s */
+    launch_model_params p = *base;
+    double lo = 1e-6, hi = 1.0;
+    int i;
+    for (i = 0; i < 60; i++) {
+        double mid = (lo + hi) / 2.0;
+        p.bw_mbs = 1.0 / mid;
+        double usecs = launch_model_bcast(&p, s->nodes, s->shape, s->degree,
+            (size_t) s->bcast_bytes, s->bcast_chunk);
+        if (usecs > s->bcast_usecs) {
+            hi = mid;
+        } else {
+            lo = mid;
+        }
+    }
+    return 2.0 / (lo + hi);
+}
+
+/* From each sample we derive:
+ *   fork - root time to launch its children / children
+ *   rsh  - accepting children ends when the last child connects,
+ *          which is rsh after its fork, so accept time + fork
+ *   hop  - signal round trip / (2 * depth)
+ *   pack - pack/unpack of one entry in the endpoint map
+ *   bw   - bandwidth at which model matches bcast time
+ *   send - params time per child less the time to move the params
+ * Tails come from p99 across procs, which is rough since leaf procs
+ * record zero for these phases.  Without a p99 we keep the ratio of
+ * p99 to median we had. */
+void
+launch_model_fit (const launch_model_sample * samples, int count,
+        launch_model_params * p)
+{
+    model_fit fork = {0, 0}, fork_p99 = {0, 0}, rsh = {0, 0}, rsh_p99 = {0, 0};
+    model_fit hop = {0, 0}, pack = {0, 0}, bw = {0, 0}, send = {0, 0};
+
+    double fork_ratio = (p->fork_usecs > 0.0) ? p->fork_p99 / p->fork_usecs : 1.0;
+    double rsh_ratio  = (p->rsh_usecs  > 0.0) ? p->rsh_p99  / p->rsh_usecs  : 1.0;
+
+    int i;
+    for (i = 0; i < count; i++) {
+        const launch_model_sample* s = &samples[i];
+        int kids = launch_model_children(s->shape, 0, s->nodes, s->degree, NULL);
+        if (kids == 0) {
+            continue;
+        }
+        int depth = launch_model_depth(s->shape, s->nodes, s->degree);
+
+        double fork_usecs = 0.0;
+        if (s->launch_usecs > 0.0) {
+            fork_usecs = s->launch_usecs / kids;
+            fit_add(&fork, fork_usecs);
+            if (s->launch_p99 > 0.0) {
+                double val = s->launch_p99 / kids;
+                fit_add(&fork_p99, (val > fork_usecs) ? val : fork_usecs);
+            }
+        }
+        if (s->accept_usecs > 0.0) {
+            double rsh_usecs = s->accept_usecs + fork_usecs;
+            fit_add(&rsh, rsh_usecs);
+            if (s->accept_p99 > 0.0) {
+                double extra = s->accept_p99 - s->accept_usecs;
+                fit_add(&rsh_p99, rsh_usecs + ((extra > 0.0) ? extra : 0.0));
+            }
+        }
+        if (s->signal_usecs > 0.0 && depth > 0) {
+            fit_add(&hop, s->signal_usecs / 1000.0 / (2.0 * depth));
+        }
+        if (s->pack_usecs > 0.0) {
+            fit_add(&pack, s->pack_usecs / 1000.0 / s->nodes);
+        }
+    }
+
+    fit_apply(&fork, &p->fork_usecs);
+    if (! fit_apply(&fork_p99, &p->fork_p99)) {
+        p->fork_p99 = p->fork_usecs * fork_ratio;
+    }
+    fit_apply(&rsh, &p->rsh_usecs);
+    if (! fit_apply(&rsh_p99, &p->rsh_p99)) {
+        p->rsh_p99 = p->rsh_usecs * rsh_ratio;
+    }
+    fit_apply(&hop,  &p->hop_usecs);
+    fit_apply(&pack, &p->pack_usecs);
+
+    /* bandwidth depends on hop latency, so fit it after that */
+    for (i = 0; i < count; i++) {
+        const launch_model_sample* s = &samples[i];
+        if (s->nodes >= 2 && s->bcast_usecs > 0.0 && s->bcast_bytes > 0.0) {
+            fit_add(&bw, fit_bandwidth(p, s));
+        }
+    }
+    fit_apply(&bw, &p->bw_mbs);
+
+    /* and send cost depends on bandwidth */
+    for (i = 0; i < count; i++) {
+        const launch_model_sample* s = &samples[i];
+        int kids = launch_model_children(s->shape, 0, s->nodes, s->degree, NULL);
+        if (kids == 0 || s->params_usecs <= 0.0) {
+            continue;
+        }
+        double usecs = s->params_usecs / kids;
+        usecs -= (double) (s->nodes - 1) / kids * p->host_bytes / p->bw_mbs;
+        fit_add(&send, (usecs > 1.0) ? usecs : 1.0);
+    }
+    fit_apply(&send, &p->send_usecs);
+}
+
+void
+launch_model_average (launch_model_params * p,
+        const launch_model_params * q, double weight)
+{
+    size_t i;
+    for (i = 0; i < PARAM_COUNT; i++) {
+        double* a = (double*) ((char*) p + param_table[i].offset);
+        const double* b = (const double*) ((const char*) q + param_table[i].offset);
+        *a = weight * (*a) + (1.0 - weight) * (*b);
+    }
+}
+
+const char *
+launch_model_shape_name (launch_shape shape)
+{
+    return (shape == LAUNCH_SHAPE_KNOMIAL) ? "knomial" : "kary";
+}
+
+int
+launch_model_shape_parse (const char * name)
+{
+    if (strcmp(name, "kary") == 0) {
+        return LAUNCH_SHAPE_KARY;
+    }
+    if (strcmp(name, "knomial") == 0) {
+        return LAUNCH_SHAPE_KNOMIAL;
+    }
+    return -1;
+}
+
+/* return largest power of k that divides rank (rank > 0) */
+static long long
+knomial_span (int rank, int k)
+{
+    long long step = 1;
+    while ((rank / step) % k == 0) {
+        step *= k;
+    }
+    return step;
+}
+
+/* return smallest power of k that is >= ranks */
+static long long
+knomial_root_span (int ranks, int k)
+{
+    long long span = 1;
+    while (span < ranks) {
+        span *= k;
+    }
+    return span;
+}
+
+int
+launch_model_max_children (launch_shape shape, int ranks, int degree)
+{
+    if (shape == LAUNCH_SHAPE_KARY) {
+        return degree;
+    }
+
+    /* root of a k-nomial tree has the most children */
+    int levels = 0;
+    long long span = 1;
+    while (span < ranks) {
+        span *= degree;
+        levels++;
+    }
+    return levels * (degree - 1);
+}
+
+int
+launch_model_children (launch_shape shape, int rank, int ranks,
+        int degree, int * children)
+{
+    int count = 0;
+
+    if (shape == LAUNCH_SHAPE_KARY) {
+        long long first = (long long) rank * degree + 1;
+        int i;
+        for (i = 0; i < degree; i++) {
+            long long child = first + i;
+            if (child >= ranks) {
+                break;
+            }
+            if (children != NULL) {
+                children[count] = (int) child;
+            }
+            count++;
+        }
+        return count;
+    }
+
+    /* in a k-nomial tree rank r with span k^v has children
+     * r + j*k^m for m < v, we list them from largest span down */
+    long long span;
+    if (rank == 0) {
+        span = knomial_root_span(ranks, degree);
+    } else {
+        span = knomial_span(rank, degree);
+    }
+    long long step;
+    for (step = span / degree; step >= 1; step /= degree) {
+        int j;
+        for (j = 1; j < degree; j++) {
+            long long child = rank + j * step;
+            if (child >= ranks) {
+                break;
+            }
+            if (children != NULL) {
+                children[count] = (int) child;
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+int
+launch_model_parent (launch_shape shape, int rank, int degree)
+{
+    if (rank == 0) {
+        return -1;
+    }
+
+    if (shape == LAUNCH_SHAPE_KARY) {
+        return (rank - 1) / degree;
+    }
+
+    /* clear lowest nonzero digit of rank in base k */
+    long long step = knomial_span(rank, degree);
+    return (int) (rank - ((rank / step) % degree) * step);
+}
+
+int
+launch_model_depth (launch_shape shape, int ranks, int degree)
+{
+    /* last rank is deepest in a k-ary tree, but not in a k-nomial
+     * tree, where depth is the number of nonzero digits in base k */
+    int max = 0;
+    int rank = (shape == LAUNCH_SHAPE_KARY) ? ranks - 1 : 0;
+    for (; rank < ranks; rank++) {
+        int depth = 0;
+        int r = rank;
+        while (r > 0) {
+            r = launch_model_parent(shape, r, degree);
+            depth++;
+        }
+        if (depth > max) {
+            max = depth;
+        }
+    }
+    return max;
+}
+
+int
+launch_model_subtree_size (launch_shape shape, int rank, int ranks,
+        int degree)
+{
+    if (shape == LAUNCH_SHAPE_KARY) {
+        /* add up the range of ranks at each level below rank */
+        long long size = 0;
+        long long lo = rank;
+        long long hi = rank;
+        while (lo < ranks) {
+            long long last = (hi < ranks) ? hi : ranks - 1;
+            size += last - lo + 1;
+            lo = lo * degree + 1;
+            hi = hi * degree + degree;
+        }
+        return (int) size;
+    }
+
+    if (rank == 0) {
+        return ranks;
+    }
+    long long span = knomial_span(rank, degree);
+    long long size = ranks - rank;
+    return (int) ((span < size) ? span : size);
+}
+
+/* Both shapes have the property that a subtree of n ranks has the
+ * same shape as a whole tree of n ranks, so we evaluate subtrees by
+ * looking at the children of rank 0 in a tree of n ranks, and cache
+ * results by n. */
+
+typedef struct model_cache_t {
+    int count;
+    int size;
+    int* keys;
+    double* vals;
+} model_cache;
+
+static void
+cache_init (model_cache * c)
+{
+    c->count = 0;
+    c->size  = 0;
+    c->keys  = NULL;
+    c->vals  = NULL;
+}
+
+static void
+cache_free (model_cache * c)
+{
+    free(c->keys);
+    free(c->vals);
+    cache_init(c);
+}
+
+static int
+cache_get (const model_cache * c, int key, double * val)
+{
+    int i;
+    for (i = 0; i < c->count; i++) {
+        if (c->keys[i] == key) {
+            *val = c->vals[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void
+cache_put (model_cache * c, int key, double val)
+{
+    if (c->count == c->size) {
+        c->size = (c->size > 0) ? c->size * 2 : 64;
+        c->keys = (int*)    realloc(c->keys, c->size * sizeof(int));
+        c->vals = (double*) realloc(c->vals, c->size * sizeof(double));
+    }
+    c->keys[c->count] = key;
+    c->vals[c->count] = val;
+    c->count++;
+}
+
+/* list children of root in a tree of n ranks along with the size
+ * of each child's subtree, caller frees both arrays */
+static int
+root_children (launch_shape shape, int n, int degree, int ** children,
+        int ** sizes)
+{
+    int max = launch_model_max_children(shape, n, degree);
+    *children = (int*) malloc((max + 1) * sizeof(int));
+    *sizes    = (int*) malloc((max + 1) * sizeof(int));
+    int count = launch_model_children(shape, 0, n, degree, *children);
+    int i;
+    for (i = 0; i < count; i++) {
+        (*sizes)[i] = launch_model_subtree_size(shape, (*children)[i], n, degree);
+    }
+    return count;
+}
+
+/* cost for sender to put a message of given size on a link */
+static double
+msg_usecs (const launch_model_params * p, double bytes)
+{
+    double usecs = p->send_usecs;
+    if (p->bw_mbs > 0.0) {
+        /* 1 MB/s moves 1 byte per usec */
+        usecs += bytes / p->bw_mbs;
+    }
+    return usecs;
+}
+
+/* time from a spawn proc getting its params until it hears that all
+ * procs in its subtree of n ranks are up, this follows the launch
+ * children, accept children, and send params loops in session_start,
+ * each child is sent the hosts of its own subtree */
+static double
+unfurl_subtree (const launch_model_params * p, launch_shape shape,
+        int degree, int n, model_cache * cache)
+{
+    double val;
+    if (cache_get(cache, n, &val)) {
+        return val;
+    }
+
+    int* children;
+    int* sizes;
+    int count = root_children(shape, n, degree, &children, &sizes);
+
+    /* fork remote shells one after another, child i connects back
+     * once its remote shell has started it */
+    double t = 0.0;
+    int i;
+    for (i = 0; i < count; i++) {
+        t += p->fork_usecs;
+    }
+
+    /* accept children in the order they connect */
+    for (i = 0; i < count; i++) {
+        double connect = (double) (i + 1) * p->fork_usecs + p->rsh_usecs;
+        if (connect > t) {
+            t = connect;
+        }
+        t += p->accept_usecs;
+    }
+
+    /* send params to each child, then each child unfurls its own
+     * subtree and signals back up */
+    double done = t;
+    for (i = 0; i < count; i++) {
+        t += msg_usecs(p, (double) sizes[i] * p->host_bytes);
+        double child = t + p->hop_usecs +
+            unfurl_subtree(p, shape, degree, sizes[i], cache) +
+            p->hop_usecs;
+        if (child > done) {
+            done = child;
+        }
+    }
+    if (t > done) {
+        done = t;
+    }
+
+    free(sizes);
+    free(children);
+
+    cache_put(cache, n, done);
+    return done;
+}
+
+double
+launch_model_unfurl (const launch_model_params * p, int ranks,
+        launch_shape shape, int degree)
+{
+    model_cache cache;
+    cache_init(&cache);
+    double usecs = unfurl_subtree(p, shape, degree, ranks, &cache);
+    cache_free(&cache);
+    return usecs;
+}
+
+/* given the time each chunk arrives at the root of a subtree of n
+ * ranks, return the time the last chunk arrives anywhere in that
+ * subtree, bcast forwards each chunk to every child in turn as soon
+ * as it has the chunk and has finished sending the previous one */
+static double
+bcast_subtree (const launch_model_params * p, launch_shape shape,
+        int degree, int n, const double * arrive, int chunks,
+        size_t bytes, size_t chunk)
+{
+    double done = arrive[chunks - 1];
+
+    int* children;
+    int* sizes;
+    int count = root_children(shape, n, degree, &children, &sizes);
+    if (count == 0) {
+        free(sizes);
+        free(children);
+        return done;
+    }
+
+    /* A later child with the same subtree size gets every chunk no
+     * sooner than an earlier one, and so finishes no sooner, so we
+     * only follow the last child sent to among each run of children
+     * with the same subtree size. */
+    int reps = 0;
+    int* rep_index = (int*) malloc(count * sizeof(int));
+    int i;
+    for (i = 0; i < count; i++) {
+        if (i == count - 1 || sizes[i + 1] != sizes[i]) {
+            rep_index[reps++] = i;
+        }
+    }
+    double* rep_arrive = (double*) malloc((size_t) reps * chunks * sizeof(double));
+
+    double t = 0.0;
+    int j;
+    for (j = 0; j < chunks; j++) {
+        if (arrive[j] > t) {
+            t = arrive[j];
+        }
+        size_t offset = (size_t) j * chunk;
+        size_t len = (bytes - offset < chunk) ? bytes - offset : chunk;
+        double cost = msg_usecs(p, (double) len);
+
+        int r = 0;
+        for (i = 0; i < count; i++) {
+            t += cost;
+            if (r < reps && rep_index[r] == i) {
+                rep_arrive[r * chunks + j] = t + p->hop_usecs;
+                r++;
+            }
+        }
+    }
+
+    int r;
+    for (r = 0; r < reps; r++) {
+        int size = sizes[rep_index[r]];
+        double child = bcast_subtree(p, shape, degree, size,
+            &rep_arrive[r * chunks], chunks, bytes, chunk);
+        if (child > done) {
+            done = child;
+        }
+    }
+
+    free(rep_arrive);
+    free(rep_index);
+    free(sizes);
+    free(children);
+
+    return done;
+}
+
+double
+launch_model_bcast (const launch_model_params * p, int ranks,
+        launch_shape shape, int degree, size_t bytes, size_t chunk)
+{
+    if (bytes == 0) {
+        return 0.0;
+    }
+    if (chunk == 0 || chunk > bytes) {
+        chunk = bytes;
+    }
+
+    /* root has the whole file in memory before it sends */
+    int chunks = (int) ((bytes + chunk - 1) / chunk);
+    double* arrive = (double*) calloc(chunks, sizeof(double));
+    double usecs = bcast_subtree(p, shape, degree, ranks, arrive, chunks,
+        bytes, chunk);
+    free(arrive);
+    return usecs;
+}
+
+/* gather_strmap first sends sizes up the tree and then the data,
+ * return time a subtree of n ranks has sent its size to its parent
+ * in sent_size and its data in the return value, all procs start at
+ * time 0 */
+static double
+gather_subtree (const launch_model_params * p, launch_shape shape,
+        int degree, int n, double entry_bytes, model_cache * size_cache,
+        model_cache * data_cache, double * sent_size)
+{
+    double data;
+    if (cache_get(data_cache, n, &data)) {
+        cache_get(size_cache, n, sent_size);
+        return data;
+    }
+
+    int* children;
+    int* sizes;
+    int count = root_children(shape, n, degree, &children, &sizes);
+
+    double* child_size = (double*) malloc((count + 1) * sizeof(double));
+    double* child_data = (double*) malloc((count + 1) * sizeof(double));
+    int i;
+    for (i = 0; i < count; i++) {
+        child_data[i] = gather_subtree(p, shape, degree, sizes[i],
+            entry_bytes, size_cache, data_cache, &child_size[i]);
+    }
+
+    /* read size from each child, then send our total size */
+    double t = 0.0;
+    for (i = 0; i < count; i++) {
+        double arrive = child_size[i] + p->hop_usecs;
+        if (arrive > t) {
+            t = arrive;
+        }
+    }
+    t += msg_usecs(p, sizeof(unsigned long long));
+    *sent_size = t;
+
+    /* pack our entry, then read data from each child in turn */
+    t += p->pack_usecs;
+    for (i = 0; i < count; i++) {
+        double arrive = child_data[i] + p->hop_usecs;
+        if (arrive > t) {
+            t = arrive;
+        }
+    }
+    t += msg_usecs(p, (double) n * entry_bytes);
+
+    free(child_data);
+    free(child_size);
+    free(sizes);
+    free(children);
+
+    cache_put(size_cache, n, *sent_size);
+    cache_put(data_cache, n, t);
+    return t;
+}
+
+double
+launch_model_gather (const launch_model_params * p, int ranks,
+        launch_shape shape, int degree, size_t entry_bytes)
+{
+    model_cache size_cache, data_cache;
+    cache_init(&size_cache);
+    cache_init(&data_cache);
+
+    /* root doesn't send data on, but unpacks every entry instead */
+    double sent_size;
+    double usecs = gather_subtree(p, shape, degree, ranks,
+        (double) entry_bytes, &size_cache, &data_cache, &sent_size);
+    usecs -= msg_usecs(p, (double) ranks * (double) entry_bytes);
+    usecs += (double) ranks * p->pack_usecs;
+
+    cache_free(&data_cache);
+    cache_free(&size_cache);
+    return usecs;
+}
+
+void
+launch_model_recommend (const launch_model_params * p, int ranks,
+        size_t bytes, launch_model_choice * choice)
+{
+    choice->shape        = LAUNCH_SHAPE_KARY;
+    choice->degree       = 2;
+    choice->chunk        = 0;
+    choice->unfurl_usecs = 0.0;
+    choice->bcast_usecs  = 0.0;
+
+    double best = -1.0;
+    int shape;
+    for (shape = LAUNCH_SHAPE_KARY; shape <= LAUNCH_SHAPE_KNOMIAL; shape++) {
+        int degree;
+        for (degree = 2; degree <= MODEL_MAX_DEGREE; degree++) {
+            /* degrees above ranks-1 all build the same flat tree */
+            if (degree > 2 && degree > ranks - 1) {
+                break;
+            }
+
+            double unfurl = launch_model_unfurl(p, ranks, (launch_shape) shape, degree);
+
+            /* try whole file, then chunks of powers of two MB */
+            size_t best_chunk = 0;
+            double best_bcast = launch_model_bcast(p, ranks,
+                (launch_shape) shape, degree, bytes, 0);
+            size_t chunk;
+            for (chunk = MODEL_MIN_CHUNK; chunk < bytes; chunk *= 2) {
+                if ((bytes + chunk - 1) / chunk > MODEL_MAX_CHUNKS) {
+                    continue;
+                }
+                double bcast = launch_model_bcast(p, ranks,
+                    (launch_shape) shape, degree, bytes, chunk);
+                if (bcast < best_bcast) {
+                    best_bcast = bcast;
+                    best_chunk = chunk;
+                }
+            }
+
+            double total = unfurl + best_bcast;
+            if (best < 0.0 || total < best) {
+                best = total;
+                choice->shape        = (launch_shape) shape;
+                choice->degree       = degree;
+                choice->chunk        = best_chunk;
+                choice->unfurl_usecs = unfurl;
+                choice->bcast_usecs  = best_bcast;
+            }
+        }
+    }
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* Cost model of a launch: given the measured cost of the primitives
+ * the spawn tree is built from (forking a remote shell, the remote
+ * shell starting a spawn proc, accepting a connection, and sending a
+ * message over a tree link), predict how long it takes to unfurl the
+ * tree and to run the bcast and gather_strmap algorithms over it for
+ * a given tree shape, degree, and chunk size.
+ *
+ * Predictions are deterministic and cheap: subtrees with the same
+ * number of ranks have the same shape in both k-ary and k-nomial
+ * trees, so each subtree size is only evaluated once.  The avasim
+ * simulator adds variance to these costs with a discrete-event
+ * simulation of every rank. */
+
+#ifndef LAUNCH_MODEL_H
+#define LAUNCH_MODEL_H 1
+
+#include <stddef.h>
+
+/* tree shapes */
+typedef enum launch_shape_t {
+    LAUNCH_SHAPE_KARY = 0, /* rank r has children k*r+1 .. k*r+k */
+    LAUNCH_SHAPE_KNOMIAL,  /* rank r has children r + j*k^m, largest first */
+} launch_shape;
+
+/* cost of launch primitives, all times in usecs */
+typedef struct launch_model_params_t {
+    double fork_usecs;   /* parent cost to fork one remote shell */
+    double fork_p99;     /* 99th percentile of fork cost */
+    double rsh_usecs;    /* fork of remote shell until child connects back */
+    double rsh_p99;      /* 99th percentile of rsh time */
+    double accept_usecs; /* parent cost to accept one child */
+    double send_usecs;   /* sender cost of one message */
+    double hop_usecs;    /* latency of one message over a tree link */
+    double bw_mbs;       /* bandwidth of a tree link in MB/s (bytes/usec) */
+    double host_bytes;   /* bytes of params sent per host in subtree */
+    double pack_usecs;   /* cost to pack and unpack one strmap entry */
+} launch_model_params;
+
+/* times measured by one launch, in usecs, 0 where not measured */
+typedef struct launch_model_sample_t {
+    int nodes;           /* spawn procs in tree, including root */
+    launch_shape shape;
+    int degree;
+    double launch_usecs; /* root forks its children */
+    double launch_p99;   /* p99 of launch children across procs */
+    double accept_usecs; /* root accepts its children */
+    double accept_p99;   /* p99 of accept children across procs */
+    double params_usecs; /* root sends params to its children */
+    double signal_usecs; /* 1000 signal round trips through the tree */
+    double pack_usecs;   /* 1000 pack/unpack of the spawn endpoint map */
+    double bcast_usecs;  /* bcast of a file */
+    double bcast_bytes;  /* size of that file */
+    size_t bcast_chunk;  /* chunk size used, 0 for whole file */
+} launch_model_sample;
+
+/* a choice of tree and chunk size along with its predicted cost */
+typedef struct launch_model_choice_t {
+    launch_shape shape;
+    int degree;
+    size_t chunk;        /* bcast chunk size in bytes */
+    double unfurl_usecs; /* predicted time to unfurl tree */
+    double bcast_usecs;  /* predicted time to bcast file */
+} launch_model_choice;
+
+/* fill params with costs typical of a commodity cluster */
+void launch_model_defaults (launch_model_params * p);
+
+/* set param named key to value, returns 0 on success */
+int launch_model_set (launch_model_params * p, const char * key,
+        const char * value);
+
+/* read params from a file of key=value lines, keys not in the file
+ * keep their current value, returns 0 on success */
+int launch_model_read (const char * file, launch_model_params * p);
+
+/* write params to file as key=value lines, replacing file at once
+ * with rename so readers never see it partly written, returns 0 on
+ * success */
+int launch_model_write (const char * file, const launch_model_params * p);
+
+/* update params with costs derived from count samples, params not
+ * measured by any sample keep their current value */
+void launch_model_fit (const launch_model_sample * samples, int count,
+        launch_model_params * p);
+
+/* set each param in p to weight * p + (1 - weight) * q */
+void launch_model_average (launch_model_params * p,
+        const launch_model_params * q, double weight);
+
+/* returns name of shape, and shape given a name, -1 if unknown */
+const char * launch_model_shape_name (launch_shape shape);
+int launch_model_shape_parse (const char * name);
+
+/* return number of children of rank in tree of ranks with given
+ * shape and degree, and fill in children with their ranks ordered
+ * by decreasing subtree size if children is not NULL, children must
+ * have room for launch_model_max_children entries */
+int launch_model_children (launch_shape shape, int rank, int ranks,
+        int degree, int * children);
+int launch_model_max_children (launch_shape shape, int ranks, int degree);
+
+/* return parent of rank, or -1 for the root */
+int launch_model_parent (launch_shape shape, int rank, int degree);
+
+/* return depth of deepest rank, the root is at depth 0 */
+int launch_model_depth (launch_shape shape, int ranks, int degree);
+
+/* return number of ranks in subtree rooted at rank */
+int launch_model_subtree_size (launch_shape shape, int rank, int ranks,
+        int degree);
+
+/* predicted usecs for root to launch the tree, where each spawn proc
+ * forks its children, accepts them, and sends them params, until all
+ * spawn procs have signaled root that they are up */
+double launch_model_unfurl (const launch_model_params * p, int ranks,
+        launch_shape shape, int degree);
+
+/* predicted usecs to bcast bytes from root in chunks of given size */
+double launch_model_bcast (const launch_model_params * p, int ranks,
+        launch_shape shape, int degree, size_t bytes, size_t chunk);
+
+/* predicted usecs to gather a strmap with one entry of given size
+ * from every rank to root */
+double launch_model_gather (const launch_model_params * p, int ranks,
+        launch_shape shape, int degree, size_t entry_bytes);
+
+/* pick shape, degree, and chunk size to minimize predicted unfurl
+ * plus bcast of bytes (bytes may be 0) over ranks */
+void launch_model_recommend (const launch_model_params * p, int ranks,
+        size_t bytes, launch_model_choice * choice);
+
+#endif
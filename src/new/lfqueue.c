@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+#include <lfqueue.h>
+
+#include "spawn.h"
+
+#include <sched.h>
+
+/* The queue is a ring buffer with one more slot than its capacity,
+ * so that head == tail means empty and tail + 1 == head means full.
+ * Only the producer writes tail and only the consumer writes head,
+ * each publishes its index with a release store after touching the
+ * slot, and reads the other side's index with an acquire load. */
+struct lfqueue_struct {
+    size_t size;   /* number of slots in items array */
+    void** items;  /* ring buffer of items */
+    size_t head;   /* index of next item to pop, written by consumer */
+    size_t tail;   /* index of next free slot, written by producer */
+};
+
+lfqueue *
+lfqueue_new (size_t capacity)
+{
+    lfqueue* q = (lfqueue*) SPAWN_MALLOC(sizeof(lfqueue));
+    q->size  = capacity + 1;
+    q->items = (void**) SPAWN_MALLOC(q->size * sizeof(void*));
+    q->head  = 0;
+    q->tail  = 0;
+    return q;
+}
+
+void
+lfqueue_delete (lfqueue ** pq)
+{
+    if (pq == NULL || *pq == NULL) {
+        return;
+    }
+
+    lfqueue* q = *pq;
+    spawn_free(&q->items);
+    spawn_free(pq);
+
+    return;
+}
+
+int
+lfqueue_push (lfqueue * q, void * item)
+{
+    /* we own tail, but need to see latest value of head */
+    size_t tail = q->tail;
+    size_t next = (tail + 1) % q->size;
+    if (next == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) {
+        /* queue is full */
+        return 1;
+    }
+
+    /* fill in slot, then publish it to the consumer */
+    q->items[tail] = item;
+    __atomic_store_n(&q->tail, next, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void
+lfqueue_push_wait (lfqueue * q, void * item)
+{
+    while (lfqueue_push(q, item) != 0) {
+        sched_yield();
+    }
+    return;
+}
+
+void *
+lfqueue_pop (lfqueue * q)
+{
+    /* we own head, but need to see latest value of tail */
+    size_t head = q->head;
+    if (head == __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)) {
+        /* queue is empty */
+        return NULL;
+    }
+
+    /* read slot, then release it back to the producer */
+    void* item = q->items[head];
+    __atomic_store_n(&q->head, (head + 1) % q->size, __ATOMIC_RELEASE);
+
+    return item;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* Bounded lock-free queue of pointers for passing work between
+ * exactly two threads: one thread pushes and one thread pops.
+ * Neither side ever blocks on a lock, a full push or an empty
+ * pop simply fails and the caller decides how to wait. */
+
+#ifndef LFQUEUE_H
+#define LFQUEUE_H 1
+
+#include <stdlib.h>
+
+typedef struct lfqueue_struct lfqueue;
+
+/* allocate a new queue that holds up to capacity items */
+lfqueue * lfqueue_new (size_t capacity);
+
+/* free queue and set caller's pointer to NULL, any items still in
+ * the queue are not freed */
+void lfqueue_delete (lfqueue ** pq);
+
+/* append item to tail of queue, returns 0 on success or 1 if the
+ * queue is full (only called by producer thread) */
+int lfqueue_push (lfqueue * q, void * item);
+
+/* like lfqueue_push, but yields the processor until there is room */
+void lfqueue_push_wait (lfqueue * q, void * item);
+
+/* remove and return item from head of queue, returns NULL if the
+ * queue is empty (only called by consumer thread) */
+void * lfqueue_pop (lfqueue * q);
+
+#endif
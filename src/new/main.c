@@ -13,6 +13,7 @@
  * Local Headers
  */
 #include <session.h>
+#include <timer_util.h>
 
 /*
  * System Headers
@@ -41,6 +42,20 @@ main (int argc, char * argv[])
         exit(EXIT_FAILURE);
     }
 
-    if (!nodeid) { print_deltas(stdout); }
+    if (!nodeid) {
+        print_deltas(stdout);
+
+        /* write phase times where the benchmark driver can read them */
+        const char* csv = getenv("MV2_SPAWN_BENCH_CSV");
+        if (csv != NULL) {
+            FILE* fd = fopen(csv, "w");
+            if (fd != NULL) {
+                write_deltas_csv(fd);
+                fclose(fd);
+            } else {
+                fprintf(stderr, "Failed to open `%s' to write phase times\n", csv);
+            }
+        }
+    }
     return EXIT_SUCCESS;
 }
@@ -12,37 +12,19 @@
 /* Implement subset of PMI functionality on top of pmgr_collective calls */
 
 #include "pmi.h"
+#include "pmi_conn.h"
 #include "spawn.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/*******************************
- * MPIR
- ******************************/
-
-#ifndef VOLATILE
-#if defined(__STDC__) || defined(__cplusplus)
-#define VOLATILE volatile
-#else
-#define VOLATILE
-#endif
-#endif
-
-extern VOLATILE int MPIR_debug_gate;
-
-/*******************************
- * End MPIR
- ******************************/
-
 static int initialized  = 0;
-spawn_net_endpoint* global_ep = SPAWN_NET_ENDPOINT_NULL;
-static char* server_name = NULL;
-spawn_net_channel* server_ch = SPAWN_NET_CHANNEL_NULL;
 static int global_ranks;
 static int global_rank;
 static int global_jobid;
+static int clique_size;
+static int* clique_ranks = NULL;
 
 #define MAX_KVS_LEN (256)
 #define MAX_KEY_LEN (256)
@@ -59,13 +41,6 @@ static const char command_finalize[] = "FINALIZE";
 
 int PMI_Init( int *spawned )
 {
-  const char* value;
-
-  /* if being debugged, wait for debugger to attach */
-  if ((value = getenv("MV2_MPIR")) != NULL) {
-    while (MPIR_debug_gate == 0);
-  }
-
   /* check that we got a variable to write our flag value to */
   if (spawned == NULL) {
     return PMI_ERR_INVALID_ARG;
@@ -78,34 +53,14 @@ int PMI_Init( int *spawned )
   put = strmap_new();
   commit = strmap_new();
 
-  /* read PMI server addr */
-  server_name = NULL;
-  if ((value = getenv("MV2_PMI_ADDR")) != NULL) {
-    server_name = SPAWN_STRDUP(value);
-  }
-  if (server_name == NULL) {
+  /* connect to server, this is a no-op if ring_create2 or another
+   * user of the library already opened the connection */
+  if (pmi_conn_open() != PMI_CONN_SUCCESS) {
     return PMI_FAIL;
   }
 
-  /* create an endpoint */
-  spawn_net_type type = spawn_net_infer_type(server_name);
-  global_ep = spawn_net_open(type);
-
-  /* connect to server */
-  server_ch = spawn_net_connect(server_name);
-  if (server_ch == SPAWN_NET_CHANNEL_NULL) {
-    return PMI_FAIL;
-  }
-
-  /* send PMI_INIT message to server */
-  strmap* init = strmap_new();
-  strmap_set(init, "MSG", "PMI_INIT");
-  spawn_net_write_strmap(server_ch, init);
-  strmap_delete(&init);
-
-  /* read parameters from server */
-  strmap* params = strmap_new();
-  spawn_net_read_strmap(server_ch, params);
+  /* read parameters the server sent in reply to PMI_INIT */
+  const strmap* params = pmi_conn_params();
 
   /* get rank, ranks, and jobid */
   const char* ranks_str = strmap_get(params, "RANKS");
@@ -120,8 +75,44 @@ int PMI_Init( int *spawned )
   /* create something for our KVS name */
   snprintf(kvs_name, sizeof(kvs_name), "jobid.%d", global_jobid);
 
-  /* delete parameters */
-  strmap_delete(&params);
+  /* get ranks of procs on our node, if server didn't send a clique,
+   * we're the only one we know about */
+  clique_size = 1;
+  const char* clique_size_str = strmap_get(params, "CLIQUE_SIZE");
+  const char* clique_ranks_str = strmap_get(params, "CLIQUE_RANKS");
+  if (clique_size_str != NULL && clique_ranks_str != NULL) {
+    clique_size = atoi(clique_size_str);
+    if (clique_size < 1) {
+      clique_size = 1;
+    }
+  }
+  clique_ranks = (int*) SPAWN_MALLOC(clique_size * sizeof(int));
+  clique_ranks[0] = global_rank;
+  if (clique_size_str != NULL && clique_ranks_str != NULL) {
+    /* parse comma-separated list of ranks, if the list is shorter
+     * than CLIQUE_SIZE, only report the ranks it gives */
+    int i;
+    const char* ptr = clique_ranks_str;
+    for (i = 0; i < clique_size; i++) {
+      char* end;
+      long value = strtol(ptr, &end, 10);
+      if (end == ptr) {
+        break;
+      }
+      clique_ranks[i] = (int) value;
+      if (*end != ',') {
+        i++;
+        break;
+      }
+      ptr = end + 1;
+    }
+    if (i > 0) {
+      clique_size = i;
+    } else {
+      clique_size = 1;
+      clique_ranks[0] = global_rank;
+    }
+  }
 
   /* if successful, set initialized=1 */
   initialized = 1;
@@ -151,17 +142,16 @@ int PMI_Finalize( void )
   strmap_delete(&commit);
   strmap_delete(&put);
 
-  /* send "FINALIZE" to server */
-  strmap* final = strmap_new();
-  strmap_set(final, "MSG", "PMI_FINALIZE");
-  spawn_net_write_strmap(server_ch, final);
-  strmap_delete(&final);
+  /* free list of ranks on our node */
+  spawn_free(&clique_ranks);
 
-  /* disconnect from parent */
-  spawn_net_disconnect(&server_ch);
+  /* release our reference to the server connection, then send
+   * PMI_FINALIZE and disconnect, ring_create2 is done with it by now */
+  pmi_conn_close();
+  pmi_conn_finalize();
 
-  /* close down our endpoint */
-  spawn_net_close(&global_ep);
+  /* we're no longer initialized */
+  initialized = 0;
 
   return rc;
 }
@@ -230,6 +220,45 @@ int PMI_Get_appnum( int *appnum )
   return PMI_SUCCESS;
 }
 
+int PMI_Get_clique_size( int *size )
+{
+  /* check that we're initialized */
+  if (!initialized) {
+    return PMI_ERR_INIT;
+  }
+
+  /* check that we got a variable to write our value to */
+  if (size == NULL) {
+    return PMI_ERR_INVALID_ARG;
+  }
+
+  *size = clique_size;
+  return PMI_SUCCESS;
+}
+
+int PMI_Get_clique_ranks( int ranks[], int length )
+{
+  /* check that we're initialized */
+  if (!initialized) {
+    return PMI_ERR_INIT;
+  }
+
+  /* check that we got an array to write our values to */
+  if (ranks == NULL) {
+    return PMI_ERR_INVALID_ARG;
+  }
+
+  /* check that the array is large enough */
+  if (length < clique_size) {
+    return PMI_ERR_INVALID_LENGTH;
+  }
+
+  /* copy ranks of procs on our node, we got these from
+   * the server during init, so no need to talk to it now */
+  memcpy(ranks, clique_ranks, clique_size * sizeof(int));
+  return PMI_SUCCESS;
+}
+
 int PMI_Publish_name( const char service_name[], const char port[] )
 {
     return PMI_FAIL;
@@ -248,6 +277,7 @@ int PMI_Lookup_name( const char service_name[], char port[] )
 int PMI_Abort(int exit_code, const char error_msg[])
 {
   /* TODO: send "ABORT" message to server */
+  spawn_net_channel* server_ch = pmi_conn_channel();
   if (server_ch != SPAWN_NET_CHANNEL_NULL) {
     strmap* final = strmap_new();
     strmap_set(final,  "MSG", "PMI_ABORT");
@@ -399,19 +429,17 @@ int PMI_KVS_Commit( const char kvsname[] )
   return PMI_SUCCESS;
 }
 
-int PMI_Barrier( void )
+/* execute a fence, and collect key/values on all nodes
+ * if collect is set */
+static int fence( int collect )
 {
-  /* check that we're initialized */
-  if (!initialized) {
-    /* would like to return PMI_ERR_INIT here, but definition says
-     * it must return either SUCCESS or FAIL, and since user knows
-     * that PMI_FAIL == -1, he could be testing for this */
-    return PMI_FAIL;
-  }
+  /* get channel to server */
+  spawn_net_channel* server_ch = pmi_conn_channel();
 
-  /* send "BARRIER" message to server */
+  /* send "FENCE" message to server */
   strmap* map = strmap_new();
-  strmap_set(map, "MSG", "PMI_BARRIER");
+  strmap_set(map, "MSG", "PMI_FENCE");
+  strmap_setf(map, "COLLECT=%d", collect);
   spawn_net_write_strmap(server_ch, map);
   strmap_delete(&map);
 
@@ -422,7 +450,7 @@ int PMI_Barrier( void )
   strmap_delete(&commit);
   commit = strmap_new();
 
-  /* wait for PMI_BCAST message from server to complete barrier */
+  /* wait for PMI_BCAST message from server to complete fence */
   map = strmap_new();
   spawn_net_read_strmap(server_ch, map);
   strmap_delete(&map);
@@ -430,37 +458,45 @@ int PMI_Barrier( void )
   return PMI_SUCCESS; 
 }
 
-int PMI_KVS_Get( const char kvsname[], const char key[], char value[], int length)
+int PMI_Barrier( void )
 {
   /* check that we're initialized */
   if (!initialized) {
-    return PMI_ERR_INIT;
+    /* would like to return PMI_ERR_INIT here, but definition says
+     * it must return either SUCCESS or FAIL, and since user knows
+     * that PMI_FAIL == -1, he could be testing for this */
+    return PMI_FAIL;
   }
 
-  /* check length of name */
-  if (kvsname == NULL || strlen(kvsname) > MAX_KVS_LEN) {
-    return PMI_ERR_INVALID_KVS;
-  }
+  /* a PMI-1 barrier makes all committed values visible everywhere */
+  return fence(1);
+}
 
-  /* check that kvsname is the correct one */
-  if (strcmp(kvsname, kvs_name) != 0) {
-    return PMI_ERR_INVALID_KVS;
-  }
-      
-  /* check length of key */
-  if (key == NULL || strlen(key) > MAX_KEY_LEN) {
-    return PMI_ERR_INVALID_KEY;
+int PMIX_Fence( int collect )
+{
+  /* check that we're initialized */
+  if (!initialized) {
+    return PMI_FAIL;
   }
 
-  /* check that we have a buffer to write something to */
-  if (value == NULL) {
-    return PMI_ERR_INVALID_VAL;
-  }
+  return fence(collect ? 1 : 0);
+}
+
+/* send a get request for the given key to the server and copy
+ * value to caller's buffer, if rank >= 0, it's the rank that put
+ * the key, and the server may fetch the value from that rank's node */
+static int get( int rank, const char key[], char value[], int length )
+{
+  /* get channel to server */
+  spawn_net_channel* server_ch = pmi_conn_channel();
 
   /* send request to server for key */
   strmap* map = strmap_new();
   strmap_set(map, "MSG", "PMI_GET");
   strmap_set(map, "KEY", key);
+  if (rank >= 0) {
+    strmap_setf(map, "RANK=%d", rank);
+  }
   spawn_net_write_strmap(server_ch, map);
   strmap_delete(&map);
 
@@ -471,6 +507,7 @@ int PMI_KVS_Get( const char kvsname[], const char key[], char value[], int lengt
   const char* str = strmap_get(map, "VAL");
   if (str == NULL) {
     /* failed to find the key */
+    strmap_delete(&map);
     return PMI_FAIL;
   }
 
@@ -490,6 +527,61 @@ int PMI_KVS_Get( const char kvsname[], const char key[], char value[], int lengt
   return PMI_SUCCESS;
 }
 
+int PMI_KVS_Get( const char kvsname[], const char key[], char value[], int length)
+{
+  /* check that we're initialized */
+  if (!initialized) {
+    return PMI_ERR_INIT;
+  }
+
+  /* check length of name */
+  if (kvsname == NULL || strlen(kvsname) > MAX_KVS_LEN) {
+    return PMI_ERR_INVALID_KVS;
+  }
+
+  /* check that kvsname is the correct one */
+  if (strcmp(kvsname, kvs_name) != 0) {
+    return PMI_ERR_INVALID_KVS;
+  }
+      
+  /* check length of key */
+  if (key == NULL || strlen(key) > MAX_KEY_LEN) {
+    return PMI_ERR_INVALID_KEY;
+  }
+
+  /* check that we have a buffer to write something to */
+  if (value == NULL) {
+    return PMI_ERR_INVALID_VAL;
+  }
+
+  return get(-1, key, value, length);
+}
+
+int PMIX_Get( int rank, const char key[], char value[], int length )
+{
+  /* check that we're initialized */
+  if (!initialized) {
+    return PMI_ERR_INIT;
+  }
+
+  /* check that rank is valid */
+  if (rank < 0 || rank >= global_ranks) {
+    return PMI_ERR_INVALID_ARG;
+  }
+
+  /* check length of key */
+  if (key == NULL || strlen(key) > MAX_KEY_LEN) {
+    return PMI_ERR_INVALID_KEY;
+  }
+
+  /* check that we have a buffer to write something to */
+  if (value == NULL) {
+    return PMI_ERR_INVALID_VAL;
+  }
+
+  return get(rank, key, value, length);
+}
+
 int PMI_Spawn_multiple(
   int count, const char * cmds[], const char ** argvs[], const int maxprocs[],
   const int info_keyval_sizesp[], const PMI_keyval_t * info_keyval_vectors[],
@@ -512,6 +604,9 @@ int PMIX_Ring(
     return PMI_ERR_INIT;
   }
 
+  /* get channel to server */
+  spawn_net_channel* server_ch = pmi_conn_channel();
+
   /* check length of input value */
   if (value == NULL || strlen(value) > MAX_VAL_LEN) {
     return PMI_ERR_INVALID_VAL;
@@ -542,8 +637,9 @@ int PMIX_Ring(
   /* extract values from map, we now have
    * the address of our left and right neighbors
    * in the ring, as well as our rank within
-   * the ring, note that our ring rank may be
-   * different than our global rank */
+   * the ring, which is our global rank when
+   * ranks are placed in blocks, but only our
+   * position in the ring with other maps */
   const char* left_str  = strmap_get(map, "LEFT");
   const char* right_str = strmap_get(map, "RIGHT");
   const char* count_str = strmap_get(map, "COUNT");
@@ -861,6 +861,56 @@ the function.
 @*/
 int PMIX_Ring( const char value[], int *rank, int *ranks, char left[], char right[], int length );
 
+#define HAVE_PMIX_FENCE 1
+/*@
+PMIX_Fence - barrier across the process group with optional data collection
+
+Input Parameters:
+. collect - if non-zero, make all committed key/value pairs available
+            on every node before returning
+
+Return values:
++ PMI_SUCCESS - fence successfully finished
+- PMI_FAIL - fence failed
+
+Notes:
+This function is a collective call across all processes in the process group
+the local process belongs to.  It will not return until all the processes
+have called 'PMIX_Fence()'.  'PMIX_Fence(1)' is equivalent to 'PMI_Barrier()'.
+With 'collect' set to zero, the fence only synchronizes, and key/value pairs
+committed before the fence stay on the node of the process that put them.
+Such values can then be fetched on demand with 'PMIX_Get()' (direct modex),
+which is much cheaper when each process only needs values from a few peers.
+@*/
+int PMIX_Fence( int collect );
+
+/*@
+PMIX_Get - obtain a key/value pair put by a specific rank
+
+Input Parameters:
++ rank - rank of the process that put the key
+. key - key
+- length - length of value character array
+
+Output Parameters:
+. value - value
+
+Return values:
++ PMI_SUCCESS - key/value pair successfully obtained
+. PMI_ERR_INVALID_ARG - invalid rank
+. PMI_ERR_INVALID_KEY - invalid key
+. PMI_ERR_INVALID_VAL - invalid val argument
+. PMI_ERR_INVALID_LENGTH - invalid length argument
+- PMI_FAIL - failed to get key/value pair
+
+Notes:
+Like 'PMI_KVS_Get()', but since the caller names the rank that put the key,
+the value can be found even if it was committed before a 'PMIX_Fence(0)'.
+In that case, the request is routed to the node of that rank, and the value
+is cached on the local node for subsequent lookups.
+@*/
+int PMIX_Get( int rank, const char key[], char value[], int length );
+
 #if defined(__cplusplus)
 }
 #endif
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+#include "pmi_conn.h"
+#include "spawn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*******************************
+ * MPIR
+ ******************************/
+
+#ifndef VOLATILE
+#if defined(__STDC__) || defined(__cplusplus)
+#define VOLATILE volatile
+#else
+#define VOLATILE
+#endif
+#endif
+
+extern VOLATILE int MPIR_debug_gate;
+
+/*******************************
+ * End MPIR
+ ******************************/
+
+static int conn_refs = 0; /* number of open references to connection */
+static int conn_up = 0;   /* whether we are connected to PMI server */
+static int conn_atexit = 0; /* whether we registered finalize at exit */
+static spawn_net_endpoint* conn_ep = SPAWN_NET_ENDPOINT_NULL; /* our local endpoint */
+static spawn_net_channel*  conn_ch = SPAWN_NET_CHANNEL_NULL; /* channel to PMI server */
+static strmap* conn_params = NULL; /* reply to PMI_INIT from server */
+
+int pmi_conn_open(void)
+{
+  const char* value;
+
+  /* if the connection is already up, just add a reference */
+  if (conn_up) {
+    conn_refs++;
+    return PMI_CONN_SUCCESS;
+  }
+
+  /* if being debugged, wait for debugger to attach */
+  if ((value = getenv("MV2_MPIR")) != NULL) {
+    while (MPIR_debug_gate == 0);
+  }
+
+  /* read PMI server addr */
+  char* server_name = NULL;
+  if ((value = getenv("MV2_PMI_ADDR")) != NULL) {
+    server_name = SPAWN_STRDUP(value);
+  }
+  if (server_name == NULL) {
+    return PMI_CONN_FAILURE;
+  }
+
+  /* create an endpoint */
+  spawn_net_type type = spawn_net_infer_type(server_name);
+  conn_ep = spawn_net_open(type);
+  if (conn_ep == SPAWN_NET_ENDPOINT_NULL) {
+    spawn_free(&server_name);
+    return PMI_CONN_FAILURE;
+  }
+
+  /* connect to server */
+  conn_ch = spawn_net_connect(server_name);
+  if (conn_ch == SPAWN_NET_CHANNEL_NULL) {
+    spawn_net_close(&conn_ep);
+    spawn_free(&server_name);
+    return PMI_CONN_FAILURE;
+  }
+
+  /* send PMI_INIT message to server */
+  strmap* init = strmap_new();
+  strmap_set(init, "MSG", "PMI_INIT");
+  spawn_net_write_strmap(conn_ch, init);
+  strmap_delete(&init);
+
+  /* read parameters from server, we hold on to these
+   * so each user of the connection can look them up */
+  conn_params = strmap_new();
+  spawn_net_read_strmap(conn_ch, conn_params);
+
+  /* free the server name */
+  spawn_free(&server_name);
+
+  /* we now have one reference to the connection */
+  conn_refs = 1;
+  conn_up = 1;
+
+  /* say goodbye to the server if the app exits without
+   * calling PMI_Finalize */
+  if (! conn_atexit) {
+    atexit(pmi_conn_finalize);
+    conn_atexit = 1;
+  }
+
+  return PMI_CONN_SUCCESS;
+}
+
+void pmi_conn_close(void)
+{
+  /* drop our reference, we keep the connection open even after the
+   * last one, since the server only accepts one connection per proc */
+  if (conn_refs > 0) {
+    conn_refs--;
+  }
+
+  return;
+}
+
+void pmi_conn_finalize(void)
+{
+  /* nothing to do if connection is not open */
+  if (! conn_up) {
+    return;
+  }
+
+  /* send PMI_FINALIZE to server */
+  strmap* final = strmap_new();
+  strmap_set(final, "MSG", "PMI_FINALIZE");
+  spawn_net_write_strmap(conn_ch, final);
+  strmap_delete(&final);
+
+  /* disconnect from server */
+  spawn_net_disconnect(&conn_ch);
+
+  /* close down our endpoint */
+  spawn_net_close(&conn_ep);
+
+  /* free parameters from init */
+  strmap_delete(&conn_params);
+
+  conn_refs = 0;
+  conn_up = 0;
+
+  return;
+}
+
+spawn_net_channel* pmi_conn_channel(void)
+{
+  if (! conn_up) {
+    return SPAWN_NET_CHANNEL_NULL;
+  }
+  return conn_ch;
+}
+
+const strmap* pmi_conn_params(void)
+{
+  if (! conn_up) {
+    return NULL;
+  }
+  return conn_params;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* Connection from an application process to its PMI server
+ * (the local spawn process).  The PMI and ring interfaces both
+ * talk to the same server, so rather than have each open its own
+ * endpoint and connection, they share this one.  The connection is
+ * created on first open and the PMI_INIT handshake is executed at
+ * that time.  Each open is paired with a close, but the connection
+ * stays up after the last close, so a later open reuses it rather
+ * than connecting again.  The PMI_FINALIZE message is sent and the
+ * connection torn down by pmi_conn_finalize, which PMI_Finalize
+ * calls, or else when the process exits. */
+
+#ifndef PMI_CONN_H
+#define PMI_CONN_H
+
+#include "spawn.h"
+
+#define PMI_CONN_SUCCESS (0)
+#define PMI_CONN_FAILURE (1)
+
+/* acquire a reference to the connection, connects to the server
+ * and executes PMI_INIT if this is the first reference */
+int pmi_conn_open(void);
+
+/* release a reference to the connection, which stays open */
+void pmi_conn_close(void);
+
+/* sends PMI_FINALIZE and disconnects, if connected */
+void pmi_conn_finalize(void);
+
+/* returns channel to server, or SPAWN_NET_CHANNEL_NULL if the
+ * connection is not open */
+spawn_net_channel* pmi_conn_channel(void);
+
+/* returns map holding the reply the server sent for PMI_INIT
+ * (RANK, RANKS, JOBID, ...), or NULL if the connection is not open */
+const strmap* pmi_conn_params(void);
+
+#endif /* PMI_CONN_H */
@@ -16,7 +16,6 @@
 #include <unistd.h>
 #include <node.h>
 #include <print_errmsg.h>
-#include <hostfile/parser.h>
 
 #include "spawn.h"
 
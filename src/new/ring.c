@@ -10,6 +10,7 @@
 */
 
 #include "ring.h"
+#include "pmi_conn.h"
 #include "spawn.h"
 
 #include <stdio.h>
@@ -108,7 +109,10 @@ int ring_create(
 }
 
 /* simple library that exchanges variable length data
- * among procs to create a ring */
+ * among procs to create a ring, unlike ring_create, this uses the
+ * PMI protocol and shares its connection to the server with the PMI
+ * library, so a process that calls both PMI_Init and ring_create2
+ * only connects once */
 int ring_create2(
   const char* addr,
   uint64_t* rank,
@@ -116,68 +120,29 @@ int ring_create2(
   char** left,
   char** right)
 {
-  char* value;
-
-  /* if being debugged, wait for debugger to attach */
-  if ((value = getenv("MV2_MPIR")) != NULL) {
-    while (MPIR_debug_gate == 0);
-  }
-
   /*********************
    * Open connection
    ********************/
  
-  /* read server addr */
-  char* server_name = NULL;
-  if ((value = getenv("MV2_PMI_ADDR")) != NULL) {
-    server_name = SPAWN_STRDUP(value);
-  }
-  if (server_name == NULL) {
+  /* acquire connection to the server, this connects and
+   * executes PMI_INIT unless someone already did that for us */
+  if (pmi_conn_open() != PMI_CONN_SUCCESS) {
     return RING_FAILURE;
   }
 
-  /* create an endpoint */
-  spawn_net_type type = spawn_net_infer_type(server_name);
-  spawn_net_endpoint* ep = spawn_net_open(type);
-  if (ep == SPAWN_NET_ENDPOINT_NULL) {
-    spawn_free(&server_name);
-    return RING_FAILURE;
-  }
-
-  /* connect to server */
-  spawn_net_channel* ch = spawn_net_connect(server_name);
-  if (ch == SPAWN_NET_CHANNEL_NULL) {
-    spawn_free(&server_name);
-    spawn_net_close(&ep);
-    return RING_FAILURE;
-  }
-
-  /*********************
-   * Send PMI_INIT
-   ********************/
- 
-  /* create PMI_INIT message */
-  strmap* map = strmap_new();
-  strmap_set(map, "MSG", "PMI_INIT");
-
-  /* write init message to server */
-  spawn_net_write_strmap(ch, map);
-
-  /* read init reply from server */
-  spawn_net_read_strmap(ch, map);
+  /* get channel to server */
+  spawn_net_channel* ch = pmi_conn_channel();
 
   /* TODO: get our rank and ranks from reply,
    * this gives us our global rank */
-  //const char* rank_str  = strmap_get(map, "RANK");
-  const char* ranks_str = strmap_get(map, "RANKS");
+  const strmap* params = pmi_conn_params();
+  //const char* rank_str  = strmap_get(params, "RANK");
+  const char* ranks_str = strmap_get(params, "RANKS");
 
   /* set output params */
   //*rank  = atoi(rank_str);
   *ranks = atoi(ranks_str);
 
-  /* delete the init message */
-  strmap_delete(&map);
-
   /*********************
    * Send PMI_RING_IN
    ********************/
@@ -186,7 +151,7 @@ int ring_create2(
    * leftmost and rightmost addresses, and we specify a count of 1,
    * an exclusive scan is executed on count to compute our rank
    * within the ring */
-  map = strmap_new();
+  strmap* map = strmap_new();
   strmap_set(map, "MSG",  "PMI_RING_IN");
   strmap_set(map, "LEFT",  addr);
   strmap_set(map, "RIGHT", addr);
@@ -216,31 +181,12 @@ int ring_create2(
   strmap_delete(&map);
 
   /*********************
-   * Send PMI_FINALIZE
-   ********************/
- 
-  /* create PMI Finalize message */
-  map = strmap_new();
-  strmap_set(map, "MSG", "PMI_FINALIZE");
-
-  /* send strmap to server */
-  spawn_net_write_strmap(ch, map);
-
-  /* delete the strmap */
-  strmap_delete(&map);
-
-  /*********************
-   * Shut down connection
+   * Release connection
    ********************/
  
-  /* disconnect channel */
-  spawn_net_disconnect(&ch);
-
-  /* close endpoint */
-  spawn_net_close(&ep);
-
-  /* free the server name */
-  spawn_free(&server_name);
+  /* drop our reference to the connection, it stays open so PMI_Init
+   * or another ring call can reuse it */
+  pmi_conn_close();
 
   return RING_SUCCESS;
 }
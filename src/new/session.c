@@ -9,6 +9,10 @@
  * Please also read the LICENSE file.
 */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 /*
  * Local headers
  */
@@ -16,7 +20,8 @@
 #include <unistd.h>
 #include <node.h>
 #include <print_errmsg.h>
-#include <hostfile/parser.h>
+#include <timer_util.h>
+#include <hostfile/hostfile.h>
 
 #include "spawn.h"
 
@@ -26,6 +31,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <ctype.h>
 #include <sys/utsname.h>
 #include <limits.h>
 #include <getopt.h>
@@ -36,18 +42,67 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/wait.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
 
 #include <libgen.h>
 
 /* needed to read library list from ELF headers */
 #include "readlibs.h"
 
+/* records and writes launch trace */
+#include "trace.h"
+
+/* serves live launch counters from root */
+#include "status.h"
+
+/* PMI server runs on its own thread and posts events to main thread */
+#include <pthread.h>
+#include "lfqueue.h"
+
+#include "launch_model.h"
+#include "hostlist.h"
+
+/* binds app procs to cpus and numa nodes */
+#include "binding.h"
+
+/* forks app procs from a preloaded template proc */
+#include "zygote.h"
+
+/* serves launcher to avaboot on child hosts */
+#include "boot.h"
+
+/* where libavazygote is installed, set by the build */
+#ifndef AVALAUNCH_LIBDIR
+#define AVALAUNCH_LIBDIR "/usr/local/lib"
+#endif
+
+/* where avaboot is installed, set by the build */
+#ifndef AVALAUNCH_BINDIR
+#define AVALAUNCH_BINDIR "/usr/local/bin"
+#endif
+
 #define KEY_NET_TCP  "tcp"
 #define KEY_NET_IBUD "ibud"
 #define KEY_LOCAL_SHELL  "sh"
 #define KEY_LOCAL_DIRECT "direct"
+#define KEY_SH_FORK "fork"
+#define KEY_COPY_BOOT "boot"
+#define KEY_REMOTE_SHELL  "shell"
+#define KEY_REMOTE_DIRECT "direct"
+
+/* with REMOTE=direct, the only argument of a remote spawn proc, which
+ * names its id and the endpoint of its parent as "<id>,<parent>" */
+#define SPAWN_CHILD_ARG "--spawn-child="
 #define KEY_MPIR_SPAWN "spawn"
 #define KEY_MPIR_APP   "app"
+#define KEY_TREE_KARY    "kary"
+#define KEY_TREE_KNOMIAL "knomial"
+#define KEY_MAP_BLOCK  "block"
+#define KEY_MAP_CYCLIC "cyclic"
+#define KEY_MAP_SOCKET "socket"
+#define KEY_MAP_FILE   "file"
 
 /*******************************
  * MPIR
@@ -119,6 +174,8 @@ MPIR_Breakpoint (void)
 typedef struct spawn_tree_struct {
     int rank;                      /* our global rank (0 to ranks-1) */
     int ranks;                     /* number of nodes in tree */
+    int degree;                    /* max number of children per node */
+    launch_shape shape;            /* k-ary or k-nomial */
     spawn_net_channel* parent_ch;  /* channel to our parent */
     int children;                  /* number of children we have */
     int* child_ranks;              /* global ranks of our children */
@@ -142,6 +199,7 @@ typedef struct session_t {
     spawn_net_endpoint* ep;   /* our endpoint */
     spawn_tree* tree;         /* data structure that tracks tree info */
     strmap* params;           /* spawn parameters sent from parent after connect */
+    strmap* hosts;            /* hostname of each spawn proc in our subtree by rank */
     strmap* name2group;       /* maps a group name to a process group pointer */
     strmap* pid2name;         /* maps a pid to a process group name */
     session_options options;
@@ -155,8 +213,8 @@ typedef struct session_t {
  *
  * PMI_STATE_INIT --> PMI_STATE_NORMAL when client sends PMI_INIT message
  *
- * PMI_STATE_NORMAL --> PMI_STATE_BARRIER when client sends PMI_BARRIER message
- * PMI_STATE_BARRIER --> PMI_STATE_NORMAL when send PMI_BARRIER to client
+ * PMI_STATE_NORMAL --> PMI_STATE_BARRIER when client sends PMI_BARRIER or PMI_FENCE message
+ * PMI_STATE_BARRIER --> PMI_STATE_NORMAL when send PMI_BCAST to client
  *
  * PMI_STATE_NORMAL --> PMI_STATE_RING when client sends PMI_RING_IN message
  * PMI_STATE_RING --> PMI_STATE_NORMAL when send PMI_RING_OUT message to client
@@ -171,6 +229,31 @@ typedef enum pmi_states {
     PMI_STATE_FINAL,
 } pmi_state;
 
+/* The PMI server runs on a dedicated thread from before the app
+ * procs are started until they finalize, and it reports the end of
+ * each PMI phase to the main thread through a lock-free queue in the
+ * process group, so only the main thread touches the phase timers.
+ * The server thread is the only producer and the main thread the
+ * only consumer. */
+typedef struct pmi_event_struct {
+    const char* label;     /* name of the phase that ended */
+    struct timespec begin; /* when the phase began (CLOCK_MONOTONIC_RAW) */
+    struct timespec end;   /* when the phase ended */
+    int done;              /* set on last event, server has left its loop */
+} pmi_event;
+
+/* max number of events that can be pending in the queue before
+ * the server thread has to wait on the main thread */
+#define PMI_EVENT_QUEUE_SIZE (64)
+
+/* policies to assign group ranks to app procs */
+typedef enum pg_map_types {
+    PG_MAP_BLOCK = 0, /* consecutive ranks on the same spawn proc */
+    PG_MAP_CYCLIC,    /* consecutive ranks round-robin across spawn procs */
+    PG_MAP_SOCKET,    /* blocks across spawn procs, round-robin across sockets */
+    PG_MAP_FILE,      /* spawn proc of each rank listed in a map file */
+} pg_map_type;
+
 /* records info about an application process group including
  * paramters used to start the processes, the number of processes
  * started by the owning spawn process and their pids */
@@ -179,28 +262,90 @@ typedef struct process_group_struct {
     strmap* params;  /* parameters specified to start process group */
     uint64_t size;   /* size of process group */
     uint64_t num;    /* number of children procs on the node */
+    int runs;        /* number of runs of spawn procs that start the same number of procs */
+    int* run_node;   /* first spawn proc in each run */
+    int* run_ppn;    /* number of procs each spawn proc in run starts */
+    int nodes;       /* number of spawn procs in layout */
+    uint64_t offset; /* first rank of our block, from a scan over the tree, block and socket maps only */
+    uint64_t* child_first; /* first rank of the block of each child subtree in spawn tree */
+    uint64_t* child_size;  /* number of procs in each child subtree in spawn tree */
+    pg_map_type map; /* how group ranks are assigned to procs */
+    int* rank_node;  /* spawn proc of each group rank, for PG_MAP_FILE only */
+    binding_topo* topo; /* topology of node, read if map or binding needs it */
+    binding_policy bind; /* how procs are bound to cpus */
     pid_t* pids;     /* list of children pids */
     uint64_t* ranks; /* group rank of each child */
+    char* clique;    /* ranks of children as comma-separated string, built on first PMI_INIT */
     spawn_net_channel** chs; /* channels to children */
     strmap* file_map; /* list of files stored in ramdisk */
     uint64_t nconnected; /* hack: record number of connected children, used to assign ids */
 
     /* PMI-specific things */
+    pthread_t pmi_thread; /* thread running PMI server for this group */
+    lfqueue* pmi_events;  /* events posted from PMI server to main thread */
+    spawn_net_channel* pmi_ctl; /* main thread's channel to PMI server */
+    struct timespec pmi_last; /* when the previous PMI phase ended */
     pmi_state* states;   /* records PMI state of each child */
+    uint64_t init_count;     /* number of children that have sent init msg */
     uint64_t barrier_count;  /* number of children that have sent barrier msg */
+    uint64_t barrier_arrived; /* number of app procs in subtree that have entered barrier */
     uint64_t ring_count;     /* number of children that have sent ring input msg */
     uint64_t finalize_count; /* number of children that have sent finalize msg */
-    strmap* commit_map; /* holds keys committed by children but not yet stored in global */
-    strmap* global_map; /* holds committed keys after barrier */
+    strmap* commit_map; /* holds keys committed by children as rank:key until a fence collects them */
+    strmap* global_map; /* holds keys collected by fences as rank:key */
+    strmap* global_index; /* maps each collected key to the last rank that put it */
+    strmap* local_map;  /* holds keys committed by procs on this node as rank:key, used for direct modex */
+    strmap* dmodex_cache; /* holds values fetched by direct modex as rank:key until next fence */
+    strmap* dmodex_map; /* maps rank:key to list of app procs waiting on a remote lookup */
+    int fence_collect;  /* set to 1 if any proc in current fence asked to collect data */
     strmap* ring_map;   /* records data for a ring exchange */
 } process_group;
 
+/* returns 1 if the map places ranks in blocks by spawn proc */
+static int
+pg_map_blocks (const process_group * pg)
+{
+    return (pg->map == PG_MAP_BLOCK || pg->map == PG_MAP_SOCKET);
+}
+
 /* TODO: need to map pid to process group */
 
 static int call_stop_event_handler = 0;
 static int call_node_finalize = 0;
 
-static int copy_launcher = 0; /* set to 1 to copy launcher to /tmp while unfurling tree */
+#define COPY_RCP  (1) /* rcp or scp launcher to children before starting them */
+#define COPY_BOOT (2) /* start avaboot on children and serve it the launcher */
+
+static int copy_launcher = 0; /* set to COPY_RCP or COPY_BOOT to copy launcher to /tmp while unfurling tree */
+
+static int sync_timers = 1; /* set to 0 to skip barriers that only serve to time launch phases */
+
+static int bench_enabled = 0; /* set to 1 to run extra phases that only serve to measure costs */
+
+/* number of (proc, phase) pairs to list from critical path */
+#define TRACE_TOP_CONTRIBUTORS (10)
+
+static int trace_enabled = 0;   /* set to 1 to gather a launch trace at teardown */
+static char* trace_file = NULL; /* root writes launch trace to this file */
+
+static char* status_path = NULL; /* root serves live status on this socket */
+
+/* In virtual cluster mode (SH=fork), "remote" spawn procs are forked
+ * on this host, and we inject delays to emulate the cost of a remote
+ * shell and of moving data over the network between tree nodes */
+static long virt_launch = 0;      /* usecs to stall each remote launch */
+static long virt_latency = 0;     /* usecs to stall each tree message */
+static double virt_bandwidth = 0; /* MB/s of each tree link, 0 for infinite */
+
+static char* spawn_tmpdir = NULL; /* directory where we stage bcast files */
+
+/* launch profile used to tune the tree, and what the bcast of the app
+ * binary cost this launch, which we fold into the profile at the end */
+static char* profile_file = NULL;   /* path of profile, NULL to skip */
+static size_t profile_chunk = 0;    /* tuned bcast chunk size in bytes */
+static double profile_bcast_bytes = 0.0;
+static size_t profile_bcast_chunk = 0;
+static double profile_bcast_usecs = 0.0;
 
 /*******************************
  * Utility routines
@@ -445,6 +590,22 @@ static void environ_merge(strmap* dst, const strmap* src)
     return;
 }
 
+/* return value of variable key in ENV entries of map, or NULL if
+ * it's not set */
+static const char* environ_get(const strmap* map, const char* key)
+{
+    size_t len = strlen(key);
+    int num = environ_num(map);
+    int i;
+    for (i = 0; i < num; i++) {
+        const char* keyval = strmap_getf(map, "ENV%d", i);
+        if (strncmp(keyval, key, len) == 0 && keyval[len] == '=') {
+            return keyval + len + 1;
+        }
+    }
+    return NULL;
+}
+
 /* return number of LIBS in map */
 static int lib_num(strmap* map)
 {
@@ -467,6 +628,8 @@ tree_new (void)
 
     t->rank        = -1;
     t->ranks       = -1;
+    t->degree      = 0;
+    t->shape       = LAUNCH_SHAPE_KARY;
     t->parent_ch   = SPAWN_NET_CHANNEL_NULL;
     t->children    = 0;
     t->child_ranks = NULL;
@@ -528,8 +691,10 @@ tree_create_kary (int rank, int ranks, int k, spawn_tree* t)
     int max_children = k;
 
     /* prepare data structures to store our parent and children */
-    t->rank  = rank;
-    t->ranks = ranks;
+    t->rank   = rank;
+    t->ranks  = ranks;
+    t->degree = k;
+    t->shape  = LAUNCH_SHAPE_KARY;
 
     if (max_children > 0) {
         t->child_ranks = (int*) SPAWN_MALLOC(max_children * sizeof(int));
@@ -588,6 +753,181 @@ tree_create_kary (int rank, int ranks, int k, spawn_tree* t)
     }
 }
 
+/* returns rank of the parent of the given rank in a k-ary tree
+ * built by tree_create_kary, returns -1 for the root */
+static int
+tree_parent_kary (int rank, int k)
+{
+    if (rank <= 0) {
+        return -1;
+    }
+    return (rank - 1) / k;
+}
+
+/* In a k-nomial tree, rank r with span k^v (the largest power of k
+ * dividing r, or the smallest one >= ranks for the root) has children
+ * r + j*k^m for each m < v and 0 < j < k.  The root has more children
+ * than in a k-ary tree, but each proc starts forwarding to its first
+ * child, whose subtree is largest, sooner. */
+static void
+tree_create_knomial (int rank, int ranks, int k, spawn_tree* t)
+{
+    int i;
+
+    /* the root has the most children */
+    int max_children = launch_model_max_children(LAUNCH_SHAPE_KNOMIAL, ranks, k);
+
+    /* prepare data structures to store our parent and children */
+    t->rank   = rank;
+    t->ranks  = ranks;
+    t->degree = k;
+    t->shape  = LAUNCH_SHAPE_KNOMIAL;
+
+    if (max_children > 0) {
+        t->child_ranks = (int*) SPAWN_MALLOC(max_children * sizeof(int));
+        t->child_chs   = (spawn_net_channel**) SPAWN_MALLOC(max_children * sizeof(spawn_net_channel));
+        t->child_hosts = (char**) SPAWN_MALLOC(max_children * sizeof(char*));
+        t->child_pids  = (pid_t*) SPAWN_MALLOC(max_children * sizeof(pid_t));
+    }
+
+    for (i = 0; i < max_children; i++) {
+        t->child_chs[i]   = SPAWN_NET_CHANNEL_NULL;
+        t->child_hosts[i] = NULL;
+        t->child_pids[i]  = -1;
+    }
+
+    /* children are listed largest subtree first */
+    t->children = launch_model_children(LAUNCH_SHAPE_KNOMIAL, rank, ranks, k, t->child_ranks);
+
+    SPAWN_DBG("Rank %d has %d children", t->rank, t->children);
+    for (i = 0; i < t->children; i++) {
+        SPAWN_DBG("Rank %d: Child %d of %d has rank=%d", t->rank, (i + 1), t->children, t->child_ranks[i]);
+    }
+}
+
+/* returns rank of the parent of the given rank in our tree,
+ * returns -1 for the root */
+static int
+tree_parent (const spawn_tree * t, int rank)
+{
+    if (t->shape == LAUNCH_SHAPE_KARY) {
+        return tree_parent_kary(rank, t->degree);
+    }
+    return launch_model_parent(t->shape, rank, t->degree);
+}
+
+/* returns depth of the given rank in our tree, the root is at
+ * depth 0 */
+static int
+tree_depth (const spawn_tree * t, int rank)
+{
+    int depth = 0;
+    while (rank > 0) {
+        rank = tree_parent(t, rank);
+        depth++;
+    }
+    return depth;
+}
+
+/* returns the channel on which to forward a message so that it
+ * travels through the tree toward the given destination rank,
+ * this is one of our children if the destination is in our
+ * subtree and our parent otherwise */
+static spawn_net_channel *
+tree_route (const spawn_tree * t, int dst)
+{
+    /* walk up from destination, since parents always have lower
+     * ranks than their children, we can stop once we pass our rank */
+    int rank = dst;
+    while (rank > t->rank) {
+        int parent = tree_parent(t, rank);
+        if (parent == t->rank) {
+            /* rank is one of our children, look up its channel */
+            int i;
+            for (i = 0; i < t->children; i++) {
+                if (t->child_ranks[i] == rank) {
+                    return t->child_chs[i];
+                }
+            }
+        }
+        rank = parent;
+    }
+
+    /* destination is not in our subtree, send it up */
+    return t->parent_ch;
+}
+
+/* records the hostname of each rank in the subtree rooted at the
+ * given rank from src in dst, a child only needs the hosts of its own
+ * subtree to launch the rest of the tree, ranks and hosts are stored
+ * as compressed lists under RANKS and HOSTS, since hosts are usually
+ * numbered in rank order, this takes a few bytes per tree level */
+static void
+tree_subtree_hosts (const spawn_tree * t, int rank, const strmap * src,
+        strmap * dst)
+{
+    /* walk subtree breadth first, since every rank in the subtree
+     * is added exactly once, the queue never holds more than size */
+    int size = launch_model_subtree_size(t->shape, rank, t->ranks, t->degree);
+    int* queue = (int*) SPAWN_MALLOC(size * sizeof(int));
+    const char** hosts = (const char**) SPAWN_MALLOC(size * sizeof(char*));
+    int head = 0;
+    int tail = 0;
+    queue[tail++] = rank;
+    while (head < tail) {
+        int r = queue[head];
+        hosts[head] = strmap_getf(src, "%d", r);
+        if (hosts[head] == NULL) {
+            SPAWN_ERR("No host for rank %d", r);
+            _exit(EXIT_FAILURE);
+        }
+        head++;
+        tail += launch_model_children(t->shape, r, t->ranks, t->degree, &queue[tail]);
+    }
+
+    char* ranks_str = hostlist_encode_ints(queue, size);
+    char* hosts_str = hostlist_encode(hosts, size);
+    strmap_set(dst, "RANKS", ranks_str);
+    strmap_set(dst, "HOSTS", hosts_str);
+    spawn_free(&hosts_str);
+    spawn_free(&ranks_str);
+
+    spawn_free(&hosts);
+    spawn_free(&queue);
+}
+
+/* expands RANKS and HOSTS lists written by tree_subtree_hosts in src
+ * into a rank=host entry per rank in dst, returns 0 on success */
+static int
+tree_hosts_expand (const strmap * src, strmap * dst)
+{
+    const char* ranks_str = strmap_get(src, "RANKS");
+    const char* hosts_str = strmap_get(src, "HOSTS");
+    if (ranks_str == NULL || hosts_str == NULL) {
+        return 1;
+    }
+
+    int num_ranks, num_hosts;
+    int* ranks = hostlist_expand_ints(ranks_str, &num_ranks);
+    char** hosts = hostlist_expand(hosts_str, &num_hosts);
+
+    int rc = 0;
+    if (num_ranks > 0 && num_ranks == num_hosts) {
+        int i;
+        for (i = 0; i < num_ranks; i++) {
+            strmap_setf(dst, "%d=%s", ranks[i], hosts[i]);
+        }
+    } else {
+        SPAWN_ERR("Host list has %d hosts for %d ranks", num_hosts, num_ranks);
+        rc = 1;
+    }
+
+    hostlist_free(&hosts, num_hosts);
+    spawn_free(&ranks);
+
+    return rc;
+}
+
 /*******************************
  * Routines to fork/exec procs
  ******************************/
@@ -648,19 +988,199 @@ serialize_to_str (const strmap * map, const char * key_count,
     return str;
 }
 
-/* given a remote host, exec rsh or ssh of specified exe in named
+/* sleep for given number of nsecs */
+static void
+virt_sleep (uint64_t nsecs)
+{
+    struct timespec ts;
+    ts.tv_sec  = (time_t) (nsecs / 1000000000ULL);
+    ts.tv_nsec = (long)   (nsecs % 1000000000ULL);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+    return;
+}
+
+/* in virtual cluster mode, stall the sender of a tree message for
+ * the time it would take to move the given number of bytes over a
+ * link with the configured latency and bandwidth, we charge it all
+ * to the sender, which serializes a parent's sends to its children
+ * as a single NIC would */
+static void
+virt_link_delay (size_t bytes)
+{
+    if (virt_latency == 0 && virt_bandwidth == 0) {
+        return;
+    }
+
+    /* 1 MB/s moves 1 byte per usec */
+    uint64_t nsecs = (uint64_t) virt_latency * 1000;
+    if (virt_bandwidth > 0) {
+        nsecs += (uint64_t) ((double) bytes / virt_bandwidth * 1000.0);
+    }
+    virt_sleep(nsecs);
+
+    return;
+}
+
+/* like virt_link_delay for a message made up of one or two strmaps,
+ * we only compute their size if we need it */
+static void
+virt_strmap_delay (const strmap * a, const strmap * b)
+{
+    if (virt_latency == 0 && virt_bandwidth == 0) {
+        return;
+    }
+
+    size_t bytes = strmap_pack_size(a);
+    if (b != NULL) {
+        bytes += strmap_pack_size(b);
+    }
+    virt_link_delay(bytes);
+
+    return;
+}
+
+/* Procs are started with vfork, so the child borrows our memory until
+ * it execs rather than copying our page tables as fork does, and the
+ * cost of a launch doesn't grow with the size of the launcher.  The
+ * child may only make system calls before the exec, so it changes
+ * directory and applies its binding with syscalls, and it leaves the
+ * errno of a failed call in our stack frame for us to report.  Stdio
+ * is inherited as it was with fork.  Where configure finds no working
+ * vfork, config.h defines vfork to be fork. */
+
+/* start path with argv and envp in directory cwd bound to bind,
+ * envp and cwd may be NULL to use ours, bind may be NULL to leave
+ * proc unbound, returns pid of child or -1 on error */
+static pid_t
+spawn_cmd (const char * path, char * const argv[], char * const envp[],
+        const char * cwd, const binding * bind)
+{
+    if (envp == NULL) {
+        envp = environ;
+    }
+
+    /* written by child, which runs in our memory until it execs */
+    volatile int chdir_errno = 0;
+    volatile int bind_errno  = 0;
+    volatile int exec_errno  = 0;
+
+    pid_t pid = vfork();
+    if (pid == -1) {
+        SPAWN_ERR("create_process (vfork() errno=%d %s)", errno, strerror(errno));
+        return -1;
+    }
+
+    if (pid == 0) {
+        /* change to specified working directory (exec'd process will
+         * inherit this) */
+        if (cwd != NULL && chdir(cwd) != 0) {
+            chdir_errno = errno;
+            _exit(EXIT_FAILURE);
+        }
+
+        /* bind before exec, an unbound proc still runs */
+        if (bind != NULL) {
+            bind_errno = binding_apply(bind);
+        }
+
+        /* exec process, we only return on error */
+        execve(path, argv, envp);
+        exec_errno = errno;
+        _exit(EXIT_FAILURE);
+    }
+
+    /* child has exec'd or exited by now, the SIGCHLD handler reaps
+     * one that failed */
+    if (bind_errno != 0) {
+        SPAWN_ERR("Failed to bind `%s' (errno=%d %s)", path,
+            bind_errno, strerror(bind_errno));
+    }
+    if (chdir_errno != 0) {
+        SPAWN_ERR("Failed to change directory to `%s' (errno=%d %s)", cwd,
+            chdir_errno, strerror(chdir_errno));
+        return -1;
+    }
+    if (exec_errno != 0) {
+        SPAWN_ERR("Failed to exec program `%s' (execve errno=%d %s)", path,
+            exec_errno, strerror(exec_errno));
+        return -1;
+    }
+    return pid;
+}
+
+/* run specified exe on this host in place of a remote shell, used to
+ * emulate a cluster on a single node, we add env variables to our
+ * own environment rather than replacing it, since that's closer to
+ * what a process started by rsh would see.  The child sleeps to emulate
+ * the remote shell before it execs, so this always forks. */
+static pid_t
+launch_fork (const strmap * params, const char * cwd, const char * exe,
+        const strmap * argmap, const strmap * envmap)
+{
+    int i;
+
+    pid_t cpid = fork();
+    if (cpid == -1) {
+        SPAWN_ERR("create_process (fork() errno=%d %s)", errno, strerror(errno));
+        return cpid;
+    } else if (cpid > 0) {
+        return cpid;
+    }
+
+    /* emulate the time it takes the remote shell to start the proc */
+    if (virt_launch > 0) {
+        virt_sleep((uint64_t) virt_launch * 1000);
+    }
+
+    /* change to specified working directory */
+    if (chdir(cwd) != 0) {
+        SPAWN_ERR("Failed to change directory to `%s' (errno=%d %s)", cwd, errno, strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+
+    /* add env variables to our environment, putenv keeps a pointer
+     * to the string, but we're about to exec anyway */
+    int envs = environ_num(envmap);
+    for (i = 0; i < envs; i++) {
+        const char* env = strmap_getf(envmap, "ENV%d", i);
+        putenv(SPAWN_STRDUP(env));
+    }
+
+    /* allocate memory for argv array (one extra for terminating NULL) */
+    int args = args_num(argmap);
+    char** argv = (char**) SPAWN_MALLOC((args + 1) * sizeof(char*));
+    for (i = 0; i < args; i++) {
+        argv[i] = strmap_getf(argmap, "ARG%d", i);
+    }
+    argv[args] = (char*) NULL;
+
+    /* exec process, we only return on error */
+    execv(exe, argv);
+    SPAWN_ERR("Failed to exec program (execv errno=%d %s)", errno, strerror(errno));
+    _exit(EXIT_FAILURE);
+}
+
+/* given a remote host, start rsh or ssh of specified exe in named
  * current working directory, using provided arguments and env
  * variables.  The shell type is selected by the SH key, which
- * in turn is set via the MV2_SPAWN_SH variable. */
-static int
-exec_remote (const char * host, const strmap * params, const char * cwd,
+ * in turn is set via the MV2_SPAWN_SH variable.  With SH=fork,
+ * the proc is started on this host instead.  With REMOTE=direct,
+ * the remote command is just exe and its arguments, without the cd
+ * and env wrapper. */
+static pid_t
+launch_remote (const char * host, const strmap * params, const char * cwd,
         const char * exe, const strmap * argmap, const strmap * envmap)
 {
     /* get name of remote shell */
     const char* shname = strmap_get(params, "SH");
     if (shname == NULL) {
         SPAWN_ERR("Failed to read name of remote shell from SH key");
-        return 1;
+        return -1;
+    }
+
+    /* in virtual cluster mode, skip the remote shell */
+    if (strcmp(shname, KEY_SH_FORK) == 0) {
+        return launch_fork(params, cwd, exe, argmap, envmap);
     }
 
     /* determine whether to use rsh or ssh */
@@ -668,7 +1188,7 @@ exec_remote (const char * host, const strmap * params, const char * cwd,
         strcmp(shname, "ssh") != 0)
     {
         SPAWN_ERR("Unknown launch remote shell: `%s'", shname);
-        return 1;
+        return -1;
     }
 
     /* lookup paths to env and remote sh commands from params */
@@ -676,11 +1196,22 @@ exec_remote (const char * host, const strmap * params, const char * cwd,
     const char* shpath  = strmap_get(params, shname);
     if (envpath == NULL) {
         SPAWN_ERR("Path to env command not set");
-        return 1;
+        return -1;
     }
     if (shpath == NULL) {
         SPAWN_ERR("Path to sh command not set");
-        return 1;
+        return -1;
+    }
+
+    /* in direct mode, the caller packs everything the proc needs to
+     * connect back into its arguments, so skip cd and env */
+    const char* remote = strmap_get(params, "REMOTE");
+    if (remote != NULL && strcmp(remote, KEY_REMOTE_DIRECT) == 0) {
+        char* argstr = serialize_to_str(argmap, "ARGS", "ARG");
+        char* argv[] = { (char*) shname, (char*) host, argstr, NULL };
+        pid_t pid = spawn_cmd(shpath, argv, NULL, NULL, NULL);
+        spawn_free(&argstr);
+        return pid;
     }
 
     /* create strings for environment variables and arguments */
@@ -691,34 +1222,32 @@ exec_remote (const char * host, const strmap * params, const char * cwd,
     char* app_command = SPAWN_STRDUPF("cd %s && %s %s %s",
         cwd, envpath, envstr, argstr);
 
-    /* exec process, we only return on error */
-    execl(shpath, shname, host, app_command, (char*)0);
-    SPAWN_ERR("Failed to exec program (execl errno=%d %s)", errno, strerror(errno));
+    char* argv[] = { (char*) shname, (char*) host, app_command, NULL };
+    pid_t pid = spawn_cmd(shpath, argv, NULL, NULL, NULL);
 
-    /* clean up in case we do happen to fall through */
     spawn_free(&app_command);
     spawn_free(&argstr);
     spawn_free(&envstr);
 
-    return 1;
+    return pid;
 }
 
-/* exec sh shell to run specified exe in named current working
+/* start sh shell to run specified exe in named current working
  * directory, using provided arguments and env variables */
-static int
-exec_shell (const strmap * params, const char * cwd, const char * exe,
-        const strmap * argmap, const strmap * envmap)
+static pid_t
+launch_shell (const strmap * params, const char * cwd, const char * exe,
+        const strmap * argmap, const strmap * envmap, const binding * bind)
 {
     /* lookup paths to env and sh commands from params */
     const char* envpath = strmap_get(params, "env");
     const char* shpath  = strmap_get(params, "sh");
     if (envpath == NULL) {
         SPAWN_ERR("Path to env command not set");
-        return 1;
+        return -1;
     }
     if (shpath == NULL) {
         SPAWN_ERR("Path to sh command not set");
-        return 1;
+        return -1;
     }
 
     /* create strings for environment variables and arguments */
@@ -729,37 +1258,26 @@ exec_shell (const strmap * params, const char * cwd, const char * exe,
     char* app_command = SPAWN_STRDUPF("cd %s && %s %s %s",
         cwd, envpath, envstr, argstr);
 
-    /* exec process, we only return on error */
-    execl(shpath, "sh", "-c", app_command, (char*)0);
-    SPAWN_ERR("Failed to exec program (execl errno=%d %s)", errno, strerror(errno));
+    char* argv[] = { "sh", "-c", app_command, NULL };
+    pid_t pid = spawn_cmd(shpath, argv, NULL, NULL, bind);
 
-    /* clean up in case we do happen to fall through */
     spawn_free(&app_command);
     spawn_free(&argstr);
     spawn_free(&envstr);
 
-    return 1;
+    return pid;
 }
 
-/* directly exec specified exe in named current working
+/* directly start specified exe in named current working
  * directory, using provided arguments and env variables */
-static int
-exec_direct (const strmap * params, const char * cwd, const char * exe,
-    const strmap * argmap, const strmap * envmap)
+static pid_t
+launch_direct (const strmap * params, const char * cwd, const char * exe,
+    const strmap * argmap, const strmap * envmap, const binding * bind)
 {
     int i;
 
     /* TODO: setup stdin and friends */
 
-    /* TODO: copy environment from current process? */
-
-    /* change to specified working directory (exec'd process will
-     * inherit this) */
-    if (chdir(cwd) != 0) {
-        SPAWN_ERR("Failed to change directory to `%s' (errno=%d %s)", cwd, errno, strerror(errno));
-        return 1;
-    }
-
     /* determine number of arguments */
     int args = args_num(argmap);
 
@@ -784,120 +1302,113 @@ exec_direct (const strmap * params, const char * cwd, const char * exe,
     }
     envp[envs] = (char*) NULL;
 
-    /* exec process, we only return on error */
-    execve(exe, argv, envp);
-    SPAWN_ERR("Failed to exec program (execve errno=%d %s)", errno, strerror(errno));
+    pid_t pid = spawn_cmd(exe, argv, envp, cwd, bind);
 
-    /* clean up in case we do happen to fall through */
     spawn_free(&envp);
     spawn_free(&argv);
 
-    return 1;
+    return pid;
 }
 
-/* fork process, child execs specified command */
+/* start process running specified command, on host if it's not NULL,
+ * bound to bind if it's not NULL */
 static pid_t
-fork_proc (const char * host, const strmap * params, const char * cwd,
-    const char * exe, const strmap * argmap, const strmap * envmap)
+launch_proc (const char * host, const strmap * params, const char * cwd,
+    const char * exe, const strmap * argmap, const strmap * envmap,
+    const binding * bind)
 {
-#if 0
-    int pipe_stdin[2], pipe_stdout[2], pipe_stderr[2];
+    /* TODO: execlp searches the user's path looking for the launch command,
+     * so this could create a bunch of traffic on the file system if there
+     * are lots of extra entries in user's path */
+    if (host != NULL) {
+        return launch_remote(host, params, cwd, exe, argmap, envmap);
+    }
 
-    if (-1 == pipe(pipe_stdin)) {
-        print_errmsg("create_process (pipe)", errno);
+    /* local launch, use sh or just direct launch */
+    const char* local = strmap_get(params, "LOCAL");
+    if (local == NULL) {
+        SPAWN_ERR("Failed to read LOCAL key");
         return -1;
     }
+    if (strcmp(local, KEY_LOCAL_SHELL) == 0) {
+        return launch_shell(params, cwd, exe, argmap, envmap, bind);
+    } else if (strcmp(local, KEY_LOCAL_DIRECT) == 0) {
+        return launch_direct(params, cwd, exe, argmap, envmap, bind);
+    }
+    SPAWN_ERR("Unknown LOCAL key value `%s'", local);
+    return -1;
+}
 
-    if (-1 == pipe(pipe_stdout)) {
-        print_errmsg("create_process (pipe)", errno);
+/* start app exe as a zygote with lib preloaded, see zygote.h, params
+ * holds the global env vars of the app, returns our end of the socket
+ * to the zygote once it is ready, or -1 on error */
+static int
+zygote_start (const session * s, const strmap * params, const char * lib,
+    const char * cwd, const char * exe, const strmap * argmap)
+{
+    /* ranks outlive the zygote, so have them reparented to us rather
+     * than init when it exits */
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1) != 0) {
+        SPAWN_ERR("Failed to become child subreaper (prctl errno=%d %s)",
+            errno, strerror(errno));
         return -1;
     }
 
-    if (-1 == pipe(pipe_stderr)) {
-        print_errmsg("create_process (pipe)", errno);
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        SPAWN_ERR("Failed to create zygote socket (socketpair errno=%d %s)",
+            errno, strerror(errno));
         return -1;
     }
-#endif
+    fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+
+    /* preload zygote ahead of any libraries the user preloads, and
+     * bind all symbols up front so ranks inherit the relocations */
+    strmap* envmap = strmap_new();
+    int envs = 0;
+    strmap_setf(envmap, "ENV%d=%s=%d", envs, ZYGOTE_FD_ENV, sv[1]);
+    envs++;
+    strmap_setf(envmap, "ENV%d=LD_BIND_NOW=1", envs);
+    envs++;
+    const char* preload = environ_get(params, "LD_PRELOAD");
+    if (preload != NULL) {
+        strmap_setf(envmap, "ENV%d=LD_PRELOAD=%s:%s", envs, lib, preload);
+        envs++;
+        strmap_setf(envmap, "ENV%d=%s=%s", envs, ZYGOTE_PRELOAD_ENV, preload);
+        envs++;
+    } else {
+        strmap_setf(envmap, "ENV%d=LD_PRELOAD=%s", envs, lib);
+        envs++;
+    }
+    strmap_setf(envmap, "ENVS=%d", envs);
+    environ_merge(envmap, params);
 
-    pid_t cpid = fork();
+    /* exec directly even with LOCAL=sh, so pid is the template
+     * itself and we can kill it if it never gets ready */
+    pid_t pid = launch_direct(s->params, cwd, exe, argmap, envmap, NULL);
+    strmap_delete(&envmap);
+    close(sv[1]);
 
-    if (cpid == -1) {
-        /* fork failed */
-        SPAWN_ERR("create_process (fork() errno=%d %s)", errno, strerror(errno));
-        return cpid;
+    if (pid < 0) {
+        close(sv[0]);
+        return -1;
     }
 
-    else if (cpid == 0) {
-        /* fork succeeded, I'm child */
-
-#if 0
-        dup2(pipe_stdin[0], STDIN_FILENO);
-        dup2(pipe_stdout[1], STDOUT_FILENO);
-        dup2(pipe_stderr[1], STDERR_FILENO);
+    /* without the ready message the template is running main as an
+     * extra rank, or died, so get rid of it */
+    if (zygote_wait_ready(sv[0], ZYGOTE_READY_MSECS) != 0) {
+        SPAWN_ERR("Zygote `%s' did not start, exec'ing each rank instead", exe);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(sv[0]);
+        return -1;
+    }
+    return sv[0];
+}
 
-        close(pipe_stdin[1]);
-        close(pipe_stdout[0]);
-        close(pipe_stderr[0]);
-#endif
-
-        /* TODO: execlp searches the user's path looking for the launch command,
-         * so this could create a bunch of traffic on the file system if there
-         * are lots of extra entries in user's path */
-        if (host == NULL) {
-            /* local launch, use sh or just direct launch */
-            const char* local = strmap_get(params, "LOCAL");
-            if (local == NULL) {
-                SPAWN_ERR("Failed to read LOCAL key");
-            } else {
-                if (strcmp(local, KEY_LOCAL_SHELL) == 0) {
-                    exec_shell(params, cwd, exe, argmap, envmap);
-                } else if (strcmp(local, KEY_LOCAL_DIRECT) == 0) {
-                    exec_direct(params, cwd, exe, argmap, envmap);
-                } else {
-                    SPAWN_ERR("Unknown LOCAL key value `%s'", local);
-                }
-            }
-        } else {
-            exec_remote(host, params, cwd, exe, argmap, envmap);
-        }
-
-        /* failed to exec, exit with failure code */
-        SPAWN_ERR("create_child (execlp errno=%d %s)", errno, strerror(errno));
-        _exit(EXIT_FAILURE);
-    }
-
-    else {
-        /* fork succeeded, I'm parent */
-
-#if 0
-        //struct pollfds_param stdin_param, stdout_param, stderr_param;
-        //
-        stdin_param.fd = pipe_stdin[1];
-        stdout_param.fd = pipe_stdout[0];
-        stderr_param.fd = pipe_stderr[0];
-
-        stdin_param.fd_handler = stdin_handler;
-        stdout_param.fd_handler = stdout_handler;
-        stderr_param.fd_handler = stderr_handler;
-
-        fcntl(stdin_param.fd, F_SETFL, O_NONBLOCK);
-        fcntl(stdout_param.fd, F_SETFL, O_NONBLOCK);
-        fcntl(stderr_param.fd, F_SETFL, O_NONBLOCK);
-
-        close(pipe_stdin[0]);
-        close(pipe_stdout[1]);
-        close(pipe_stderr[1]);
-
-        pollfds_add(id, stdin_param, stdout_param, stderr_param);
-#endif
-    }
-
-    return cpid;
-}
-
-/*******************************
- * Routines to remote copy launcher executable
- ******************************/
+/*******************************
+ * Routines to remote copy launcher executable
+ ******************************/
 
 /* return number of files in file map */
 static int pg_files_num(const process_group* pg)
@@ -1116,64 +1627,47 @@ copy_to_tmp (const char* dir, const char * src)
     return dst;
 }
 
-/* fork process, child executes remote copy of file from local host to remote host */
+/* start process to execute remote copy of file from local host to
+ * remote host, returns pid so caller can wait on it, or -1 on error */
 static pid_t
 copy_exe (const strmap * params, const char * host, const char * exepath)
 {
-    pid_t cpid = fork();
-
-    if (cpid == -1) {
-        SPAWN_ERR("create_process (fork() errno=%d %s)", errno, strerror(errno));
+    /* we switch off SH=ssh/rsh to use scp/rcp */
+    /* get name of remote shell */
+    const char* shname = strmap_get(params, "SH");
+    if (shname == NULL) {
+        SPAWN_ERR("Failed to read name of remote shell from SH key");
         return -1;
-    } else if (cpid == 0) {
-        /* we switch off SH=ssh/rsh to use scp/rcp */
-        /* get name of remote shell */
-        const char* shname = strmap_get(params, "SH");
-        if (shname == NULL) {
-            SPAWN_ERR("Failed to read name of remote shell from SH key");
-            _exit(EXIT_FAILURE);
-        }
-
-        /* determine whether to use rsh or ssh */
-        if (strcmp(shname, "rsh") != 0 &&
-            strcmp(shname, "ssh") != 0)
-        {
-            SPAWN_ERR("Unknown remote shell: `%s'", shname);
-            _exit(EXIT_FAILURE);
-        }
+    }
 
-        const char scp_key[] = "scp";
-        const char rcp_key[] = "rcp";
-        const char* key;
-        if (strcmp(shname, "rsh") == 0) {
-            key = rcp_key;
-        } else if (strcmp(shname, "ssh") == 0) {
-            key = scp_key;
-        } else {
-            SPAWN_ERR("Unknown remote shell: `%s'", shname);
-            _exit(EXIT_FAILURE);
-        }
+    const char scp_key[] = "scp";
+    const char rcp_key[] = "rcp";
+    const char* key;
+    if (strcmp(shname, "rsh") == 0) {
+        key = rcp_key;
+    } else if (strcmp(shname, "ssh") == 0) {
+        key = scp_key;
+    } else {
+        SPAWN_ERR("Unknown remote shell: `%s'", shname);
+        return -1;
+    }
 
-        /* get path of remote copy command */
-        const char* shpath = strmap_get(params, key);
-        if (shpath == NULL) {
-            SPAWN_ERR("Path to remote copy command not set");
-            _exit(EXIT_FAILURE);
-        }
+    /* get path of remote copy command */
+    const char* shpath = strmap_get(params, key);
+    if (shpath == NULL) {
+        SPAWN_ERR("Path to remote copy command not set");
+        return -1;
+    }
 
+    /* build destination file name */
+    char* dstpath = SPAWN_STRDUPF("%s:%s", host, exepath);
 
-        /* build destination file name */
-        const char* dstpath = SPAWN_STRDUPF("%s:%s", host, exepath);
+    char* argv[] = { (char*) shpath, (char*) exepath, dstpath, NULL };
+    pid_t pid = spawn_cmd(shpath, argv, NULL, NULL, NULL);
 
-        /* exec process, we only return on error */
-        execl(shpath, shpath, exepath, dstpath, (char*)0);
-        SPAWN_ERR("Failed to exec program (execl errno=%d %s)", errno, strerror(errno));
-        _exit(EXIT_FAILURE);
-    }
+    spawn_free(&dstpath);
 
-    /* return pid to parent so it can wait on us to ensure
-     * copy is complete */
-    return cpid;
+    return pid;
 }
 
 /*******************************
@@ -1209,6 +1703,7 @@ signal_to_root (const session * s)
 
     /* forward signal to parent */
     if (t->parent_ch != SPAWN_NET_CHANNEL_NULL) {
+        virt_link_delay(sizeof(char));
         spawn_net_write(t->parent_ch, &signal, sizeof(char));
     }
 
@@ -1234,12 +1729,83 @@ signal_from_root (const session * s)
     int i;
     for (i = 0; i < children; i++) {
         spawn_net_channel* ch = t->child_chs[i];
+        virt_link_delay(sizeof(char));
         spawn_net_write(ch, &signal, sizeof(char));
     }
 
     return;
 }
 
+/* barrier used only to measure a launch phase from the root, in
+ * production mode (SYNC=0) phases pipeline freely through the tree
+ * and we skip the barrier */
+static void
+sync_to_root (const session * s)
+{
+    if (sync_timers) {
+        signal_to_root(s);
+    }
+    return;
+}
+
+/* barrier used only to measure a launch phase from the root,
+ * see sync_to_root */
+static void
+sync_from_root (const session * s)
+{
+    if (sync_timers) {
+        signal_from_root(s);
+    }
+    return;
+}
+
+/* on the root, given a map whose keys are the ranks of spawn procs
+ * known to be up, update the status counts for each tree level up to
+ * depth.  While the tree unfurls, the root only hears from its own
+ * children, so it passes a depth of 1 and deeper levels stay out of
+ * the status until the spawn pid gather brings in every spawn proc,
+ * rather than showing as down */
+static void
+status_tree_levels (const spawn_tree * t, const strmap * up, int depth)
+{
+    /* nothing to do if we're not serving status */
+    if (status_path == NULL) {
+        return;
+    }
+
+    uint64_t ups[STATUS_MAX_LEVELS];
+    uint64_t totals[STATUS_MAX_LEVELS];
+    memset(ups,    0, sizeof(ups));
+    memset(totals, 0, sizeof(totals));
+
+    /* count procs up and expected at each level */
+    int i;
+    uint64_t count = 0;
+    for (i = 0; i < t->ranks; i++) {
+        int level = tree_depth(t, i);
+        if (level > depth) {
+            continue;
+        }
+        if (level >= STATUS_MAX_LEVELS) {
+            level = STATUS_MAX_LEVELS - 1;
+        }
+        totals[level]++;
+        if (strmap_getf((strmap*) up, "%d", i) != NULL) {
+            ups[level]++;
+            count++;
+        }
+    }
+
+    for (i = 0; i < STATUS_MAX_LEVELS; i++) {
+        if (totals[i] > 0) {
+            status_level(i, ups[i], totals[i]);
+        }
+    }
+    status_set(STATUS_SPAWN_UP, count);
+
+    return;
+}
+
 /* a type of reduction in which each spawn process adds its time to
  * the max time of all of its children and sends the sum to its parent,
  * an array of input values are provided along with labels to print
@@ -1297,6 +1863,337 @@ print_critical_path (const session * s, int count, uint64_t * vals,
     return;
 }
 
+/* returns key naming a delta by its label and the number of times
+ * that label was recorded before it, e.g., "pmi fence#2", so the same
+ * phase lines up across procs, counts tracks occurrences of each
+ * label, caller should free key with spawn_free */
+static char *
+delta_key (strmap * counts, int id)
+{
+    const char* label = delta_label(id);
+
+    int n = 0;
+    const char* n_str = strmap_get(counts, label);
+    if (n_str != NULL) {
+        n = atoi(n_str);
+    }
+    strmap_setf(counts, "%s=%d", label, n + 1);
+
+    char* key = SPAWN_STRDUPF("%s#%d", label, n);
+    return key;
+}
+
+/* each spawn proc times its own launch phases, so we reduce each
+ * phase to its min, mean, max, and percentiles across the tree along
+ * with the node that took the longest, and record that on the root
+ * for print_deltas, we carry the resource usage of each phase along
+ * under a second key, this costs a single pass up the tree after
+ * everything else is done */
+static void
+reduce_deltas (const session * s)
+{
+    spawn_tree* t = s->tree;
+    int children = t->children;
+
+    /* record our time for each delta that has completed */
+    strmap* counts = strmap_new();
+    strmap* map = strmap_new();
+    int num = num_deltas();
+    int id;
+    for (id = 0; id < num; id++) {
+        char* key = delta_key(counts, id);
+        const struct timespec* end = delta_end(id);
+        if (end->tv_sec != 0 || end->tv_nsec != 0) {
+            char* val = delta_stats_encode(delta_nsecs(id), t->rank);
+            strmap_set(map, key, val);
+            free(val);
+
+            char* usage = delta_usage_encode(id);
+            if (usage != NULL) {
+                strmap_setf(map, "%s@usage=%s", key, usage);
+                free(usage);
+            }
+        }
+        spawn_free(&key);
+    }
+    strmap_delete(&counts);
+
+    /* merge in values from each child */
+    int i;
+    for (i = 0; i < children; i++) {
+        strmap* child_map = strmap_new();
+        spawn_net_read_strmap(t->child_chs[i], child_map);
+
+        strmap_node* node;
+        for (node = strmap_node_first(child_map);
+             node != NULL;
+             node = strmap_node_next(node))
+        {
+            const char* key = strmap_node_key(node);
+            const char* val = strmap_node_value(node);
+
+            /* keys ending with @usage hold resource usage */
+            int is_usage = 0;
+            size_t keylen = strlen(key);
+            if (keylen > 6 && strcmp(key + keylen - 6, "@usage") == 0) {
+                is_usage = 1;
+            }
+
+            const char* ours = strmap_get(map, key);
+            if (ours == NULL) {
+                strmap_set(map, key, val);
+            } else {
+                char* merged;
+                if (is_usage) {
+                    merged = delta_usage_merge(ours, val);
+                } else {
+                    merged = delta_stats_merge(ours, val);
+                }
+                strmap_set(map, key, merged);
+                free(merged);
+            }
+        }
+
+        strmap_delete(&child_map);
+    }
+
+    /* forward to parent, or record results if we're the root */
+    if (t->parent_ch != SPAWN_NET_CHANNEL_NULL) {
+        spawn_net_write_strmap(t->parent_ch, map);
+    } else {
+        counts = strmap_new();
+        for (id = 0; id < num; id++) {
+            char* key = delta_key(counts, id);
+            const char* val = strmap_get(map, key);
+            if (val != NULL) {
+                delta_stats stats;
+                delta_stats_decode(val, &stats);
+                set_delta_stats(id, &stats);
+            }
+            const char* usage = strmap_getf(map, "%s@usage", key);
+            if (usage != NULL) {
+                set_delta_usage(id, usage);
+            }
+            spawn_free(&key);
+        }
+        strmap_delete(&counts);
+    }
+
+    strmap_delete(&map);
+
+    return;
+}
+
+/*******************************
+ * Launch profile
+ ******************************/
+
+/* The root records what each launch cost in a profile kept per
+ * machine and per job size, and the next launch of a similar size
+ * reads it back to pick the tree shape, degree, and bcast chunk size
+ * that launch_model predicts to be fastest.  Machines are named by
+ * hostname with any domain and trailing node number stripped, and
+ * job sizes are grouped by power of two. */
+
+/* returns path of profile for a job of given number of hosts,
+ * caller should free path with spawn_free */
+static char *
+profile_path (int hosts, int virt)
+{
+    const char* value = getenv("MV2_SPAWN_PROFILE");
+    if (value != NULL) {
+        return SPAWN_STRDUP(value);
+    }
+
+    const char* home = getenv("HOME");
+    if (home == NULL) {
+        return NULL;
+    }
+
+    /* strip domain and node number from our hostname */
+    char* machine = spawn_hostname();
+    char* dot = strchr(machine, '.');
+    if (dot != NULL) {
+        *dot = '\0';
+    }
+    size_t len = strlen(machine);
+    while (len > 1 && isdigit((unsigned char) machine[len - 1])) {
+        len--;
+    }
+    machine[len] = '\0';
+
+    /* round number of hosts up to a power of two */
+    int bucket = 1;
+    while (bucket < hosts) {
+        bucket *= 2;
+    }
+
+    char* dir = SPAWN_STRDUPF("%s/.avalaunch", home);
+    if (mkdir(dir, S_IRWXU) != 0 && errno != EEXIST) {
+        SPAWN_DBG("Failed to create directory: `%s' (%s)", dir, strerror(errno));
+    }
+
+    /* virtual clusters cost nothing like real ones */
+    char* path = SPAWN_STRDUPF("%s/%s%s.%d", dir, machine,
+        virt ? "-virt" : "", bucket);
+
+    spawn_free(&dir);
+    spawn_free(&machine);
+
+    return path;
+}
+
+/* read profile and fill in choice of tree and chunk size for hosts,
+ * returns 1 if we have a profile, 0 otherwise */
+static int
+profile_recommend (const session * s, int hosts,
+        launch_model_choice * choice)
+{
+    if (profile_file == NULL || access(profile_file, R_OK) != 0) {
+        return 0;
+    }
+
+    launch_model_params p;
+    launch_model_defaults(&p);
+    if (launch_model_read(profile_file, &p) != 0) {
+        return 0;
+    }
+
+    /* only weigh the bcast if we'll bcast the app binary */
+    size_t bytes = 0;
+    const char* value = getenv("MV2_SPAWN_BCAST_BIN");
+    const char* exename = strmap_get(s->appmap, "EXENAME");
+    if (value != NULL && atoi(value) != 0 && exename != NULL) {
+        char* path = spawn_path_search(exename);
+        struct stat statbuf;
+        if (path != NULL && stat(path, &statbuf) == 0) {
+            bytes = (size_t) statbuf.st_size;
+        }
+        spawn_free(&path);
+    }
+
+    launch_model_recommend(&p, hosts, bytes, choice);
+
+    return 1;
+}
+
+/* returns usecs of first completed delta with given label, 0 if none */
+static double
+profile_delta_usecs (const char * label)
+{
+    int num = num_deltas();
+    int id;
+    for (id = 0; id < num; id++) {
+        const struct timespec* end = delta_end(id);
+        if ((end->tv_sec != 0 || end->tv_nsec != 0) &&
+            strcmp(delta_label(id), label) == 0)
+        {
+            return (double) delta_nsecs(id) / 1000.0;
+        }
+    }
+    return 0.0;
+}
+
+/* fold costs measured by this launch into the profile, called on the
+ * root after all deltas have been recorded */
+static void
+profile_update (const session * s)
+{
+    const spawn_tree* t = s->tree;
+    if (profile_file == NULL || t->children == 0) {
+        return;
+    }
+
+    launch_model_sample sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.nodes        = t->ranks;
+    sample.shape        = t->shape;
+    sample.degree       = atoi(strmap_get(s->params, "DEG"));
+    sample.launch_usecs = profile_delta_usecs("launch children");
+    sample.accept_usecs = profile_delta_usecs("accept children");
+    sample.params_usecs = profile_delta_usecs("send params to children");
+    if (bench_enabled) {
+        /* only measure_costs times these */
+        sample.signal_usecs = profile_delta_usecs("signal costs x1000 **");
+        sample.pack_usecs   = profile_delta_usecs("pack/unpack strmap x1000 **");
+    }
+    sample.bcast_usecs  = profile_bcast_usecs;
+    sample.bcast_bytes  = profile_bcast_bytes;
+    sample.bcast_chunk  = profile_bcast_chunk;
+
+    /* blend this launch into the profile as a moving average, it
+     * counts for half, and each earlier launch for half as much as
+     * the one after it, so the profile follows changes to the system */
+    launch_model_params old;
+    launch_model_defaults(&old);
+    int have_old = (launch_model_read(profile_file, &old) == 0);
+
+    launch_model_params p = old;
+    launch_model_fit(&sample, 1, &p);
+    if (have_old) {
+        launch_model_average(&p, &old, 0.5);
+    }
+
+    if (launch_model_write(profile_file, &p) != 0) {
+        SPAWN_ERR("Failed to write launch profile `%s' (%s)", profile_file, strerror(errno));
+    }
+
+    return;
+}
+
+/* gathers variable-size byte buffers to root, each proc contributes
+ * buf and the root gets the buffers of all procs concatenated in
+ * a newly allocated buffer in recvbuf, which the caller should free
+ * with spawn_free, other procs get NULL */
+static void
+gather_bytes (const void * buf, size_t size, const spawn_tree * t,
+        void ** recvbuf, size_t * recvsize)
+{
+    int children = t->children;
+
+    /* get size of data from each child */
+    int i;
+    uint64_t total = (uint64_t) size;
+    uint64_t* sizes = (uint64_t*) SPAWN_MALLOC(children * sizeof(uint64_t));
+    for (i = 0; i < children; i++) {
+        spawn_net_channel* ch = t->child_chs[i];
+        spawn_net_read(ch, &sizes[i], sizeof(uint64_t));
+        total += sizes[i];
+    }
+
+    /* copy our data, then append data from each child */
+    char* all = (char*) SPAWN_MALLOC((size_t) total);
+    memcpy(all, buf, size);
+    char* ptr = all + size;
+    for (i = 0; i < children; i++) {
+        spawn_net_channel* ch = t->child_chs[i];
+        if (sizes[i] > 0) {
+            spawn_net_read(ch, ptr, (size_t) sizes[i]);
+        }
+        ptr += sizes[i];
+    }
+
+    /* TODO: convert to network order */
+    /* forward data to parent, or hand it back if we're the root */
+    if (t->parent_ch != SPAWN_NET_CHANNEL_NULL) {
+        virt_link_delay(sizeof(uint64_t) + (size_t) total);
+        spawn_net_write(t->parent_ch, &total, sizeof(uint64_t));
+        if (total > 0) {
+            spawn_net_write(t->parent_ch, all, (size_t) total);
+        }
+        spawn_free(&all);
+        *recvbuf  = NULL;
+        *recvsize = 0;
+    } else {
+        *recvbuf  = all;
+        *recvsize = (size_t) total;
+    }
+
+    spawn_free(&sizes);
+
+    return;
+}
+
 static void
 bcast (void * buf, size_t size, const spawn_tree * t)
 {
@@ -1304,6 +2201,8 @@ bcast (void * buf, size_t size, const spawn_tree * t)
     spawn_net_channel* p = t->parent_ch;
     if (p != SPAWN_NET_CHANNEL_NULL) {
         spawn_net_read(p, buf, size);
+    } else {
+        status_add(STATUS_BCAST_BYTES, (uint64_t) size);
     }
 
     /* send bytes to children */
@@ -1311,6 +2210,7 @@ bcast (void * buf, size_t size, const spawn_tree * t)
     int children = t->children;
     for (i = 0; i < children; i++) {
         spawn_net_channel* ch = t->child_chs[i];
+        virt_link_delay(size);
         spawn_net_write(ch, buf, size);
     }
 
@@ -1408,6 +2308,7 @@ gather_strmap (strmap * map, const spawn_tree * t)
 
     /* forward map to parent, or unpack each map if we're the root */
     if (p != SPAWN_NET_CHANNEL_NULL) {
+        virt_link_delay(bufsize);
         spawn_net_write(p, buf, bufsize);
     } else {
         /* we're the root, unpack each map into output map */
@@ -1441,47 +2342,149 @@ allgather_strmap (strmap * map, const spawn_tree * t)
     return;
 }
 
-/* broadcast file from file system to /tmp using spawn tree,
- * returns name of file in /tmp (caller should free name) */
-static char *
-bcast_file (const char* dir, const char * file, const spawn_tree * t, process_group* pg)
+/* exclusive scan of count over spawn procs in tree order, each spawn
+ * proc before the subtrees of its children in order, returns the sum
+ * of counts of spawn procs before us and fills in sizes with the sum
+ * over the subtree of each child */
+static uint64_t
+scan_counts (uint64_t count, const spawn_tree * t, uint64_t * sizes)
 {
-    /* root spawn process reads file size */
-    ssize_t bcast_size = 0;
-
-    /* check for the chunk size to be used for BCAST_BIN */
-    const char* use_bin_bcast_chunk_sz_str = strmap_get(pg->params, "BCAST_BIN_CHUNK_SZ");
-    size_t use_bin_bcast_chunk_sz = atoi(use_bin_bcast_chunk_sz_str) * 1024 * 1024;
+    int children = t->children;
 
-    /* get file size */
-    ssize_t bufsize;
-    if (t->rank == 0) {
-        bufsize = get_file_size(file);
+    /* total counts in our subtree */
+    int i;
+    uint64_t total = count;
+    for (i = 0; i < children; i++) {
+        spawn_net_channel* ch = t->child_chs[i];
+        spawn_net_read(ch, &sizes[i], sizeof(uint64_t));
+        total += sizes[i];
     }
-    bcast(&bufsize, sizeof(ssize_t), t);
-
-    /* TODO: read/bcast file in chunks */
 
-    /* allocate buffer to hold file */
-    void* buf = SPAWN_MALLOC(bufsize);
+    /* TODO: convert to network order */
+    /* send total to parent and get our offset back,
+     * the root starts at 0 */
+    uint64_t offset = 0;
+    spawn_net_channel* p = t->parent_ch;
+    if (p != SPAWN_NET_CHANNEL_NULL) {
+        virt_link_delay(sizeof(uint64_t));
+        spawn_net_write(p, &total, sizeof(uint64_t));
+        spawn_net_read(p, &offset, sizeof(uint64_t));
+    }
 
-    /* root reads file from disk */
-    if (t->rank == 0) {
-        printf("bcasting %s\n", file);
-        read_to_mem(file, bufsize, (char*)buf);
-        /* TODO: check for errors */
+    /* send each child the offset of its subtree */
+    uint64_t child_offset = offset + count;
+    for (i = 0; i < children; i++) {
+        spawn_net_channel* ch = t->child_chs[i];
+        virt_link_delay(sizeof(uint64_t));
+        spawn_net_write(ch, &child_offset, sizeof(uint64_t));
+        child_offset += sizes[i];
     }
 
-    /* bcast entire file at one go by default */
-    if (!use_bin_bcast_chunk_sz) {
+    return offset;
+}
+
+/* measure some costs of the spawn tree that are not part of a launch,
+ * an allgather of all spawn endpoints, strmap pack/unpack on the
+ * root, and signal propagation through the tree */
+static void
+measure_costs (const session * s)
+{
+    int i, tid;
+    int nodeid = s->tree->rank;
+
+    /* wait for signal from root before we start spawn ep exchange */
+    status_phase("spawn endpoint exchange");
+    tid = begin_delta("spawn endpoint exchange **");
+    sync_from_root(s);
+
+    /* add our endpoint into strmap and do an allgather */
+    strmap* spawnep_strmap = strmap_new();
+    strmap_setf(spawnep_strmap, "%d=%s", s->tree->rank, s->ep_name);
+    allgather_strmap(spawnep_strmap, s->tree);
+
+    /* signal root to let it know spawn ep bcast has completed */
+    sync_to_root(s);
+    end_delta(tid);
+
+    /* measure pack/unpack cost of strmap */
+    if (nodeid == 0) {
+        tid = begin_delta("pack/unpack strmap x1000 **");
+        for (i = 0; i < 1000; i++) {
+            size_t pack_size = strmap_pack_size(spawnep_strmap);
+            void* pack_buf = SPAWN_MALLOC(pack_size);
+
+            strmap_pack(pack_buf, spawnep_strmap);
+
+            strmap* tmpmap = strmap_new();
+            strmap_unpack(pack_buf, tmpmap);
+            strmap_delete(&tmpmap);
+
+            spawn_free(&pack_buf);
+        }
+        end_delta(tid);
+    }
+
+    strmap_delete(&spawnep_strmap);
+
+    /* measure cost of signal propagation */
+    status_phase("signal costs");
+    signal_from_root(s);
+    tid = begin_delta("signal costs x1000 **");
+    for (i = 0; i < 1000; i++) {
+        signal_to_root(s);
+        signal_from_root(s);
+    }
+    end_delta(tid);
+
+    return;
+}
+
+/* broadcast file from file system to /tmp using spawn tree,
+ * returns name of file in /tmp (caller should free name) */
+static char *
+bcast_file (const char* dir, const char * file, const spawn_tree * t, process_group* pg)
+{
+    /* root spawn process reads file size */
+    ssize_t bcast_size = 0;
+
+    /* check for the chunk size to be used for BCAST_BIN */
+    const char* use_bin_bcast_chunk_sz_str = strmap_get(pg->params, "BCAST_BIN_CHUNK_SZ");
+    size_t use_bin_bcast_chunk_sz = atoi(use_bin_bcast_chunk_sz_str) * 1024 * 1024;
+
+    /* get file size */
+    ssize_t bufsize;
+    if (t->rank == 0) {
+        bufsize = get_file_size(file);
+    }
+    bcast(&bufsize, sizeof(ssize_t), t);
+
+    /* TODO: read/bcast file in chunks */
+
+    /* allocate buffer to hold file */
+    void* buf = SPAWN_MALLOC(bufsize);
+
+    /* root reads file from disk */
+    if (t->rank == 0) {
+        printf("bcasting %s\n", file);
+        read_to_mem(file, bufsize, (char*)buf);
+        /* TODO: check for errors */
+    }
+
+    /* bcast entire file at one go by default */
+    if (!use_bin_bcast_chunk_sz) {
         use_bin_bcast_chunk_sz = bufsize;
     }
 
     /* bcast bytes from root with appropriate chunking */
     while (bcast_size < bufsize) {
 //        fprintf(stdout,"Bcasted %ldMB\n", ((bcast_size) / (1024 * 1024 )));
-        bcast((buf+bcast_size), use_bin_bcast_chunk_sz, t);
-        bcast_size += use_bin_bcast_chunk_sz;
+        /* last chunk may be short */
+        size_t chunk = use_bin_bcast_chunk_sz;
+        if (chunk > (size_t) (bufsize - bcast_size)) {
+            chunk = (size_t) (bufsize - bcast_size);
+        }
+        bcast((buf+bcast_size), chunk, t);
+        bcast_size += chunk;
     }
                 
     /* write file to ramdisk and get name of new file */
@@ -1666,26 +2669,32 @@ ring_scan (strmap * input, strmap * output, const spawn_tree * t)
  *   4) Spawn proc invokes ring_scan across spawn tree
  *   5) Spawn proc computes LEFT/RIGHT addresses for each child,
  *      sends these values along with RANK/RANKS to each child
- *   6) Spawn proc disconnects from each child */
+ *   6) Spawn proc disconnects from each child
+ *
+ * The ring is ordered by group rank, so RANK is the rank the child has
+ * in PMI, and LEFT and RIGHT come from rank-1 and rank+1.  With block
+ * and socket maps, ring_scan links blocks in the order the rank scan
+ * assigned them, and we link our own procs in rank order.  Cyclic and
+ * file maps put neighboring ranks on different spawn procs, so a scan
+ * can't link them, and we allgather the address of every rank
+ * instead. */
 static void
 ring_exchange (session * s, const process_group * pg,
         const spawn_net_endpoint * ep)
 {
     int i, tid, tid_ring;
     spawn_tree* t = s->tree;
-    int rank = t->rank;
 
     /* wait for signal from root before we start exchange */
-    if (!rank) { tid_ring = begin_delta("ring exchange"); }
-    signal_from_root(s);
+    status_phase("ring exchange");
+    tid_ring = begin_delta("ring exchange");
+    sync_from_root(s);
 
     /* get number of procs we should here from */
     int children = (int) pg->num;
 
-    /* TODO: read ranks from process group */
-
     /* get total number of procs in job */
-    int ranks = t->ranks * children;
+    int ranks = (int) pg->size;
 
     /* allocate a strmap for each child */
     strmap** maps = (strmap**) SPAWN_MALLOC(children * sizeof(strmap*));
@@ -1697,17 +2706,17 @@ ring_exchange (session * s, const process_group * pg,
     spawn_net_channel** chs = (spawn_net_channel**) SPAWN_MALLOC(children * sizeof(spawn_net_channel*));
 
     /* wait for children to connect */
-    if (!rank) { tid = begin_delta("ring accept"); }
-    signal_from_root(s);
+    tid = begin_delta("ring accept");
+    sync_from_root(s);
     for (i = 0; i < children; i++) {
         chs[i] = spawn_net_accept(ep);
     }
-    signal_to_root(s);
-    if (!rank) { end_delta(tid); }
+    sync_to_root(s);
+    end_delta(tid);
 
     /* wait for address from each child */
-    if (!rank) { tid = begin_delta("ring read children"); }
-    signal_from_root(s);
+    tid = begin_delta("ring read children");
+    sync_from_root(s);
     for (i = 0; i < children; i++) {
         //spawn_net_read_strmap(chs[i], maps[i]);
 
@@ -1715,85 +2724,112 @@ ring_exchange (session * s, const process_group * pg,
         spawn_net_wait(0, NULL, children, chs, &child_index);
         spawn_net_read_strmap(chs[child_index], maps[child_index]);
     }
-    signal_to_root(s);
-    if (!rank) { end_delta(tid); }
+    sync_to_root(s);
+    end_delta(tid);
 
 
+    /* order our children by group rank, with a block map the
+     * child at position j of our block has rank offset + j */
+    int* order = (int*) SPAWN_MALLOC(children * sizeof(int));
+    for (i = 0; i < children; i++) {
+        int j = pg_map_blocks(pg) ? (int) (pg->ranks[i] - pg->offset) : i;
+        order[j] = i;
+    }
+
     /* compute scan on tree */
-    if (!rank) { tid = begin_delta("ring scan"); }
-    signal_from_root(s);
+    tid = begin_delta("ring scan");
+    sync_from_root(s);
 
     strmap* output = strmap_new();
 
-    /* get addresses of our left-most and right-most children */
-    strmap* input = strmap_new();
-    if (children > 0) {
-        const char* leftmost  = strmap_get(maps[0], "ADDR");
-        const char* rightmost = strmap_get(maps[children-1], "ADDR");
-        strmap_set(input, "LEFT",  leftmost);
-        strmap_set(input, "RIGHT", rightmost);
-    }
+    if (pg_map_blocks(pg)) {
+        /* get addresses of our left-most and right-most children */
+        strmap* input = strmap_new();
+        if (children > 0) {
+            const char* leftmost  = strmap_get(maps[order[0]], "ADDR");
+            const char* rightmost = strmap_get(maps[order[children-1]], "ADDR");
+            strmap_set(input, "LEFT",  leftmost);
+            strmap_set(input, "RIGHT", rightmost);
+        }
 
-    /* execute the scan */
-    ring_scan(input, output, t);
+        /* execute the scan */
+        ring_scan(input, output, t);
 
-    /* free the input */
-    strmap_delete(&input);
+        /* free the input */
+        strmap_delete(&input);
+    } else {
+        /* gather address of every rank */
+        for (i = 0; i < children; i++) {
+            const char* addr = strmap_get(maps[i], "ADDR");
+            strmap_setf(output, "%llu=%s", (unsigned long long) pg->ranks[i], addr);
+        }
+        allgather_strmap(output, t);
+    }
 
-    signal_to_root(s);
-    if (!rank) { end_delta(tid); }
+    sync_to_root(s);
+    end_delta(tid);
 
     /* compute left and right addresses for each of our children */
-    if (!rank) { tid = begin_delta("ring write children"); }
-    signal_from_root(s);
+    tid = begin_delta("ring write children");
+    sync_from_root(s);
     for (i = 0; i < children; i++) {
-        /* since each spawn proc is creating the same number of tasks,
-         * we can hardcode a child rank relative to the spawn rank */
-        int child_rank = rank * children + i;
+        /* get group rank we assigned this child at launch */
+        uint64_t child_rank = pg->ranks[i];
 
         /* send init info */
         strmap* init = strmap_new();
-        strmap_setf(init, "RANK=%d",  child_rank);
+        strmap_setf(init, "RANK=%llu", (unsigned long long) child_rank);
         strmap_setf(init, "RANKS=%d", ranks);
 
         const char* left;
-        if (i == 0) {
-            /* get the address our parent says is our left */
-            left = strmap_get(output, "LEFT");
-        } else {
-            /* get rightmost address on left side */
-            left = strmap_get(maps[i-1], "ADDR");
-        }
-        strmap_set(init, "LEFT", left);
-
         const char* right;
-        if (i < children-1) {
-            /* get leftmost address on right side */
-            right = strmap_get(maps[i+1], "ADDR");
+        if (pg_map_blocks(pg)) {
+            int j = (int) (child_rank - pg->offset);
+            if (j == 0) {
+                /* get the address our parent says is our left */
+                left = strmap_get(output, "LEFT");
+            } else {
+                /* get rightmost address on left side */
+                left = strmap_get(maps[order[j-1]], "ADDR");
+            }
+
+            if (j < children-1) {
+                /* get leftmost address on right side */
+                right = strmap_get(maps[order[j+1]], "ADDR");
+            } else {
+                /* get the address our parent says is our right */
+                right = strmap_get(output, "RIGHT");
+            }
         } else {
-            /* get the address our parent says is our right */
-            right = strmap_get(output, "RIGHT");
+            /* look up addresses of neighboring ranks, wrapping ends */
+            uint64_t size = pg->size;
+            left  = strmap_getf(output, "%llu",
+                (unsigned long long) ((child_rank + size - 1) % size));
+            right = strmap_getf(output, "%llu",
+                (unsigned long long) ((child_rank + 1) % size));
         }
+        strmap_set(init, "LEFT", left);
         strmap_set(init, "RIGHT", right);
 
         spawn_net_write_strmap(chs[i], init);
         strmap_delete(&init);
     }
 
-    /* delete strmap from parent */
+    /* delete strmap from parent and our ordering */
     strmap_delete(&output);
+    spawn_free(&order);
 
-    signal_to_root(s);
-    if (!rank) { end_delta(tid); }
+    sync_to_root(s);
+    end_delta(tid);
 
     /* disconnect from each child */
-    if (!rank) { tid = begin_delta("ring disconnect"); }
-    signal_from_root(s);
+    tid = begin_delta("ring disconnect");
+    sync_from_root(s);
     for (i = 0; i < children; i++) {
         spawn_net_disconnect(&chs[i]);
     }
-    signal_to_root(s);
-    if (!rank) { end_delta(tid); }
+    sync_to_root(s);
+    end_delta(tid);
 
     /* delete each child strmap */
     for (i = 0; i < children; i++) {
@@ -1801,8 +2837,8 @@ ring_exchange (session * s, const process_group * pg,
     }
 
     /* signal root to let it know PMI bcast has completed */
-    signal_to_root(s);
-    if (!rank) { end_delta(tid_ring); }
+    sync_to_root(s);
+    end_delta(tid_ring);
 
     return;
 }
@@ -1824,13 +2860,33 @@ process_group_new()
     pg->params = strmap_new();
     pg->size   = 0;
     pg->num    = 0;
+    pg->runs     = 0;
+    pg->run_node = NULL;
+    pg->run_ppn  = NULL;
+    pg->nodes     = 0;
+    pg->offset      = 0;
+    pg->child_first = NULL;
+    pg->child_size  = NULL;
+    pg->map       = PG_MAP_BLOCK;
+    pg->rank_node = NULL;
+    pg->topo      = NULL;
+    pg->bind      = BINDING_NONE;
     pg->pids   = NULL;
     pg->ranks  = NULL;
+    pg->clique = NULL;
     pg->chs    = NULL;
     pg->nconnected = 0;
+    pg->pmi_events = NULL;
+    pg->pmi_ctl    = SPAWN_NET_CHANNEL_NULL;
+    pg->states     = NULL;
     pg->file_map   = strmap_new();
     pg->commit_map = strmap_new();
     pg->global_map = strmap_new();
+    pg->global_index = strmap_new();
+    pg->local_map  = strmap_new();
+    pg->dmodex_cache = strmap_new();
+    pg->dmodex_map = strmap_new();
+    pg->fence_collect = 0;
     pg->ring_map   = strmap_new();
     return pg;
 }
@@ -1854,6 +2910,15 @@ process_group_delete (process_group ** ppg)
 
         /* delete ranks */
         spawn_free(&pg->ranks);
+        spawn_free(&pg->clique);
+
+        /* delete layout */
+        spawn_free(&pg->run_node);
+        spawn_free(&pg->run_ppn);
+        spawn_free(&pg->child_first);
+        spawn_free(&pg->child_size);
+        spawn_free(&pg->rank_node);
+        binding_topo_free(&pg->topo);
 
         /* delete channels */
         spawn_free(&pg->chs);
@@ -1862,8 +2927,20 @@ process_group_delete (process_group ** ppg)
         strmap_delete(&pg->file_map);
 
         /* delete PMI resources */
+        if (pg->pmi_events != NULL) {
+            pmi_event* ev;
+            while ((ev = (pmi_event*) lfqueue_pop(pg->pmi_events)) != NULL) {
+                spawn_free(&ev);
+            }
+            lfqueue_delete(&pg->pmi_events);
+        }
+        spawn_free(&pg->states);
         strmap_delete(&pg->commit_map);
         strmap_delete(&pg->global_map);
+        strmap_delete(&pg->global_index);
+        strmap_delete(&pg->local_map);
+        strmap_delete(&pg->dmodex_cache);
+        strmap_delete(&pg->dmodex_map);
         strmap_delete(&pg->ring_map);
     }
 
@@ -1873,6 +2950,266 @@ process_group_delete (process_group ** ppg)
     return;
 }
 
+/* Each spawn proc may start a different number of procs, so the root
+ * lists the number for each spawn proc in rank order as a compressed
+ * integer list in the PPN param, e.g., "8,4*1023".  We decode the list
+ * straight into runs of spawn procs that start the same number of
+ * procs, so looking up the count of a spawn proc doesn't take memory
+ * for each spawn proc.  A single value applies to all spawn procs. */
+
+/* set layout of process group across nodes spawn procs from list,
+ * returns 0 on success */
+static int
+pg_layout_set (process_group * pg, const char * list, int nodes)
+{
+    int count;
+    int* run_node = NULL;
+    int* run_ppn  = NULL;
+    int runs = hostlist_expand_int_runs(list, &count, &run_node, &run_ppn);
+    if (runs <= 0 || (count != 1 && count != nodes)) {
+        SPAWN_ERR("PPN list `%s' must give 1 or %d values", list, nodes);
+        spawn_free(&run_node);
+        spawn_free(&run_ppn);
+        return 1;
+    }
+
+    pg->runs     = runs;
+    pg->run_node = run_node;
+    pg->run_ppn  = run_ppn;
+    pg->nodes    = nodes;
+
+    /* total procs across all nodes, the last run extends to the last
+     * node when a single value applies to all */
+    pg->size = 0;
+    int run;
+    for (run = 0; run < runs; run++) {
+        int end = (run + 1 < runs) ? run_node[run + 1] : nodes;
+        pg->size += (uint64_t) (end - run_node[run]) * (uint64_t) run_ppn[run];
+    }
+
+    return 0;
+}
+
+/* returns run holding the given spawn proc */
+static int
+pg_node_run (const process_group * pg, int node)
+{
+    int lo = 0;
+    int hi = pg->runs - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (pg->run_node[mid] <= node) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+/* returns number of procs started by the given spawn proc */
+static int
+pg_node_ppn (const process_group * pg, int node)
+{
+    return pg->run_ppn[pg_node_run(pg, node)];
+}
+
+/* returns number of spawn procs in the given run */
+static int
+pg_run_nodes (const process_group * pg, int run)
+{
+    int end = (run + 1 < pg->runs) ? pg->run_node[run + 1] : pg->nodes;
+    return end - pg->run_node[run];
+}
+
+/* The MAP param picks how group ranks are assigned to the procs each
+ * spawn proc starts.  With a block map, each spawn proc gets its first
+ * rank from an exclusive scan of per-node counts over the spawn tree,
+ * so blocks follow tree order, each spawn proc before the subtrees of
+ * its children, the same order ring_scan links procs in.  The scan
+ * also leaves each spawn proc with the rank range of each child
+ * subtree, which is all it needs to route a message to the owner of
+ * a rank.  With a cyclic map, ranks are dealt one at a time to each
+ * spawn proc in rank order, skipping spawn procs that have no procs
+ * left, so with the same count everywhere proc i on spawn proc n gets
+ * rank i * nodes + n.  A socket map places blocks of ranks on spawn
+ * procs as a block map does, but deals ranks within a spawn proc
+ * round-robin across its sockets, so it takes its blocks from the
+ * same scan.  A map file lists the spawn proc of each rank, which the
+ * root sends to all spawn procs in the RANKMAP param.  Cyclic and file
+ * ranks are computed locally, so those maps skip the scan. */
+
+/* returns cyclic rank of proc i on the given spawn proc, this is the
+ * number of ranks dealt in rounds before round i, plus the number of
+ * spawn procs before node that receive a rank in round i */
+static uint64_t
+pg_cyclic_rank (const process_group * pg, int node, int i)
+{
+    uint64_t rank = 0;
+    int run;
+    for (run = 0; run < pg->runs; run++) {
+        int ppn   = pg->run_ppn[run];
+        int first = pg->run_node[run];
+        int count = pg_run_nodes(pg, run);
+        rank += (uint64_t) count * (uint64_t) ((ppn < i) ? ppn : i);
+        if (ppn > i && node > first) {
+            rank += (uint64_t) ((node - first < count) ? node - first : count);
+        }
+    }
+    return rank;
+}
+
+/* returns spawn proc holding the given cyclic rank */
+static int
+pg_cyclic_node (const process_group * pg, uint64_t rank)
+{
+    /* with one run, every round deals a rank to every spawn proc */
+    if (pg->runs == 1) {
+        return (int) (rank % (uint64_t) pg->nodes);
+    }
+
+    /* otherwise step through rounds, each round deals one rank to
+     * each spawn proc that starts more procs than the round number */
+    int round = 0;
+    while (1) {
+        uint64_t round_size = 0;
+        int run;
+        for (run = 0; run < pg->runs; run++) {
+            if (pg->run_ppn[run] > round) {
+                uint64_t count = (uint64_t) pg_run_nodes(pg, run);
+                if (rank < round_size + count) {
+                    return pg->run_node[run] + (int) (rank - round_size);
+                }
+                round_size += count;
+            }
+        }
+        if (round_size == 0) {
+            return -1;
+        }
+        rank -= round_size;
+        round++;
+    }
+}
+
+/* set map policy of process group from MAP and RANKMAP params,
+ * must be called after pg_layout_set, returns 0 on success */
+static int
+pg_map_set (process_group * pg, const strmap * params)
+{
+    const char* map_str = strmap_get(params, "MAP");
+    if (map_str == NULL || strcmp(map_str, KEY_MAP_BLOCK) == 0) {
+        pg->map = PG_MAP_BLOCK;
+    } else if (strcmp(map_str, KEY_MAP_CYCLIC) == 0) {
+        pg->map = PG_MAP_CYCLIC;
+    } else if (strcmp(map_str, KEY_MAP_SOCKET) == 0) {
+        pg->map = PG_MAP_SOCKET;
+    } else if (strcmp(map_str, KEY_MAP_FILE) == 0) {
+        pg->map = PG_MAP_FILE;
+    } else {
+        SPAWN_ERR("Unknown rank map `%s'", map_str);
+        return 1;
+    }
+
+    if (pg->map != PG_MAP_FILE) {
+        return 0;
+    }
+
+    /* decode spawn proc of each rank, and check that it agrees with
+     * the PPN layout the root computed from the same file */
+    const char* list = strmap_get(params, "RANKMAP");
+    int count = -1;
+    if (list != NULL) {
+        pg->rank_node = hostlist_expand_ints(list, &count);
+    }
+    if (pg->rank_node == NULL || (uint64_t) count != pg->size) {
+        SPAWN_ERR("Rank map must list %llu spawn procs",
+            (unsigned long long) pg->size);
+        return 1;
+    }
+    int rank;
+    for (rank = 0; rank < count; rank++) {
+        if (pg->rank_node[rank] >= pg->nodes) {
+            SPAWN_ERR("Rank %d mapped to unknown spawn proc %d",
+                rank, pg->rank_node[rank]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* record first rank of our block and the rank range of each child
+ * subtree, pg->num must be set, collective over the spawn tree */
+static void
+pg_scan_offsets (process_group * pg, const spawn_tree * t)
+{
+    int children = t->children;
+    pg->child_first = (uint64_t*) SPAWN_MALLOC(children * sizeof(uint64_t));
+    pg->child_size  = (uint64_t*) SPAWN_MALLOC(children * sizeof(uint64_t));
+
+    /* our procs come first in our subtree, then each child's */
+    pg->offset = scan_counts(pg->num, t, pg->child_size);
+    uint64_t first = pg->offset + pg->num;
+    int i;
+    for (i = 0; i < children; i++) {
+        pg->child_first[i] = first;
+        first += pg->child_size[i];
+    }
+
+    return;
+}
+
+/* fill in group rank of each proc started by the given spawn proc,
+ * block and socket maps need pg_scan_offsets first */
+static void
+pg_map_ranks (const process_group * pg, int node, uint64_t * ranks)
+{
+    int ppn = pg_node_ppn(pg, node);
+    uint64_t offset = pg->offset;
+
+    int i;
+    switch (pg->map) {
+    case PG_MAP_CYCLIC:
+        for (i = 0; i < ppn; i++) {
+            ranks[i] = pg_cyclic_rank(pg, node, i);
+        }
+        break;
+    case PG_MAP_SOCKET:
+    {
+        /* local procs fill sockets in blocks in launch order, as
+         * binding spreads them, then we deal ranks round-robin across
+         * sockets, so with q procs on each socket, the proc in slot k
+         * on socket s gets rank offset + k * sockets + s, and the
+         * first sockets have one more slot than the rest */
+        int sockets = (pg->topo != NULL) ? pg->topo->sockets : 1;
+        for (i = 0; i < ppn; i++) {
+            int socket, slot;
+            binding_block(i, ppn, sockets, &socket, &slot);
+            ranks[i] = offset + (uint64_t) slot * (uint64_t) sockets +
+                (uint64_t) socket;
+        }
+        break;
+    }
+    case PG_MAP_FILE:
+    {
+        /* ranks of this spawn proc in increasing order */
+        uint64_t rank;
+        i = 0;
+        for (rank = 0; rank < pg->size && i < ppn; rank++) {
+            if (pg->rank_node[rank] == node) {
+                ranks[i] = rank;
+                i++;
+            }
+        }
+        break;
+    }
+    default:
+        for (i = 0; i < ppn; i++) {
+            ranks[i] = offset + (uint64_t) i;
+        }
+        break;
+    }
+}
+
 /* record mapping of group name to a pointer to its data structure,
  * some messages will contain the name of the group, and we use this
  * structure to quickly lookup the corresponding data structure */
@@ -1957,10 +3294,58 @@ process_group_by_pid (session * s, pid_t pid)
     return group_name;
 }
 
+/* called by PMI server thread as it makes progress, posts the time
+ * since the previous call as a PMI phase named label for the main
+ * thread to record, so the phases are profiled without barriers
+ * across the tree, if the queue is full we yield until the main
+ * thread catches up */
+static void
+pmi_phase_end (process_group * pg, const char * label)
+{
+    pmi_event* ev = (pmi_event*) SPAWN_MALLOC(sizeof(pmi_event));
+    ev->label = label;
+    ev->begin = pg->pmi_last;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ev->end);
+    ev->done  = 0;
+    pg->pmi_last = ev->end;
+
+    lfqueue_push_wait(pg->pmi_events, (void*) ev);
+
+    return;
+}
+
+/* serialize group ranks of procs on this node into a newly allocated
+ * string of comma-separated values, caller should free with spawn_free */
+static char *
+clique_to_str (const process_group * pg)
+{
+    uint64_t i;
+
+    /* a uint64_t takes at most 20 digits, plus one for the comma
+     * (or terminating NUL) */
+    size_t size = pg->num * 21 + 1;
+    char* str = (char*) SPAWN_MALLOC(size);
+
+    /* print each rank into the string */
+    char* ptr = str;
+    *ptr = '\0';
+    for (i = 0; i < pg->num; i++) {
+        const char* sep = (i == 0) ? "" : ",";
+        int n = snprintf(ptr, size - (ptr - str), "%s%llu",
+            sep, (unsigned long long) pg->ranks[i]);
+        ptr += n;
+    }
+
+    return str;
+}
+
 /* given an input message of:
  *   MSG=PMI_INIT
  * reply with message of the form:
- *   RANK=rank, RANKS=ranks, JOBID=jobid */
+ *   RANK=rank, RANKS=ranks, JOBID=jobid,
+ *   CLIQUE_SIZE=num, CLIQUE_RANKS=rank0,rank1,...
+ * where the clique lists the group ranks of all procs we started
+ * on this node, so clients can answer PMI_Get_clique_* locally */
 static void handle_pmi_init(
     const session* s,
     process_group* pg,
@@ -1994,19 +3379,102 @@ static void handle_pmi_init(
     strmap_setf(map, "RANK=%d",  rank);
     strmap_setf(map, "RANKS=%d", ranks);
     strmap_setf(map, "JOBID=%d", jobid);
+
+    /* send ranks of all procs on this node, we build this string
+     * once and reuse it for each child */
+    if (pg->clique == NULL) {
+        pg->clique = clique_to_str(pg);
+    }
+    strmap_setf(map, "CLIQUE_SIZE=%llu", (unsigned long long) pg->num);
+    strmap_set(map, "CLIQUE_RANKS", pg->clique);
+
     spawn_net_write_strmap(ch, map);
     strmap_delete(&map);
 
+    /* end init phase once all local procs have initialized */
+    status_add(STATUS_PMI_INIT, 1);
+    pg->init_count++;
+    if (pg->init_count == pg->num) {
+        pmi_phase_end(pg, "pmi init");
+    }
+
+    return;
+}
+
+/* record key/values committed by app proc of given rank in our
+ * local map and commit map, keyed by rank:key since two ranks may
+ * put the same key */
+static void
+pmi_local_merge (process_group * pg, int rank, const strmap * map)
+{
+    strmap_node* node;
+    for (node = strmap_node_first(map);
+         node != NULL;
+         node = strmap_node_next(node))
+    {
+        const char* key = strmap_node_key(node);
+        const char* val = strmap_node_value(node);
+        strmap_setf(pg->local_map,  "%d:%s=%s", rank, key, val);
+        strmap_setf(pg->commit_map, "%d:%s=%s", rank, key, val);
+    }
+    return;
+}
+
+/* merge rank:key values collected by a fence into our global map,
+ * and note which rank put each key for gets that name no rank */
+static void
+pmi_global_merge (process_group * pg, const strmap * map)
+{
+    strmap_node* node;
+    for (node = strmap_node_first(map);
+         node != NULL;
+         node = strmap_node_next(node))
+    {
+        const char* rank_key = strmap_node_key(node);
+        const char* val = strmap_node_value(node);
+        strmap_set(pg->global_map, rank_key, val);
+
+        const char* key = strchr(rank_key, ':');
+        if (key != NULL) {
+            strmap_setf(pg->global_index, "%s=%d", key + 1, atoi(rank_key));
+        }
+    }
+    return;
+}
+
+/* called when a fence completes on this node, values fetched by
+ * direct modex may have been put again, so drop them.  A fence that
+ * collects carries every key in our commit map, which holds all keys
+ * our procs put since the last collecting fence, so every node now
+ * has them in its global map and we drop our local copy too */
+static void
+pmi_fence_done (process_group * pg, int collect)
+{
+    strmap_delete(&pg->dmodex_cache);
+    pg->dmodex_cache = strmap_new();
+    if (collect) {
+        strmap_delete(&pg->local_map);
+        pg->local_map = strmap_new();
+    }
     return;
 }
 
 /* given an input message of:
- *   MSG=PMI_BARRIER
+ *   MSG=PMI_BARRIER or MSG=PMI_FENCE, COLLECT=0|1
  *   key/values
  * merge key/values into our commit map, if we have received such a
  * message from all application procs and spawn tree children forward
  * such a message to our parent, if we are the root, send PMI_BCAST
- * message back down the tree */
+ * message back down the tree.
+ *
+ * A PMI_BARRIER is a fence with COLLECT=1, in which case all
+ * committed key/values travel up the tree and are then broadcast to
+ * every node.  With COLLECT=0 (PMIx "sync only" fence), key/values
+ * stay on the node of the process that committed them, and only a
+ * NULL map travels through the tree.  Those keys are later fetched
+ * on demand with PMI_DMODEX_REQ messages.  If any process in the
+ * fence asks to collect data, we collect the data of the full
+ * subtree. */
 static void handle_pmi_barrier(
     const session* s,
     process_group* pg,
@@ -2019,6 +3487,7 @@ static void handle_pmi_barrier(
 
     /* get channel to process that sent this message */
     spawn_net_channel* ch;
+    uint64_t arrived = 0;
     if (app_proc) {
         /* message came from application process, check its state,
          * it's an error to get a PMI_Barrier message if we're in
@@ -2033,9 +3502,33 @@ static void handle_pmi_barrier(
 
         /* get channel for this message */
         ch = pg->chs[child_id];
+
+        /* count this proc as arrived */
+        arrived = 1;
     } else {
         /* message came from spawn process */
         ch = t->child_chs[child_id];
+
+        /* spawn child reports number of procs arrived in its subtree */
+        const char* arrived_str = strmap_get(msg, "ARRIVED");
+        if (arrived_str != NULL) {
+            arrived = strtoull(arrived_str, NULL, 10);
+        }
+    }
+
+    /* tally arrivals for status, only root's count is reported */
+    pg->barrier_arrived += arrived;
+    status_add(STATUS_PMI_BARRIER, arrived);
+
+    /* determine whether sender wants data collected,
+     * PMI_BARRIER messages don't specify and always collect */
+    int collect = 1;
+    const char* collect_str = strmap_get(msg, "COLLECT");
+    if (collect_str != NULL) {
+        collect = atoi(collect_str);
+    }
+    if (collect) {
+        pg->fence_collect = 1;
     }
 
     /* we should get a set of key/value pairs immediately following
@@ -2043,8 +3536,15 @@ static void handle_pmi_barrier(
     strmap* map = strmap_new();
     spawn_net_read_strmap(ch, map);
 
-    /* merge values from process into our commit map */
-    strmap_merge(pg->commit_map, map);
+    /* keys committed by procs on our node are owned by us, we keep
+     * them so we can serve direct modex requests, and tag them with
+     * the rank that put them, key/values from spawn children are
+     * already tagged */
+    if (app_proc) {
+        pmi_local_merge(pg, (int) pg->ranks[child_id], map);
+    } else {
+        strmap_merge(pg->commit_map, map);
+    }
 
     /* free the temporary map */
     strmap_delete(&map);
@@ -2055,6 +3555,13 @@ static void handle_pmi_barrier(
     pg->barrier_count++;
     int total_count = pg->num + t->children;
     if (pg->barrier_count == total_count) {
+        /* we only ship key/values if someone asked to collect them */
+        strmap* data = pg->commit_map;
+        strmap* empty = strmap_new();
+        if (! pg->fence_collect) {
+            data = empty;
+        }
+
         /* send to parent if we have one, otherwise send to children */
         if (t->rank > 0) {
             /* get channel to parent */
@@ -2064,25 +3571,30 @@ static void handle_pmi_barrier(
             map = strmap_new();
             strmap_set(map, "MSG", "PMI_BARRIER");
             strmap_set(map, "GROUP", pg->name);
+            strmap_setf(map, "COLLECT=%d", pg->fence_collect);
+            strmap_setf(map, "ARRIVED=%llu", (unsigned long long) pg->barrier_arrived);
+            virt_strmap_delay(map, data);
             spawn_net_write_strmap(ch, map);
             strmap_delete(&map);
 
             /* send commit to parent */
-            spawn_net_write_strmap(ch, pg->commit_map);
+            spawn_net_write_strmap(ch, data);
         } else {
             /* we're the root of the tree, bcast values back down,
              * build a bcast message */
             map = strmap_new();
             strmap_set(map, "MSG", "PMI_BCAST");
             strmap_set(map, "GROUP", pg->name);
+            strmap_setf(map, "COLLECT=%d", pg->fence_collect);
 
             /* send bcast message followed by commit map
              * to each spawn tree child */
             int i;
             for (i = 0; i < t->children; i++) {
                  ch = t->child_chs[i];
+                 virt_strmap_delay(map, data);
                  spawn_net_write_strmap(ch, map);
-                 spawn_net_write_strmap(ch, pg->commit_map);
+                 spawn_net_write_strmap(ch, data);
             }
 
             /* send bcast message to each app process,
@@ -2097,18 +3609,35 @@ static void handle_pmi_barrier(
 //printf("\n");
 
             /* merge key/values into our global map */
-            strmap_merge(pg->global_map, pg->commit_map);
+            pmi_global_merge(pg, data);
 
             /* delete bcast message */
             strmap_delete(&map);
 
             /* reset our barrier count */
             pg->barrier_count  = 0;
+
+            /* fence is complete on this node */
+            pmi_fence_done(pg, pg->fence_collect);
+            pmi_phase_end(pg, "pmi fence");
+            status_add(STATUS_PMI_FENCES, 1);
+            status_set(STATUS_PMI_BARRIER, 0);
         }
 
-        /* clear commit map */
-        strmap_delete(&pg->commit_map);
-        pg->commit_map = strmap_new();
+        /* start counting arrivals for next fence */
+        pg->barrier_arrived = 0;
+
+        /* free empty map */
+        strmap_delete(&empty);
+
+        /* clear commit map and collect flag for next fence, a fence
+         * that doesn't collect leaves the commit map for the next
+         * one that does */
+        if (pg->fence_collect) {
+            strmap_delete(&pg->commit_map);
+            pg->commit_map = strmap_new();
+        }
+        pg->fence_collect = 0;
     }
 
     return;
@@ -2130,88 +3659,309 @@ static void handle_pmi_bcast(
     /* get pointer to spawn tree */
     spawn_tree* t = s->tree;
 
-    /* get channel to parent */
-    spawn_net_channel* ch = t->parent_ch;
-
-    /* strmap of key/value pairs should follow a bcast message */
-    strmap* map = strmap_new();
-    spawn_net_read_strmap(ch, map);
-
-    /* forward these messages to children */
-    int i;
-    for (i = 0; i < t->children; i++) {
-         ch = t->child_chs[i];
-         spawn_net_write_strmap(ch, msg);
-         spawn_net_write_strmap(ch, map);
+    /* get channel to parent */
+    spawn_net_channel* ch = t->parent_ch;
+
+    /* strmap of key/value pairs should follow a bcast message */
+    strmap* map = strmap_new();
+    spawn_net_read_strmap(ch, map);
+
+    /* forward these messages to children */
+    int i;
+    for (i = 0; i < t->children; i++) {
+         ch = t->child_chs[i];
+         virt_strmap_delay(msg, map);
+         spawn_net_write_strmap(ch, msg);
+         spawn_net_write_strmap(ch, map);
+    }
+
+    /* send bcast message to each app process,
+     * and set state back to PMI_STATE_NORMAL */
+    for (i = 0; i < pg->num; i++) {
+         ch = pg->chs[i];
+         spawn_net_write_strmap(ch, msg);
+         pg->states[i] = PMI_STATE_NORMAL;
+    }
+
+    /* merge new key/values into our global map */
+    pmi_global_merge(pg, map);
+
+    /* delete the key/value map */
+    strmap_delete(&map);
+
+    /* reset our barrier count */
+    pg->barrier_count  = 0;
+
+    /* fence is complete on this node */
+    const char* collect_str = strmap_get(msg, "COLLECT");
+    pmi_fence_done(pg, (collect_str == NULL) || atoi(collect_str));
+    pmi_phase_end(pg, "pmi fence");
+
+    return;
+}
+
+/* returns channel toward the spawn proc that launched the app proc
+ * with the given group rank, or SPAWN_NET_CHANNEL_NULL if we launched
+ * it or no one did, cyclic and file ranks name their spawn proc
+ * directly, while we find a block rank in our block or one of the
+ * rank ranges of our child subtrees, and otherwise it is above us */
+static spawn_net_channel*
+pg_rank_route (const spawn_tree * t, const process_group * pg, int rank)
+{
+    if (pg->runs == 0 || rank < 0 || (uint64_t) rank >= pg->size) {
+        return SPAWN_NET_CHANNEL_NULL;
+    }
+
+    if (! pg_map_blocks(pg)) {
+        int node;
+        if (pg->map == PG_MAP_FILE) {
+            node = pg->rank_node[rank];
+        } else {
+            node = pg_cyclic_node(pg, (uint64_t) rank);
+        }
+        if (node < 0 || node == t->rank) {
+            return SPAWN_NET_CHANNEL_NULL;
+        }
+        return tree_route(t, node);
+    }
+
+    uint64_t r = (uint64_t) rank;
+    if (r >= pg->offset && r < pg->offset + pg->num) {
+        return SPAWN_NET_CHANNEL_NULL;
+    }
+    int i;
+    for (i = 0; i < t->children; i++) {
+        if (r >= pg->child_first[i] &&
+            r < pg->child_first[i] + pg->child_size[i])
+        {
+            return t->child_chs[i];
+        }
+    }
+    return t->parent_ch;
+}
+
+/* send a reply to a PMI_GET message to the given app proc */
+static void
+pmi_get_reply (process_group * pg, int child_id, const char * key,
+        const char * value)
+{
+    /* get channel for this child */
+    spawn_net_channel* ch = pg->chs[child_id];
+
+    /* create a string map to send to child */
+    strmap* map = strmap_new();
+    strmap_set(map, "KEY", key);
+    if (value != NULL) {
+        strmap_set(map, "VAL", value);
+    }
+
+    /* send value to child */
+    spawn_net_write_strmap(ch, map);
+
+    /* delete map */
+    strmap_delete(&map);
+
+    return;
+}
+
+/* given an input message of:
+ *   MSG=PMI_GET, KEY=key [, RANK=rank]
+ * return:
+ *   KEY=key, VAL=value
+ * if that key is defined in our global or local maps, and:
+ *   KEY=key
+ * otherwise.  If the message names the rank that put the key, we
+ * look for the value of that rank, and if it is not here (direct
+ * modex), forward a PMI_DMODEX_REQ through the tree to the node that
+ * owns that rank and reply to the app proc once the answer comes back */
+static void handle_pmi_get(
+    const session* s,
+    process_group* pg,
+    int child_id,
+    const strmap* msg)
+{
+    /* get pointer to spawn tree */
+    spawn_tree* t = s->tree;
+
+    /* it's an error to get a PMI_Get message if we're in
+     * any state other than PMI_STATE_NORMAL */
+    int state = (int) pg->states[child_id];
+    if (state != PMI_STATE_NORMAL) {
+        SPAWN_ERR("Recevied PMI_GET message in invalid state=%d", state);
+    }
+
+    /* get key */
+    const char* key = strmap_get(msg, "KEY");
+
+    /* lookup value the named rank put, here or collected by a fence,
+     * without a rank, take the value any proc on our node put, or
+     * else the last one a fence collected */
+    const char* value = NULL;
+    const char* rank_str = strmap_get(msg, "RANK");
+    int rank = -1;
+    if (rank_str != NULL) {
+        rank = atoi(rank_str);
+        value = strmap_getf(pg->local_map, "%d:%s", rank, key);
+        if (value == NULL) {
+            value = strmap_getf(pg->dmodex_cache, "%d:%s", rank, key);
+        }
+        if (value == NULL) {
+            value = strmap_getf(pg->global_map, "%d:%s", rank, key);
+        }
+    } else {
+        uint64_t i;
+        for (i = 0; i < pg->num && value == NULL; i++) {
+            value = strmap_getf(pg->local_map, "%llu:%s",
+                (unsigned long long) pg->ranks[i], key);
+        }
+        const char* owner_str = strmap_get(pg->global_index, key);
+        if (value == NULL && owner_str != NULL) {
+            value = strmap_getf(pg->global_map, "%s:%s", owner_str, key);
+        }
+    }
+
+    /* if we found it or we don't know who owns the key, reply now */
+    if (value != NULL || rank_str == NULL) {
+        pmi_get_reply(pg, child_id, key, value);
+        return;
+    }
+
+    /* if we're the owner, the key does not exist */
+    spawn_net_channel* owner_ch = pg_rank_route(t, pg, rank);
+    if (owner_ch == SPAWN_NET_CHANNEL_NULL) {
+        pmi_get_reply(pg, child_id, key, NULL);
+        return;
+    }
+
+    /* add this child to list of procs waiting on this key of this
+     * rank, if someone else is already waiting, the request is in
+     * flight */
+    const char* waiting = strmap_getf(pg->dmodex_map, "%d:%s", rank, key);
+    if (waiting != NULL) {
+        strmap_setf(pg->dmodex_map, "%d:%s=%s,%d", rank, key, waiting, child_id);
+        return;
+    }
+    strmap_setf(pg->dmodex_map, "%d:%s=%d", rank, key, child_id);
+
+    /* send request toward owner */
+    strmap* req = strmap_new();
+    strmap_set(req, "MSG", "PMI_DMODEX_REQ");
+    strmap_set(req, "GROUP", pg->name);
+    strmap_set(req, "KEY", key);
+    strmap_setf(req, "RANK=%d", rank);
+    strmap_setf(req, "SRC=%d", t->rank);
+    spawn_net_write_strmap(owner_ch, req);
+    strmap_delete(&req);
+
+    return;
+}
+
+/* given an input message of:
+ *   MSG=PMI_DMODEX_REQ, KEY=key, RANK=rank, SRC=node
+ * forward it toward the node that owns rank, or if we are the owner,
+ * send back the value rank put for key:
+ *   MSG=PMI_DMODEX_RESP, KEY=key, RANK=rank, DST=node [, VAL=value] */
+static void handle_pmi_dmodex_req(
+    const session* s,
+    process_group* pg,
+    int child_id,
+    const strmap* msg)
+{
+    /* get pointer to spawn tree */
+    spawn_tree* t = s->tree;
+
+    /* if we're not the owner, pass the message along */
+    const char* key  = strmap_get(msg, "KEY");
+    const char* rank = strmap_get(msg, "RANK");
+    spawn_net_channel* owner_ch = pg_rank_route(t, pg, atoi(rank));
+    if (owner_ch != SPAWN_NET_CHANNEL_NULL) {
+        spawn_net_write_strmap(owner_ch, msg);
+        return;
     }
 
-    /* send bcast message to each app process,
-     * and set state back to PMI_STATE_NORMAL */
-    for (i = 0; i < pg->num; i++) {
-         ch = pg->chs[i];
-         spawn_net_write_strmap(ch, msg);
-         pg->states[i] = PMI_STATE_NORMAL;
+    /* lookup key in keys committed by our procs, which a fence
+     * may have collected since */
+    const char* value = strmap_getf(pg->local_map, "%s:%s", rank, key);
+    if (value == NULL) {
+        value = strmap_getf(pg->global_map, "%s:%s", rank, key);
     }
 
-    /* merge new key/values into our global map */
-    strmap_merge(pg->global_map, map);
-
-    /* delete the key/value map */
-    strmap_delete(&map);
-
-    /* reset our barrier count */
-    pg->barrier_count  = 0;
+    /* build response and send it back toward requesting node */
+    const char* src = strmap_get(msg, "SRC");
+    strmap* resp = strmap_new();
+    strmap_set(resp, "MSG", "PMI_DMODEX_RESP");
+    strmap_set(resp, "GROUP", pg->name);
+    strmap_set(resp, "KEY", key);
+    strmap_set(resp, "RANK", rank);
+    strmap_set(resp, "DST", src);
+    if (value != NULL) {
+        strmap_set(resp, "VAL", value);
+    }
+    spawn_net_write_strmap(tree_route(t, atoi(src)), resp);
+    strmap_delete(&resp);
 
     return;
 }
 
 /* given an input message of:
- *   MSG=PMI_GET, KEY=key
- * return:
- *   KEY=key, VAL=value
- * if that key is defined in our global map, and:
- *   KEY=key
- * otherwise */
-static void handle_pmi_get(
+ *   MSG=PMI_DMODEX_RESP, KEY=key, RANK=rank, DST=node [, VAL=value]
+ * forward it toward the destination node, or if we are the
+ * destination, cache the value and reply to each waiting app proc */
+static void handle_pmi_dmodex_resp(
     const session* s,
     process_group* pg,
     int child_id,
     const strmap* msg)
 {
-    /* it's an error to get a PMI_Get message if we're in
-     * any state other than PMI_STATE_NORMAL */
-    int state = (int) pg->states[child_id];
-    if (state != PMI_STATE_NORMAL) {
-        SPAWN_ERR("Recevied PMI_GET message in invalid state=%d", state);
-    }
-
-    /* get channel for this message */
-    spawn_net_channel* ch = pg->chs[child_id];
-
-    /* get key */
-    const char* key = strmap_get(msg, "KEY");
+    /* get pointer to spawn tree */
+    spawn_tree* t = s->tree;
 
-    /* create a string map to send to child */
-    strmap* map = strmap_new();
+    /* if we're not the destination, pass the message along */
+    int dst = atoi(strmap_get(msg, "DST"));
+    if (dst != t->rank) {
+        spawn_net_write_strmap(tree_route(t, dst), msg);
+        return;
+    }
 
-    /* lookup key in our global map */
-    const char* value = strmap_get(pg->global_map, key);
+    /* cache value so later gets are served locally */
+    const char* key   = strmap_get(msg, "KEY");
+    const char* rank  = strmap_get(msg, "RANK");
+    const char* value = strmap_get(msg, "VAL");
     if (value != NULL) {
-        strmap_set(map, "KEY", key);
-        strmap_set(map, "VAL", value);
-    } else {
-        strmap_setf(map, "KEY", key);
+        strmap_setf(pg->dmodex_cache, "%s:%s=%s", rank, key, value);
     }
 
-    /* send value to child */
-    spawn_net_write_strmap(ch, map);
-
-    /* delete map */
-    strmap_delete(&map);
+    /* reply to each app proc waiting on this key of this rank */
+    const char* waiting = strmap_getf(pg->dmodex_map, "%s:%s", rank, key);
+    if (waiting != NULL) {
+        char* list = SPAWN_STRDUP(waiting);
+        char* id_str = strtok(list, ",");
+        while (id_str != NULL) {
+            pmi_get_reply(pg, atoi(id_str), key, value);
+            id_str = strtok(NULL, ",");
+        }
+        spawn_free(&list);
+        strmap_unsetf(pg->dmodex_map, "%s:%s", rank, key);
+    }
 
     return;
 }
 
+/* returns slot of app proc in ring data of a PMI ring exchange, our
+ * app procs take the first slots and children in the spawn tree come
+ * after, with block and socket maps, our procs are in rank order and
+ * blocks are in the order the tree links them, so the COUNT each proc
+ * gets back is its group rank, with other maps it is only its
+ * position in the ring */
+static int
+pmi_ring_slot (const process_group * pg, int child_id)
+{
+    if (pg_map_blocks(pg)) {
+        return (int) (pg->ranks[child_id] - pg->offset);
+    }
+    return child_id;
+}
+
 /* given an input message of:
  *   MSG=PMI_RING_OUT, LEFT=addr1, RIGHT=addr2
  * create and send messages to children */
@@ -2310,7 +4060,7 @@ static void handle_pmi_ring_out(
      * and set their state back to normal */
     for (i = 0; i < pg->num; i++) {
         spawn_net_channel* ch = pg->chs[i];
-        spawn_net_write_strmap(ch, maps[i]);
+        spawn_net_write_strmap(ch, maps[pmi_ring_slot(pg, i)]);
         pg->states[i] = PMI_STATE_NORMAL;
     }
 
@@ -2327,6 +4077,9 @@ static void handle_pmi_ring_out(
     strmap_delete(&pg->ring_map);
     pg->ring_map = strmap_new();
 
+    /* ring exchange is complete on this node */
+    pmi_phase_end(pg, "pmi ring");
+
     return;
 }
 
@@ -2363,7 +4116,7 @@ static void handle_pmi_ring_in(
         ch = pg->chs[child_id];
 
         /* compute ring id for this message */
-        ring_id = child_id;
+        ring_id = pmi_ring_slot(pg, child_id);
     } else {
         /* message came from spawn process */
         ch = t->child_chs[child_id];
@@ -2389,6 +4142,10 @@ static void handle_pmi_ring_in(
     value = strmap_get(msg, "COUNT");
     if (value != NULL) {
         strmap_setf(pg->ring_map, "COUNT%d=%s", ring_id, value);
+
+        /* count is the number of procs that have entered the ring
+         * in the sender's subtree, tally it for status */
+        status_add(STATUS_PMI_RING, (uint64_t) atoi(value));
     }
 
     /* if we have received ring input message from each app process and
@@ -2469,6 +4226,8 @@ static void handle_pmi_ring_in(
 
             /* simulate reception of a ring output msg */
             handle_pmi_ring_out(s, pg, -1, map);
+            status_add(STATUS_PMI_RINGS, 1);
+            status_set(STATUS_PMI_RING, 0);
 
             /* delete bcast message */
             strmap_delete(&map);
@@ -2516,15 +4275,28 @@ static int handle_pmi_finalize(
         }
 
         /* clear our counters */
-        pg->barrier_count  = 0;
-        pg->ring_count     = 0;
-        pg->finalize_count = 0;
+        pg->init_count      = 0;
+        pg->barrier_count   = 0;
+        pg->barrier_arrived = 0;
+        pg->ring_count      = 0;
+        pg->finalize_count  = 0;
 
         /* free off memory holding key/value pairs */
         strmap_delete(&pg->commit_map);
         strmap_delete(&pg->global_map);
+        strmap_delete(&pg->global_index);
+        strmap_delete(&pg->local_map);
+        strmap_delete(&pg->dmodex_cache);
+        strmap_delete(&pg->dmodex_map);
         pg->commit_map = strmap_new();
         pg->global_map = strmap_new();
+        pg->global_index = strmap_new();
+        pg->local_map  = strmap_new();
+        pg->dmodex_cache = strmap_new();
+        pg->dmodex_map = strmap_new();
+
+        /* end finalize phase once all local procs have finalized */
+        pmi_phase_end(pg, "pmi finalize");
     }
 
     return finalized;
@@ -2562,6 +4334,16 @@ static void authenticate_connection(const spawn_net_endpoint* ep, process_group*
     /* accept the connection */
     spawn_net_channel* ch = spawn_net_accept(ep);
 
+    /* each app proc makes a single connection which it shares between
+     * PMI and ring calls, so we should never see more than pg->num */
+    if (pg->nconnected >= pg->num) {
+        SPAWN_ERR("Unexpected connection, already have %llu of %llu procs",
+            (unsigned long long) pg->nconnected, (unsigned long long) pg->num);
+        spawn_net_disconnect(&ch);
+        *child_id = -1;
+        return;
+    }
+
     /* assume a child is connecting to us, and pick an id for this child */
     int idx = pg->nconnected;
     pg->nconnected++;
@@ -2580,73 +4362,136 @@ static void authenticate_connection(const spawn_net_endpoint* ep, process_group*
     return;
 }
 
-/* accepts connections from process group and processes
- * PMI messages */
-static void
-pmi_exchange(
-    session * s,
-    process_group * pg,
-    const spawn_net_endpoint * ep)
+/* results of handling one PMI message in the server loop */
+#define PMI_MSG_OK       (0) /* nothing more to do */
+#define PMI_MSG_FINALIZE (1) /* all local procs have finalized */
+#define PMI_MSG_CLOSE    (2) /* sender closed its async channel */
+
+/* handles a single PMI message from an app proc (app_proc = 1) or
+ * a spawn proc, pg is the group of the sender, and child_id is its
+ * index among app procs or spawn tree children */
+static int
+pmi_server_handle (session * s, process_group * pg, int child_id,
+        int app_proc, const strmap * msg)
 {
-    int tid, tid_pmi;
+    /* get message type */
+    const char* type = strmap_get(msg, "MSG");
+
+    /* override group if message contains a group key */
+    const char* name = strmap_get(msg, "GROUP");
+    if (name != NULL) {
+        /* we have a group name, now look it up */
+        pg = process_group_by_name(s, name);
+        if (pg == NULL) {
+            SPAWN_ERR("Failed to find group named %s", name);
+        }
+    }
 
-    /* get pointer to spawn tree */
-    const spawn_tree* t = s->tree;
+#if 0
+  printf("Rank %d: Received msg: app=%d pg=%s child=%d\n", rank, app_proc, pg->name, child_id);
+  strmap_print(msg);
+  printf("\n");
+  fflush(stdout);
+#endif
 
-    /* get our rank within spawn tree */
-    int rank = t->rank;
+    /* select function to handle message based on message type */
+    int rc = PMI_MSG_OK;
+    if (strcmp(type, "NULL") == 0) {
 
-    /* wait for children to connect */
-    signal_to_root(s);
-    if (!rank) { tid_pmi = begin_delta("pmi exchange"); }
-    signal_from_root(s);
+    } else if (strcmp(type, "PMI_GET") == 0) {
+        handle_pmi_get(s, pg, child_id, msg);
 
-    /* get number of application procs we should here from */
-    uint64_t children = pg->num;
+    } else if (strcmp(type, "PMI_BARRIER") == 0 ||
+               strcmp(type, "PMI_FENCE")   == 0)
+    {
+        handle_pmi_barrier(s, pg, child_id, msg, app_proc);
 
-    /* allocate a state variable for each child */
-    pg->states = (pmi_state*) SPAWN_MALLOC(children * sizeof(pmi_state));
+    } else if (strcmp(type, "PMI_DMODEX_REQ") == 0) {
+        handle_pmi_dmodex_req(s, pg, child_id, msg);
 
-    /* initailize states */
-    uint64_t i;
-    for (i = 0; i < children; i++) {
-        pg->states[i] = PMI_STATE_INIT;
-    }
+    } else if (strcmp(type, "PMI_DMODEX_RESP") == 0) {
+        handle_pmi_dmodex_resp(s, pg, child_id, msg);
 
-    /* initialize our PMI state counters */
-    pg->barrier_count  = 0;
-    pg->ring_count     = 0;
-    pg->finalize_count = 0;
+    } else if (strcmp(type, "PMI_BCAST") == 0) {
+        handle_pmi_bcast(s, pg, child_id, msg);
 
-    /* allocate a channel for each child */
-    pg->chs = (spawn_net_channel**) SPAWN_MALLOC(children * sizeof(spawn_net_channel*));
-    for (i = 0; i < children; i++) {
-        pg->chs[i] = SPAWN_NET_CHANNEL_NULL;
-    }
+    } else if (strcmp(type, "PMI_RING_IN") == 0) {
+        handle_pmi_ring_in(s, pg, child_id, msg, app_proc);
 
-    /* wait for children to connect */
-#if 0
-    if (!rank) { tid = begin_delta("app accept"); }
-    signal_from_root(s);
-    for (i = 0; i < children; i++) {
-        pg->chs[i] = spawn_net_accept(ep);
+    } else if (strcmp(type, "PMI_RING_OUT") == 0) {
+        handle_pmi_ring_out(s, pg, child_id, msg);
+
+    } else if (strcmp(type, "PMI_INIT") == 0) {
+        handle_pmi_init(s, pg, child_id, msg);
+
+    } else if (strcmp(type, "PMI_FINALIZE") == 0) {
+        int finalized = handle_pmi_finalize(s, pg, child_id, msg);
+        if (finalized) {
+            /* we've gotten a finalize message from each app
+             * process, close down our async channels in spawn
+             * tree */
+            send_close_async(s);
+            rc = PMI_MSG_FINALIZE;
+        }
+
+        /* TODO: we could blank out channel for app proc here */
+
+    } else if (strcmp(type, "CLOSE_ASYNC") == 0) {
+        rc = PMI_MSG_CLOSE;
+
+    } else if (strcmp(type, "KILL") == 0) {
+        /* TODO: kill all procs in process group */
     }
-    signal_to_root(s);
-    if (!rank) { end_delta(tid); }
-#endif
 
-    signal_from_root(s);
-    if (!rank) { tid = begin_delta("app exchange"); }
+    return rc;
+}
+
+/* arguments handed to PMI server thread */
+typedef struct pmi_server_args_struct {
+    session* s;                    /* session owning the spawn tree */
+    process_group* pg;             /* process group being served */
+    const spawn_net_endpoint* ep;  /* endpoint app procs connect to */
+} pmi_server_args;
+
+/* accepts connections from process group and processes PMI
+ * messages until it has received CLOSE_ASYNC from every neighbor
+ * in the spawn tree, runs on its own thread and owns the endpoint
+ * and the app proc channels.
+ *
+ * The server starts before the app procs do, so they get through
+ * PMI_Init while the main thread is still launching their peers and
+ * using the spawn tree for the launch.  Its first connection is a
+ * control channel from the main thread, which sends PMI_TREE once it
+ * is done with the spawn tree channels.  Until then we only handle
+ * PMI_INIT, and hold other messages from app procs, since fences,
+ * rings, and direct modex lookups need the tree. */
+static void *
+pmi_server_thread (void * arg)
+{
+    /* unpack our arguments */
+    pmi_server_args* args = (pmi_server_args*) arg;
+    session* s                   = args->s;
+    process_group* pg            = args->pg;
+    const spawn_net_endpoint* ep = args->ep;
+    spawn_free(&args);
+
+    /* get pointer to spawn tree */
+    const spawn_tree* t = s->tree;
+
+    /* main thread connects before it starts any app proc */
+    spawn_net_channel* ctl = spawn_net_accept(ep);
 
     /* allocate an arrays to hold list of channels, process group
-     * pointers, and child ids for all app procs and spawn tree
-     * children */
-    int channels = pg->num + 1 + t->children;
+     * pointers, and child ids for all app procs, spawn tree
+     * neighbors, and the control channel, tree channels stay
+     * blank until the main thread hands them to us */
+    int channels = pg->num + 1 + t->children + 1;
     spawn_net_channel** chs = (spawn_net_channel**) SPAWN_MALLOC(channels * sizeof(spawn_net_channel*));
     process_group** pgs     = (process_group**)     SPAWN_MALLOC(channels * sizeof(process_group*));
     int* ids                = (int*)                SPAWN_MALLOC(channels * sizeof(int));
 
     /* record channels to app procs */
+    uint64_t i;
     int index = 0;
     for (i = 0; i < pg->num; i++) {
         chs[index] = pg->chs[i];
@@ -2655,20 +4500,33 @@ pmi_exchange(
         index++;
     }
 
-    /* record channel to parent (SPAWN_NET_CHANNEL_NULL for root) */
-    chs[index] = t->parent_ch;
+    /* record slot for channel to parent */
+    int tree_index = index;
+    chs[index] = SPAWN_NET_CHANNEL_NULL;
     pgs[index] = NULL;
     ids[index] = t->children; /* use a bogus number for the child id */
     index++;
 
-    /* record channel to each child in spawn tree */
+    /* record slot for channel to each child in spawn tree */
     for (i = 0; i < t->children; i++) {
-        chs[index] = t->child_chs[i];
+        chs[index] = SPAWN_NET_CHANNEL_NULL;
         pgs[index] = NULL;
         ids[index] = i;
         index++;
     }
 
+    /* record control channel from main thread */
+    int ctl_index = index;
+    chs[index] = ctl;
+    pgs[index] = NULL;
+    ids[index] = -1;
+
+    /* messages from app procs we hold until we have the tree */
+    int held = 0;
+    int held_max = 0;
+    strmap** held_msgs = NULL;
+    int* held_index = NULL;
+
     /* compute number of CLOSE_ASYNC messages we'll receive */
     int need_to_close = 1; /* count one for ourself */
     if (t->parent_ch != SPAWN_NET_CHANNEL_NULL) {
@@ -2686,8 +4544,6 @@ pmi_exchange(
             break;
         }
 
-        /* grab lock */
-
         /* if index points to endpoint, process incoming connection request */
         if (index == 0) {
             /* TODO: acquire process group and child id from incoming message */
@@ -2695,6 +4551,9 @@ pmi_exchange(
             /* accept the connection for this process group */
             int child_id;
             authenticate_connection(ep, pg, &child_id);
+            if (child_id < 0) {
+                continue;
+            }
 
             /* initialize channel for this child */
             chs[child_id] = pg->chs[child_id];
@@ -2732,21 +4591,61 @@ pmi_exchange(
             continue;
         }
 
+        /* main thread is done with the spawn tree, take its channels
+         * and handle the messages we held in the order they came */
+        if (index == ctl_index) {
+            if (strcmp(type, "PMI_TREE") == 0) {
+                chs[tree_index] = t->parent_ch;
+                for (i = 0; i < t->children; i++) {
+                    chs[tree_index + 1 + i] = t->child_chs[i];
+                }
+                chs[ctl_index] = SPAWN_NET_CHANNEL_NULL;
+
+                int j;
+                for (j = 0; j < held; j++) {
+                    int k = held_index[j];
+                    int rc = pmi_server_handle(s, pgs[k], ids[k], 1, held_msgs[j]);
+                    if (rc == PMI_MSG_FINALIZE) {
+                        need_to_close--;
+                    }
+                    strmap_delete(&held_msgs[j]);
+                }
+                held = 0;
+            }
+
+            strmap_delete(&msg);
+            if (need_to_close == 0) {
+                break;
+            }
+            continue;
+        }
+
         /* determine whether this message came from an app proc or
          * a proc in the spawn tree */
         int app_proc = (pgs[index] != NULL);
 
-        /* set the process group based on the sender */
-        process_group* msg_pg = pgs[index];
-
-        /* override group if message contains a group key */
-        const char* name = strmap_get(msg, "GROUP");
-        if (name != NULL) {
-            /* we have a group name, now look it up */
-            msg_pg = process_group_by_name(s, name);
-            if (msg_pg == NULL) {
-                SPAWN_ERR("Failed to find group named %s", name);
+        /* hold messages that may need the tree until we have it */
+        if (app_proc && chs[ctl_index] != SPAWN_NET_CHANNEL_NULL &&
+            strcmp(type, "PMI_INIT") != 0)
+        {
+            if (held == held_max) {
+                held_max = (held_max > 0) ? held_max * 2 : (int) pg->num + 1;
+                strmap** msgs = (strmap**) SPAWN_MALLOC(held_max * sizeof(strmap*));
+                int* idxs     = (int*)     SPAWN_MALLOC(held_max * sizeof(int));
+                int j;
+                for (j = 0; j < held; j++) {
+                    msgs[j] = held_msgs[j];
+                    idxs[j] = held_index[j];
+                }
+                spawn_free(&held_msgs);
+                spawn_free(&held_index);
+                held_msgs  = msgs;
+                held_index = idxs;
             }
+            held_msgs[held]  = msg;
+            held_index[held] = index;
+            held++;
+            continue;
         }
 
         /* determine id of child process that sent the message,
@@ -2754,59 +4653,19 @@ pmi_exchange(
          * when combined with a particular group */
         int child_id = ids[index];
 
-#if 0
-  printf("Rank %d: Received msg: app=%d pg=%s child=%d\n", rank, app_proc, pg->name, child_id);
-  strmap_print(msg);
-  printf("\n");
-  fflush(stdout);
-#endif
-
-        /* select function to handle message based on message type */
-        if (strcmp(type, "NULL") == 0) {
-
-        } else if (strcmp(type, "PMI_GET") == 0) {
-            handle_pmi_get(s, msg_pg, child_id, msg);
-
-        } else if (strcmp(type, "PMI_BARRIER") == 0) {
-            handle_pmi_barrier(s, msg_pg, child_id, msg, app_proc);
-
-        } else if (strcmp(type, "PMI_BCAST") == 0) {
-            handle_pmi_bcast(s, msg_pg, child_id, msg);
-
-        } else if (strcmp(type, "PMI_RING_IN") == 0) {
-            handle_pmi_ring_in(s, msg_pg, child_id, msg, app_proc);
-
-        } else if (strcmp(type, "PMI_RING_OUT") == 0) {
-            handle_pmi_ring_out(s, msg_pg, child_id, msg);
-
-        } else if (strcmp(type, "PMI_INIT") == 0) {
-            handle_pmi_init(s, msg_pg, child_id, msg);
-
-        } else if (strcmp(type, "PMI_FINALIZE") == 0) {
-            int finalized = handle_pmi_finalize(s, msg_pg, child_id, msg);
-            if (finalized) {
-                /* we've gotten a finalize message from each app
-                 * process, close down our async channels in spawn
-                 * tree */
-                send_close_async(s);
-
-                /* decrement our count by one (as if we sent a message
-                 * to ourself) */
-                need_to_close--;
-            }
-
-            /* TODO: we could blank out channel for app proc here */
-
-        } else if (strcmp(type, "CLOSE_ASYNC") == 0) {
+        /* handle message in the group of the sender */
+        int rc = pmi_server_handle(s, pgs[index], child_id, app_proc, msg);
+        if (rc == PMI_MSG_FINALIZE) {
+            /* decrement our count by one (as if we sent a message
+             * to ourself) */
+            need_to_close--;
+        } else if (rc == PMI_MSG_CLOSE) {
             /* if we receive a close async message, blank out
              * this channel so we don't read more messages from it */
             chs[index] = SPAWN_NET_CHANNEL_NULL;
 
             /* decrement the count by one */
             need_to_close--;
-
-        } else if (strcmp(type, "KILL") == 0) {
-            /* TODO: kill all procs in process group */
         }
 
         /* delete message */
@@ -2816,30 +4675,142 @@ pmi_exchange(
         if (need_to_close == 0) {
             break;
         }
-
-        /* release unlock */
     }
 
     /* free the channel array */
+    spawn_free(&held_msgs);
+    spawn_free(&held_index);
     spawn_free(&chs);
     spawn_free(&pgs);
     spawn_free(&ids);
+    spawn_net_disconnect(&ctl);
 
-    signal_to_root(s);
-    if (!rank) { end_delta(tid); }
+    /* let main thread know we're done, it may use the spawn tree
+     * channels synchronously again after this point */
+    pmi_phase_end(pg, "pmi close");
+    pmi_event* ev = (pmi_event*) SPAWN_MALLOC(sizeof(pmi_event));
+    ev->label = NULL;
+    ev->done  = 1;
+    lfqueue_push_wait(pg->pmi_events, (void*) ev);
 
-    /* disconnect from children */
-    signal_to_root(s);
-    if (!rank) { tid = begin_delta("app disconnect"); }
-    signal_from_root(s);
+    return NULL;
+}
+
+/* initialize PMI state for process group and start server thread
+ * on endpoint ep named ep_name, which the main thread must not use
+ * while the server runs, returns after the server has our control
+ * channel, so app procs may be started */
+static void
+pmi_server_start (
+    session * s,
+    process_group * pg,
+    const spawn_net_endpoint * ep,
+    const char * ep_name)
+{
+    /* get number of application procs we should here from */
+    uint64_t children = pg->num;
+
+    /* allocate a state variable for each child */
+    pg->states = (pmi_state*) SPAWN_MALLOC(children * sizeof(pmi_state));
+
+    /* initailize states */
+    uint64_t i;
     for (i = 0; i < children; i++) {
-        spawn_net_disconnect(&pg->chs[i]);
+        pg->states[i] = PMI_STATE_INIT;
+    }
+
+    /* initialize our PMI state counters */
+    pg->init_count      = 0;
+    pg->barrier_count   = 0;
+    pg->barrier_arrived = 0;
+    pg->ring_count      = 0;
+    pg->finalize_count  = 0;
+
+    /* allocate a channel for each child */
+    pg->chs = (spawn_net_channel**) SPAWN_MALLOC(children * sizeof(spawn_net_channel*));
+    for (i = 0; i < children; i++) {
+        pg->chs[i] = SPAWN_NET_CHANNEL_NULL;
+    }
+
+    /* create queue server uses to post events to us,
+     * and time first phase from here */
+    pg->pmi_events = lfqueue_new(PMI_EVENT_QUEUE_SIZE);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &pg->pmi_last);
+
+    /* hand off to server thread, which frees the args */
+    pmi_server_args* args = (pmi_server_args*) SPAWN_MALLOC(sizeof(pmi_server_args));
+    args->s  = s;
+    args->pg = pg;
+    args->ep = ep;
+    int rc = pthread_create(&pg->pmi_thread, NULL, pmi_server_thread, (void*) args);
+    if (rc != 0) {
+        SPAWN_ERR("Failed to start PMI server thread (pthread_create rc=%d %s)", rc, strerror(rc));
+        exit(EXIT_FAILURE);
+    }
+
+    /* connect our control channel, no app proc exists yet,
+     * so this is the first connection the server accepts */
+    pg->pmi_ctl = spawn_net_connect(ep_name);
+
+    return;
+}
+
+/* hand spawn tree channels to PMI server thread, the main thread
+ * must not use them again until pmi_server_wait returns */
+static void
+pmi_server_tree (process_group * pg)
+{
+    strmap* map = strmap_new();
+    strmap_set(map, "MSG", "PMI_TREE");
+    spawn_net_write_strmap(pg->pmi_ctl, map);
+    strmap_delete(&map);
+    return;
+}
+
+/* record PMI phases the server thread posts until it finishes,
+ * then join it and disconnect from app procs */
+static void
+pmi_server_wait (session * s, process_group * pg)
+{
+    /* we back off exponentially while the queue is empty,
+     * but never sleep more than 1ms so we see events quickly */
+    long min_wait = 1000;    /* 1 usec */
+    long max_wait = 1000000; /* 1 msec */
+    struct timespec wait = { 0, min_wait };
+
+    int done = 0;
+    while (! done) {
+        /* check for a new event */
+        pmi_event* ev = (pmi_event*) lfqueue_pop(pg->pmi_events);
+        if (ev == NULL) {
+            nanosleep(&wait, NULL);
+            if (wait.tv_nsec < max_wait) {
+                wait.tv_nsec <<= 1;
+            }
+            continue;
+        }
+        wait.tv_nsec = min_wait;
+
+        if (ev->done) {
+            done = 1;
+        } else {
+            record_delta(ev->label, &ev->begin, &ev->end);
+        }
+        spawn_free(&ev);
     }
-    signal_to_root(s);
-    if (!rank) { end_delta(tid); }
 
-    signal_to_root(s);
-    if (!rank) { end_delta(tid_pmi); }
+    /* server is gone, the spawn tree channels are ours again */
+    pthread_join(pg->pmi_thread, NULL);
+    spawn_net_disconnect(&pg->pmi_ctl);
+    lfqueue_delete(&pg->pmi_events);
+
+    /* disconnect from children */
+    int tid = begin_delta("app disconnect");
+    uint64_t i;
+    for (i = 0; i < pg->num; i++) {
+        spawn_net_disconnect(&pg->chs[i]);
+    }
+    end_delta(tid);
 
     return;
 }
@@ -2870,11 +4841,40 @@ process_group_start (session* s, strmap* params)
     const char* app_exe = strmap_get(params, "EXE");
     const char* app_dir = strmap_get(params, "CWD");
     const char* app_procs_str = strmap_get(params, "PPN");
-    int children = atoi(app_procs_str);
 
-    /* store total number of processes in group */
-    uint64_t group_size = children * ranks;
-    pg->size = group_size;
+    /* record how procs are laid out across spawn procs, this sets
+     * total number of processes in group */
+    if (pg_layout_set(pg, app_procs_str, ranks) != 0) {
+        _exit(EXIT_FAILURE);
+    }
+    if (pg_map_set(pg, params) != 0) {
+        _exit(EXIT_FAILURE);
+    }
+
+    /* pick how procs are bound, and read node topology if binding or
+     * a socket map needs it, without it procs run unbound */
+    const char* bind_str = strmap_get(params, "BIND");
+    if (bind_str != NULL) {
+        int policy = binding_policy_parse(bind_str);
+        if (policy < 0) {
+            SPAWN_ERR("Unknown binding `%s'", bind_str);
+            _exit(EXIT_FAILURE);
+        }
+        pg->bind = (binding_policy) policy;
+    }
+    if (pg->bind != BINDING_NONE || pg->map == PG_MAP_SOCKET) {
+        pg->topo = binding_topo_read();
+    }
+    char* bind_host = NULL;
+    const char* bind_report_str = strmap_get(params, "BIND_REPORT");
+    if (bind_report_str != NULL && atoi(bind_report_str) != 0) {
+        bind_host = spawn_hostname();
+    }
+
+    /* check whether we should fork ranks from a zygote */
+    const char* zygote_lib = strmap_get(params, "ZYGOTE");
+
+    int children = pg_node_ppn(pg, rank);
 
     /* record number of procs we'll start locally,
      * and allocate space to store pid of each process */
@@ -2882,6 +4882,22 @@ process_group_start (session* s, strmap* params)
     pg->pids  = (pid_t*)    SPAWN_MALLOC(children * sizeof(pid_t));
     pg->ranks = (uint64_t*) SPAWN_MALLOC(children * sizeof(uint64_t));
 
+    /* find where our block of ranks starts */
+    if (pg_map_blocks(pg)) {
+        tid = begin_delta("rank scan");
+        pg_scan_offsets(pg, s->tree);
+        end_delta(tid);
+    }
+
+    /* assign group rank of each proc we'll start */
+    pg_map_ranks(pg, rank, pg->ranks);
+
+    /* set values we expect status counters to reach */
+    status_set_total(STATUS_APPS_LAUNCHED, pg->num);
+    status_set_total(STATUS_PMI_INIT,      pg->num);
+    status_set_total(STATUS_PMI_BARRIER,   pg->size);
+    status_set_total(STATUS_PMI_RING,      pg->size);
+
     /* TODO: bcast application executables/libraries here */
 
     /* determine whether we're being debugged */
@@ -2922,6 +4938,16 @@ process_group_start (session* s, strmap* params)
             }
         }
 
+        /* in virtual cluster mode, we stage files in our own dir */
+        if (strcmp(spawn_tmpdir, TMPDIR) != 0) {
+            if (mkdir(spawn_tmpdir, S_IRWXU|S_IRGRP|S_IXGRP)) {
+                if (errno != EEXIST) {
+                    SPAWN_ERR("Failed to create directory: `%s' (%s)", spawn_tmpdir, strerror(errno));
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+
         /* got a bcast directory, create it */
         if (mkdir(bcast_dir, S_IRWXU|S_IRGRP|S_IXGRP)) {
             if (errno != EEXIST) {
@@ -2931,34 +4957,43 @@ process_group_start (session* s, strmap* params)
         }
     }
 
-    /* create endpoint for children to connect to */
-    if (!rank) { tid = begin_delta("open init endpoint"); }
-    signal_from_root(s);
+    /* create endpoint for children to connect to, the PMI server
+     * thread gets an endpoint of its own so it never shares one with
+     * the spawn tree channels the main thread uses meanwhile */
+    tid = begin_delta("open init endpoint");
+    sync_from_root(s);
     spawn_net_endpoint* ep = s->ep;
     const char* ep_name = spawn_net_name(ep);
+    int own_ep = 0;
     if (use_pmi || use_ring) {
       if (use_fifo) {
         ep = spawn_net_open(SPAWN_NET_TYPE_FIFO);
         ep_name = spawn_net_name(ep);
+        own_ep = 1;
+      } else if (use_pmi) {
+        ep = spawn_net_open(spawn_net_infer_type(s->ep_name));
+        ep_name = spawn_net_name(ep);
+        own_ep = 1;
       }
     }
-    signal_to_root(s);
-    if (!rank) { end_delta(tid); }
+    sync_to_root(s);
+    end_delta(tid);
 
     /* broadcast application libraries */
     if (use_lib_bcast) {
-        if (!rank) { tid = begin_delta("bcast app libs"); }
-        signal_from_root(s);
+        status_phase("bcast app libs");
+        tid = begin_delta("bcast app libs");
+        sync_from_root(s);
         int num_libs = lib_num(params);
         for (i = 0; i < num_libs; i++) {
             const char* libname = strmap_getf(params, "LIB%d", i);
             if (libname != NULL) {
-                const char* newlib = bcast_file(TMPDIR, libname, s->tree, pg);
+                const char* newlib = bcast_file(spawn_tmpdir, libname, s->tree, pg);
                 spawn_free(&newlib);
             }
         }
-        signal_to_root(s);
-        if (!rank) { end_delta(tid); }
+        sync_to_root(s);
+        end_delta(tid);
 
         /* TODO: HACK: override LD_LIBRARY_PATH,
          * proper way to do this is like SPINDLE does it with LD_AUDIT lib */
@@ -2973,14 +5008,14 @@ process_group_start (session* s, strmap* params)
         for (j = 0; j < num_envs; j++) {
             const char* val = strmap_getf(params, "ENV%d", j);
             if (strncmp(val, ld_lib_path, ld_lib_path_len) == 0) {
-                strmap_setf(params, "ENV%d=LD_LIBRARY_PATH=%s", j, TMPDIR);
+                strmap_setf(params, "ENV%d=LD_LIBRARY_PATH=%s", j, spawn_tmpdir);
                 found_ld_lib_path = 1;
             }
         }
 
         /* if we didn't find it, add it to the end */
         if (! found_ld_lib_path) {
-            strmap_setf(params, "ENV%d=LD_LIBRARY_PATH=%s", num_envs, TMPDIR);
+            strmap_setf(params, "ENV%d=LD_LIBRARY_PATH=%s", num_envs, spawn_tmpdir);
             num_envs++;
             strmap_setf(params, "ENVS=%d", num_envs);
         }
@@ -2989,25 +5024,50 @@ process_group_start (session* s, strmap* params)
     /* bcast application binary */
     char* bcastname = NULL;
     if (use_bin_bcast) {
-        if (!rank) { tid = begin_delta("bcast app binary"); }
-        signal_from_root(s);
-        bcastname = bcast_file(TMPDIR, app_exe, s->tree, pg);
-        signal_to_root(s);
-        if (!rank) { end_delta(tid); }
+        status_phase("bcast app binary");
+        tid = begin_delta("bcast app binary");
+        sync_from_root(s);
+        bcastname = bcast_file(spawn_tmpdir, app_exe, s->tree, pg);
+        sync_to_root(s);
+        end_delta(tid);
+
+        /* record what the bcast cost for the launch profile */
+        if (s->tree->rank == 0) {
+            const char* chunk_str = strmap_get(pg->params, "BCAST_BIN_CHUNK_SZ");
+            profile_bcast_bytes = (double) get_file_size(app_exe);
+            profile_bcast_chunk = (size_t) atoi(chunk_str) * 1024 * 1024;
+            profile_bcast_usecs = (double) delta_nsecs(tid) / 1000.0;
+        }
 
         /* exec binary from /tmp */
         app_exe = bcastname;
     }
 
+    /* serve PMI from before the first app proc starts, so procs get
+     * through PMI_Init while we launch the rest */
+    if (use_pmi) {
+        pmi_server_start(s, pg, ep, ep_name);
+    }
+
     /* launch app procs */
-    if (!rank) { tid = begin_delta("launch app procs"); }
-    signal_from_root(s);
+    status_phase("launch app procs");
+    tid = begin_delta("launch app procs");
+    sync_from_root(s);
+
+    /* start zygote, if it fails we exec each rank as usual */
+    int zygote_fd = -1;
+    if (zygote_lib != NULL && children > 0) {
+        strmap* argmap = strmap_new();
+        strmap_setf(argmap, "ARG0=%s", app_exe);
+        strmap_setf(argmap, "ARGS=%d", 1);
+        args_merge(argmap, params);
+        zygote_fd = zygote_start(s, params, zygote_lib, app_dir, app_exe, argmap);
+        strmap_delete(&argmap);
+    }
 
     for (i = 0; i < children; i++) {
-        /* TODO: allow for other assignments */
-        /* assign group rank to this process */
-        uint64_t child_rank = rank * children + i;
-        pg->ranks[i] = child_rank;
+        /* get group rank assigned to this process */
+        uint64_t child_rank = pg->ranks[i];
 
         /* create map for arguments */
         strmap* argmap = strmap_new();
@@ -3041,20 +5101,47 @@ process_group_start (session* s, strmap* params)
         /* TODO: HACK: override LD_LIBRARY_PATH,
          * proper way to do this is like SPINDLE does it with LD_AUDIT lib */
         if (use_lib_bcast) {
-            strmap_setf(params, "ENV%d=LD_LIBRARY_PATH=%s", envs, TMPDIR);
+            strmap_setf(params, "ENV%d=LD_LIBRARY_PATH=%s", envs, spawn_tmpdir);
             envs++;
         }
 #endif
 
         /* update the number of env vars */
         strmap_setf(envmap, "ENVS=%d", envs);
+        int rank_envs = envs;
 
         /* copy global env vars from params */
         environ_merge(envmap, params);
 
-        /* launch child process and record pid */
-        pid_t pid = fork_proc(NULL, s->params, app_dir, app_exe, argmap, envmap);
+        /* compute binding of this proc and report it if asked */
+        binding bind;
+        const binding* bindp = NULL;
+        if (binding_compute(pg->topo, pg->bind, i, children, &bind) == 0) {
+            bindp = &bind;
+        }
+        if (bind_host != NULL) {
+            char* bind_desc = (bindp != NULL) ? binding_string(bindp) : SPAWN_STRDUP("unbound");
+            printf("Rank %llu on %s: %s\n",
+                (unsigned long long) child_rank, bind_host, bind_desc);
+            spawn_free(&bind_desc);
+        }
+
+        /* launch child process and record pid, a zygote already has
+         * the global env vars so it only needs those of this rank */
+        pid_t pid;
+        if (zygote_fd >= 0) {
+            const char** envp = (const char**) SPAWN_MALLOC(rank_envs * sizeof(char*));
+            int j;
+            for (j = 0; j < rank_envs; j++) {
+                envp[j] = strmap_getf(envmap, "ENV%d", j);
+            }
+            pid = zygote_fork(zygote_fd, envp, rank_envs, bindp);
+            spawn_free(&envp);
+        } else {
+            pid = launch_proc(NULL, s->params, app_dir, app_exe, argmap, envmap, bindp);
+        }
         pg->pids[i] = pid;
+        status_add(STATUS_APPS_LAUNCHED, 1);
 
         /* record mapping from pid to its process group,
          * we use this to determine which group to tear down when a
@@ -3065,22 +5152,32 @@ process_group_start (session* s, strmap* params)
         strmap_delete(&envmap);
         strmap_delete(&argmap);
     }
-    signal_to_root(s);
-    if (!rank) { end_delta(tid); }
+    spawn_free(&bind_host);
+
+    /* let zygote exit, which hands its ranks to us */
+    if (zygote_fd >= 0) {
+        zygote_exit(zygote_fd);
+        close(zygote_fd);
+    }
+    sync_to_root(s);
+    end_delta(tid);
 
     /* if user wants to debug app procs, gather pids and set MPIR variables */
     if (mpir_app) {
-        /* gather host, pid, exe to root spawn process for debugging */
-        if (!rank) { tid = begin_delta("gather app proc info"); }
-        signal_from_root(s);
-        char* hostname = spawn_hostname();
+        /* gather pid and spawn proc of each proc and exe of each spawn
+         * proc to root spawn process for debugging, root already has
+         * the host of each spawn proc in its host table so we don't
+         * send those */
+        status_phase("gather app proc info");
+        tid = begin_delta("gather app proc info");
+        sync_from_root(s);
 
         strmap* procmap = strmap_new();
+        strmap_setf(procmap, "E%d=%s", rank, app_exe);
         for (i = 0; i < children; i++) {
-            int child_rank = rank * children + i;
-            strmap_setf(procmap, "H%d=%s",  child_rank, hostname);
+            int child_rank = (int) pg->ranks[i];
             strmap_setf(procmap, "P%d=%ld", child_rank, pg->pids[i]);
-            strmap_setf(procmap, "E%d=%s",  child_rank, app_exe);
+            strmap_setf(procmap, "N%d=%d", child_rank, rank);
         }
 
         gather_strmap(procmap, s->tree);
@@ -3091,14 +5188,13 @@ process_group_start (session* s, strmap* params)
 //            printf("\n");
         }
 
-        spawn_free(&hostname);
-        signal_to_root(s);
-        if (!rank) { end_delta(tid); }
+        sync_to_root(s);
+        end_delta(tid);
 
         /* now we have info on root to fill in MPIR proc table */
         if (rank == 0) {
             /* allocate space for proc table */
-            MPIR_proctable_size = s->tree->ranks * children;
+            MPIR_proctable_size = (int) pg->size;
             MPIR_proctable = (MPIR_PROCDESC*) SPAWN_MALLOC(MPIR_proctable_size * sizeof(MPIR_PROCDESC));
 
             /* create a strmap so we can use the same character pointer
@@ -3111,8 +5207,9 @@ process_group_start (session* s, strmap* params)
                 /* get pointer to proc descriptor */
                 MPIR_PROCDESC* desc = &MPIR_proctable[i];
 
-                /* fill in host name */
-                const char* host_str = strmap_getf(procmap, "H%d", i);
+                /* fill in host name from spawn proc that started proc */
+                int node = atoi(strmap_getf(procmap, "N%d", i));
+                const char* host_str = strmap_getf(s->hosts, "%d", node);
                 const char* host_str2 = strmap_get(strcache, host_str);
                 if (host_str2 == NULL) {
                     strmap_set(strcache, host_str, host_str);
@@ -3121,7 +5218,7 @@ process_group_start (session* s, strmap* params)
                 desc->host_name = (char*) host_str2;
 
                 /* fill in exe name */
-                const char* exe_str = strmap_getf(procmap, "E%d", i);
+                const char* exe_str = strmap_getf(procmap, "E%d", node);
                 const char* exe_str2 = strmap_get(strcache, exe_str);
                 if (exe_str2 == NULL) {
                     strmap_set(strcache, exe_str, exe_str);
@@ -3146,27 +5243,32 @@ process_group_start (session* s, strmap* params)
 
         strmap_delete(&procmap);
 
+        /* hold all procs on signal from root */
         signal_from_root(s);
     }
 
-    /* execute PMI exchange */
+    /* we're done with the spawn tree for now, hand it to the PMI
+     * server and wait for the app procs to finish with PMI */
     if (use_pmi) {
-        pmi_exchange(s, pg, ep);
+        status_phase("pmi exchange");
+        tid = begin_delta("pmi exchange");
+        pmi_server_tree(pg);
+        pmi_server_wait(s, pg);
+        end_delta(tid);
     }
     if (use_ring) {
         ring_exchange(s, pg, ep);
     }
 
     /* close listening channel for children */
-    if (!rank) { tid = begin_delta("close init endpoint"); }
-    signal_from_root(s);
-    if (use_pmi || use_ring) {
-      if (use_fifo) {
+    status_phase("close init endpoint");
+    tid = begin_delta("close init endpoint");
+    sync_from_root(s);
+    if (own_ep) {
         spawn_net_close(&ep);
-      }
     }
-    signal_to_root(s);
-    if (!rank) { end_delta(tid); }
+    sync_to_root(s);
+    end_delta(tid);
 
     /* TODO: move this to process group or session cleanup step */
 
@@ -3277,6 +5379,7 @@ session_init (int argc, char * argv[])
     s->ep           = SPAWN_NET_ENDPOINT_NULL;
     s->tree         = NULL;
     s->params       = NULL;
+    s->hosts        = NULL;
     s->name2group   = NULL;
     s->pid2name     = NULL;
     s->appmap       = NULL;
@@ -3286,6 +5389,7 @@ session_init (int argc, char * argv[])
 
     /* create empty params strmap */
     s->params = strmap_new();
+    s->hosts  = strmap_new();
 
     /* create empty name-to-process group pointer map */
     s->name2group = strmap_new();
@@ -3298,6 +5402,23 @@ session_init (int argc, char * argv[])
 
     const char* value;
 
+    /* a spawn proc started directly rather than through the env
+     * wrapper gets its id and parent address as its only argument,
+     * set them as the wrapper would have */
+    if (argc == 2 && strncmp(argv[1], SPAWN_CHILD_ARG, strlen(SPAWN_CHILD_ARG)) == 0) {
+        char* id = SPAWN_STRDUP(argv[1] + strlen(SPAWN_CHILD_ARG));
+        char* parent = strchr(id, ',');
+        if (parent == NULL) {
+            SPAWN_ERR("Invalid spawn child argument `%s'", argv[1]);
+            _exit(EXIT_FAILURE);
+        }
+        *parent = '\0';
+        parent++;
+        setenv("MV2_SPAWN_PARENT", parent, 1);
+        setenv("MV2_SPAWN_ID", id, 1);
+        spawn_free(&id);
+    }
+
     /* check whether we have a parent */
     if ((value = getenv("MV2_SPAWN_PARENT")) != NULL) {
         /* we have a parent, record its address */
@@ -3308,7 +5429,7 @@ session_init (int argc, char * argv[])
         s->ep = spawn_net_open(type);
         s->ep_name = spawn_net_name(s->ep);
     } else {
-        strmap * hostmap = strmap_new();
+        hostfile * hf = NULL;
         process_options(s, argc, argv);
 
         switch (s->options.error) {
@@ -3329,7 +5450,10 @@ session_init (int argc, char * argv[])
         }
 
         if (s->options.hostfile) {
-            read_hostfile(s->options.hostfile, hostmap);
+            hf = hostfile_read(s->options.hostfile);
+            if (hf == NULL) {
+                _exit(EXIT_FAILURE);
+            }
         }
 
         /* no parent, we are the root, create parameters strmap */
@@ -3355,11 +5479,89 @@ session_init (int argc, char * argv[])
             }
         }
 
-        /* check whether we should remote copy the launcher exe */
+        /* check whether we should emulate a cluster of this many
+         * nodes (including ourself) on this host, in which case we
+         * fork spawn procs rather than start them with rsh/ssh,
+         * MV2_SPAWN_SH=fork does the same with hosts from hostfile */
+        int virt_nodes = 0;
+        if ((value = getenv("MV2_SPAWN_VIRT_NODES")) != NULL) {
+            virt_nodes = atoi(value);
+        }
+        int virt = (virt_nodes > 0);
+        if ((value = getenv("MV2_SPAWN_SH")) != NULL &&
+            strcmp(value, KEY_SH_FORK) == 0)
+        {
+            virt = 1;
+        }
+
+        /* check whether we should remote copy the launcher exe, or
+         * have avaboot fetch it from its parent, there is no remote
+         * host to copy to in virtual mode */
         if ((value = getenv("MV2_SPAWN_COPY")) != NULL) {
-            copy_launcher = atoi(value);
+            if (strcmp(value, KEY_COPY_BOOT) == 0) {
+                copy_launcher = COPY_BOOT;
+            } else {
+                copy_launcher = atoi(value);
+            }
+        }
+        if (virt) {
+            copy_launcher = 0;
         }
         strmap_setf(s->params, "COPY=%d", copy_launcher);
+        if (copy_launcher == COPY_BOOT) {
+            if ((value = getenv("MV2_SPAWN_BOOT_EXE")) != NULL) {
+                strmap_set(s->params, "BOOTEXE", value);
+            } else {
+                strmap_set(s->params, "BOOTEXE", AVALAUNCH_BINDIR "/avaboot");
+            }
+        }
+
+        /* in virtual mode, check for usecs to stall each launch and
+         * each tree message and for bandwidth of tree links in MB/s */
+        if (virt) {
+            if ((value = getenv("MV2_SPAWN_VIRT_LAUNCH")) != NULL) {
+                virt_launch = atol(value);
+            }
+            if ((value = getenv("MV2_SPAWN_VIRT_LAT")) != NULL) {
+                virt_latency = atol(value);
+            }
+            if ((value = getenv("MV2_SPAWN_VIRT_BW")) != NULL) {
+                virt_bandwidth = atof(value);
+            }
+        }
+        strmap_setf(s->params, "VLAUNCH=%ld", virt_launch);
+        strmap_setf(s->params, "VLAT=%ld", virt_latency);
+        strmap_setf(s->params, "VBW=%f", virt_bandwidth);
+
+        /* check whether we should synchronize the tree around each
+         * launch phase to time it, set to 0 in production to let
+         * phases pipeline, each node then times its own phases and
+         * we report the max across nodes at the end */
+        if ((value = getenv("MV2_SPAWN_SYNC")) != NULL) {
+            sync_timers = atoi(value);
+        }
+        strmap_setf(s->params, "SYNC=%d", sync_timers);
+
+        /* check whether we should write a trace of each spawn
+         * proc's launch phases, value names the output file */
+        if ((value = getenv("MV2_SPAWN_TRACE")) != NULL) {
+            trace_file = SPAWN_STRDUP(value);
+            trace_enabled = 1;
+        }
+        strmap_setf(s->params, "TRACE=%d", trace_enabled);
+
+        /* check whether we should run extra phases that measure
+         * costs of the spawn tree, but do nothing for the launch */
+        if ((value = getenv("MV2_SPAWN_BENCH")) != NULL) {
+            bench_enabled = atoi(value);
+        }
+        strmap_setf(s->params, "BENCH=%d", bench_enabled);
+
+        /* check whether we should serve live launch status,
+         * value names the Unix-domain socket, only root needs it */
+        if ((value = getenv("MV2_SPAWN_STATUS")) != NULL) {
+            status_path = SPAWN_STRDUP(value);
+        }
 
         /* first, compute and record launch executable name */
         char* spawn_orig = argv[0];
@@ -3397,26 +5599,48 @@ session_init (int argc, char * argv[])
         s->ep_name = spawn_net_name(s->ep);
 
         /* then copy in each host from the command line */
-        const char* ptr_string = NULL;
-        strmap* entrymap = NULL;
-        size_t i, n = 1;
-
-        for (i = 0; NULL != (ptr_string = strmap_getf(hostmap, "%d", i)); i++) {
-            char * hostname = NULL;
-            int multiplier = 1;
+        size_t n = 1;
 
-            sscanf(ptr_string, "%p", &entrymap);
-            hostname = strmap_get(entrymap, "hostname");
-
-            ptr_string = strmap_get(entrymap, "multiplier");
-            if (ptr_string) {
-                sscanf(ptr_string, "%d", &multiplier);
+        /* every virtual node runs on this host */
+        if (virt_nodes > 0) {
+            char* hostname = spawn_hostname();
+            for (n = 1; n < (size_t) virt_nodes; n++) {
+                strmap_setf(s->hosts, "%d=%s", (int) n, hostname);
             }
+            spawn_free(&hostname);
+        }
+
+        /* each host gets one spawn proc, which starts as many app
+         * procs as the hostfile gives slots for that host, a host
+         * listed on several lines keeps the index of its first line
+         * and adds up its slots, counting lines without slots in L
+         * so each of those starts MV2_SPAWN_PPN procs */
+        if (virt_nodes == 0 && hf != NULL) {
+            strmap* seen = strmap_new();
+            int i;
+            for (i = 0; i < hf->count; i++) {
+                const hostfile_host* host = &hf->hosts[i];
+                int index = (int) n;
+                const char* first = strmap_get(seen, host->name);
+                if (first != NULL) {
+                    index = atoi(first);
+                } else {
+                    strmap_setf(seen, "%s=%d", host->name, index);
+                    strmap_setf(s->hosts, "%d=%s", index, host->name);
+                    n++;
+                }
 
-            while (multiplier--) {
-                strmap_setf(s->params, "%d=%s", n++, hostname);
+                const char* key = (host->slots > 0) ? "S" : "L";
+                int count = (host->slots > 0) ? host->slots : 1;
+                const char* prev = strmap_getf(s->hosts, "%s%d", key, index);
+                if (prev != NULL) {
+                    count += atoi(prev);
+                }
+                strmap_setf(s->hosts, "%s%d=%d", key, index, count);
             }
+            strmap_delete(&seen);
         }
+        hostfile_free(&hf);
 
         /* we include ourself as a host,
          * plus all hosts listed on command line */
@@ -3425,32 +5649,108 @@ session_init (int argc, char * argv[])
         
         /* list our own hostname as the first host */
         char* hostname = spawn_hostname();
-        strmap_setf(s->params, "%d=%s", 0, hostname);
+        strmap_setf(s->hosts, "%d=%s", 0, hostname);
         spawn_free(&hostname);
 
-        /* TODO: read this in from command line or via some other method */
+        /* unless disabled, tune tree shape, degree, and bcast chunk
+         * size from the profile of earlier launches of this size,
+         * explicit settings below still take precedence */
+        int autotune = 1;
+        if ((value = getenv("MV2_SPAWN_AUTOTUNE")) != NULL) {
+            autotune = atoi(value);
+        }
+        launch_model_choice choice;
+        int tuned = 0;
+        if (autotune) {
+            profile_file = profile_path(hosts, virt);
+            tuned = profile_recommend(s, hosts, &choice);
+            if (tuned) {
+                profile_chunk = choice.chunk;
+            }
+        }
+
         /* specify degree of tree */
         if ((value = getenv("MV2_SPAWN_DEGREE")) != NULL) {
             int degree = atoi(value);
             strmap_setf(s->params, "DEG=%d", degree);
+        } else if (tuned) {
+            strmap_setf(s->params, "DEG=%d", choice.degree);
         } else {
             strmap_setf(s->params, "DEG=%d", 2);
         }
         /* TODO: check that degree is >= 2 */
 
-        /* record the remote shell command (rsh or ssh) to start procs */
-        if ((value = getenv("MV2_SPAWN_SH")) != NULL) {
+        /* specify shape of tree */
+        if ((value = getenv("MV2_SPAWN_TREE")) != NULL) {
+            if (strcmp(value, KEY_TREE_KARY) != 0 &&
+                strcmp(value, KEY_TREE_KNOMIAL) != 0)
+            {
+                SPAWN_ERR("MV2_SPAWN_TREE must be either \"%s\" or \"%s\"",
+                    KEY_TREE_KARY, KEY_TREE_KNOMIAL);
+                _exit(EXIT_FAILURE);
+            }
+            strmap_setf(s->params, "TREE=%s", value);
+        } else if (tuned) {
+            strmap_setf(s->params, "TREE=%s", launch_model_shape_name(choice.shape));
+        } else {
+            strmap_setf(s->params, "TREE=%s", KEY_TREE_KARY);
+        }
+
+        /* report the tree and chunk size we ended up with, after the
+         * settings that take precedence over the profile */
+        if (tuned) {
+            char* chunk_str = getenv("MV2_SPAWN_BIN_CHUNK_SIZE");
+            if (chunk_str != NULL) {
+                chunk_str = SPAWN_STRDUP(chunk_str);
+            } else {
+                chunk_str = SPAWN_STRDUPF("%lu", (unsigned long) (profile_chunk >> 20));
+            }
+            SPAWN_DBG("Tuned launch from %s: tree=%s degree=%s chunk=%sMB",
+                profile_file, strmap_get(s->params, "TREE"),
+                strmap_get(s->params, "DEG"), chunk_str);
+            spawn_free(&chunk_str);
+        }
+
+        /* record the remote shell command (rsh or ssh) to start procs,
+         * or fork to start them on this host */
+        if (virt) {
+            strmap_set(s->params, "SH", KEY_SH_FORK);
+        } else if ((value = getenv("MV2_SPAWN_SH")) != NULL) {
             strmap_setf(s->params, "SH=%s", value);
         } else {
             strmap_setf(s->params, "SH=rsh");
         }
         value = strmap_get(s->params, "SH");
         if (strcmp(value, "ssh") != 0 &&
-            strcmp(value, "rsh") != 0)
+            strcmp(value, "rsh") != 0 &&
+            strcmp(value, KEY_SH_FORK) != 0)
+        {
+            SPAWN_ERR("MV2_SPAWN_SH must be one of \"ssh\", \"rsh\", or \"%s\"", KEY_SH_FORK);
+            _exit(EXIT_FAILURE);
+        }
+
+        /* detect whether remote spawn procs are started with a cd and
+         * env wrapper or directly, in which case they get the root's
+         * working dir from params after connecting back */
+        value = getenv("MV2_SPAWN_REMOTE");
+        if (value != NULL) {
+            strmap_set(s->params, "REMOTE", value);
+        } else {
+            strmap_set(s->params, "REMOTE", KEY_REMOTE_SHELL);
+        }
+        value = strmap_get(s->params, "REMOTE");
+        if (strcmp(value, KEY_REMOTE_SHELL)  != 0 &&
+            strcmp(value, KEY_REMOTE_DIRECT) != 0)
         {
-            SPAWN_ERR("MV2_SPAWN_SH must be either \"ssh\" or \"rsh\"");
+            SPAWN_ERR("MV2_SPAWN_REMOTE must be either \"%s\" or \"%s\"",
+                KEY_REMOTE_SHELL, KEY_REMOTE_DIRECT);
             _exit(EXIT_FAILURE);
         }
+        if (strcmp(value, KEY_REMOTE_DIRECT) == 0) {
+            char* cwd = spawn_getcwd();
+            strmap_set(s->params, "CWD", cwd);
+            spawn_free(&cwd);
+        }
 
         /* detect whether we should use direct exec vs shell wrapper to
          * start local procs */
@@ -3492,6 +5792,122 @@ session_init (int argc, char * argv[])
     return s;
 }
 
+/* Reads a rank map file, each line names the spawn proc that runs the
+ * next group rank as a hostname from the hostfile or as the index of
+ * the spawn proc in hostfile order, and may give a count of
+ * consecutive ranks to place there, e.g.,
+ *
+ *   node1:4
+ *   node2:4
+ *   3
+ *
+ * A hostname listed for more than one spawn proc names the first.
+ * Everything after a '#' is a comment.  Returns spawn proc of each rank
+ * and sets count to number of ranks, returns NULL after printing an
+ * error if the file can't be read or names an unknown host. */
+static int *
+mapfile_read (const session * s, const char * path, int * count)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        SPAWN_ERR("Failed to open rank map file `%s' (fopen errno=%d %s)",
+            path, errno, strerror(errno));
+        return NULL;
+    }
+
+    /* index spawn procs by hostname, first one wins */
+    int nodes = s->tree->ranks;
+    strmap* names = strmap_new();
+    int i;
+    for (i = nodes - 1; i >= 0; i--) {
+        const char* host = strmap_getf(s->hosts, "%d", i);
+        if (host != NULL) {
+            strmap_setf(names, "%s=%d", host, i);
+        }
+    }
+
+    int error = 0;
+    int size  = 0;
+    int cap   = 0;
+    int* rank_node = NULL;
+    int lineno = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+
+        /* strip comment and surrounding whitespace */
+        char* p = strchr(line, '#');
+        if (p != NULL) {
+            *p = '\0';
+        }
+        p = line;
+        while (isspace((unsigned char) *p)) {
+            p++;
+        }
+        char* end = p + strlen(p);
+        while (end > p && isspace((unsigned char) end[-1])) {
+            end--;
+        }
+        *end = '\0';
+        if (*p == '\0') {
+            continue;
+        }
+
+        /* split off count */
+        int n = 1;
+        char* colon = strchr(p, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+            n = atoi(colon + 1);
+        }
+
+        /* look up spawn proc by name, then by index */
+        int node = -1;
+        const char* node_str = strmap_get(names, p);
+        if (node_str != NULL) {
+            node = atoi(node_str);
+        } else if (strspn(p, "0123456789") == strlen(p)) {
+            node = atoi(p);
+        }
+        if (node < 0 || node >= nodes || n < 1) {
+            SPAWN_ERR("Error parsing rank map `%s' line %d - unknown host or bad count",
+                path, lineno);
+            error = 1;
+            break;
+        }
+
+        /* append n ranks on this spawn proc */
+        if (size + n > cap) {
+            cap = (size + n) * 2;
+            int* tmp = (int*) realloc(rank_node, cap * sizeof(int));
+            if (tmp == NULL) {
+                SPAWN_ERR("Failed to allocate rank map of %d ranks", cap);
+                error = 1;
+                break;
+            }
+            rank_node = tmp;
+        }
+        for (i = 0; i < n; i++) {
+            rank_node[size++] = node;
+        }
+    }
+
+    fclose(fp);
+    strmap_delete(&names);
+
+    if (error) {
+        spawn_free(&rank_node);
+        return NULL;
+    }
+    if (size == 0) {
+        SPAWN_ERR("Rank map `%s' lists no ranks", path);
+        return NULL;
+    }
+
+    *count = size;
+    return rank_node;
+}
+
 static uint64_t
 time_diff (struct timespec * end, struct timespec * start)
 {
@@ -3513,6 +5929,13 @@ session_start (session * s)
 
     call_stop_event_handler = 1;
 
+    /* root serves live status while we launch, if asked to */
+    if (status_path != NULL) {
+        if (status_start(status_path) != 0) {
+            spawn_free(&status_path);
+        }
+    }
+
     /**********************
      * Create spawn tree
      **********************/
@@ -3523,6 +5946,7 @@ session_start (session * s)
     struct timespec t_children_connect_start, t_children_connect_end;
     struct timespec t_children_params_start,  t_children_params_end;
 
+    status_phase("unfurl tree");
     tid_tree = begin_delta("unfurl tree");
 
     tid = begin_delta("connect back to parent");
@@ -3542,16 +5966,39 @@ session_start (session * s)
         /* read our pid */
         pid_t pid = getpid();
 
-        /* send our id */
+        /* send our id, noting time we sent it to sync our clock */
+        int64_t clock_sent = trace_now();
         strmap* idmap = strmap_new();
         strmap_set(idmap, "ID", s->spawn_id);
         strmap_setf(idmap, "PID=%ld", (long) pid);
         spawn_net_write_strmap(t->parent_ch, idmap);
         strmap_delete(&idmap);
 
-        /* read parameters */
+        /* read parameters, then hosts of our subtree */
         spawn_net_read_strmap(t->parent_ch, s->params);
+        strmap* hostmap = strmap_new();
+        spawn_net_read_strmap(t->parent_ch, hostmap);
+        if (tree_hosts_expand(hostmap, s->hosts) != 0) {
+            _exit(EXIT_FAILURE);
+        }
+        strmap_delete(&hostmap);
         clock_gettime(CLOCK_MONOTONIC_RAW, &t_parent_params_end);
+
+        /* parent follows params with the times on root's clock when
+         * it got our id and when it answered, estimate our offset */
+        strmap* clockmap = strmap_new();
+        spawn_net_read_strmap(t->parent_ch, clockmap);
+        int64_t clock_recv = trace_now();
+        const char* recv_str  = strmap_get(clockmap, "RECV");
+        const char* reply_str = strmap_get(clockmap, "REPLY");
+        if (recv_str != NULL && reply_str != NULL) {
+            int64_t parent_recv  = strtoll(recv_str,  NULL, 10);
+            int64_t parent_reply = strtoll(reply_str, NULL, 10);
+            int64_t offset = trace_estimate_offset(clock_sent,
+                parent_recv, parent_reply, clock_recv);
+            trace_set_offset(offset);
+        }
+        strmap_delete(&clockmap);
     } else {
         clock_gettime(CLOCK_MONOTONIC_RAW, &t_parent_connect_start);
         clock_gettime(CLOCK_MONOTONIC_RAW, &t_parent_connect_end);
@@ -3584,20 +6031,78 @@ session_start (session * s)
         int ranks = atoi(hosts);
 
         /* create the tree and get number of children */
-        if (!nodeid) { tid = begin_delta("tree_create_kary"); }
-        tree_create_kary(rank, ranks, degree, t);
-        if (!nodeid) { end_delta(tid); }
+        const char* shape = strmap_get(s->params, "TREE");
+        if (shape != NULL && strcmp(shape, KEY_TREE_KNOMIAL) == 0) {
+            tid = begin_delta("tree_create_knomial");
+            tree_create_knomial(rank, ranks, degree, t);
+            end_delta(tid);
+        } else {
+            tid = begin_delta("tree_create_kary");
+            tree_create_kary(rank, ranks, degree, t);
+            end_delta(tid);
+        }
 
         children = t->children;
     }
 
+    /* we'll track which spawn procs are up for status */
+    strmap* upmap = strmap_new();
+    if (status_path != NULL) {
+        strmap_setf(upmap, "%d=1", t->rank);
+        status_tree_levels(t, upmap, 1);
+        status_set_total(STATUS_SPAWN_UP, (uint64_t) t->ranks);
+        status_set_total(STATUS_CHILDREN_LAUNCHED,  (uint64_t) children);
+        status_set_total(STATUS_CHILDREN_CONNECTED, (uint64_t) children);
+    }
+
     /* determine whether we should copy launcher process to /tmp */
     const char* copy_str = strmap_get(s->params, "COPY");
     copy_launcher = atoi(copy_str);
 
+    /* determine whether we should synchronize to time each phase */
+    const char* sync_str = strmap_get(s->params, "SYNC");
+    sync_timers = atoi(sync_str);
+
+    /* determine whether we should gather a launch trace */
+    const char* trace_str = strmap_get(s->params, "TRACE");
+    trace_enabled = atoi(trace_str);
+
+    /* determine whether we should run phases that only measure costs */
+    const char* bench_str = strmap_get(s->params, "BENCH");
+    bench_enabled = atoi(bench_str);
+
+    /* read delays to inject in virtual cluster mode */
+    virt_launch    = atol(strmap_get(s->params, "VLAUNCH"));
+    virt_latency   = atol(strmap_get(s->params, "VLAT"));
+    virt_bandwidth = atof(strmap_get(s->params, "VBW"));
+
+    /* pick directory to stage bcast files, each spawn proc on a
+     * virtual cluster needs its own since they share /tmp */
+    const char* sh_str = strmap_get(s->params, "SH");
+    if (strcmp(sh_str, KEY_SH_FORK) == 0) {
+        spawn_tmpdir = SPAWN_STRDUPF("%s.%d", TMPDIR, nodeid);
+    } else {
+        spawn_tmpdir = SPAWN_STRDUP(TMPDIR);
+    }
+
     /* lookup spawn executable name */
     const char* spawn_exe = strmap_get(s->params, "EXE");
 
+    /* a proc started without the cd wrapper moves to the directory
+     * of the root itself */
+    const char* remote_str = strmap_get(s->params, "REMOTE");
+    int remote_direct = (strcmp(remote_str, KEY_REMOTE_DIRECT) == 0);
+    if (remote_direct && s->spawn_parent != NULL) {
+        const char* cwd_str = strmap_get(s->params, "CWD");
+        if (chdir(cwd_str) != 0) {
+            SPAWN_ERR("Failed to change to directory `%s' (chdir() errno=%d %s)",
+                cwd_str, errno, strerror(errno));
+            strmap_delete(&upmap);
+            session_destroy(s);
+            return -1;
+        }
+    }
+
     /* get the current working directory */
     char* spawn_cwd = spawn_getcwd();
 
@@ -3606,8 +6111,9 @@ session_start (session * s)
 
     /* rcp/scp the launcher executable to /tmp on remote hosts */
     clock_gettime(CLOCK_MONOTONIC_RAW, &t_copy_launcher_start);
-    if (copy_launcher) {
-        if (!nodeid) { tid = begin_delta("copy launcher exe"); }
+    if (copy_launcher == COPY_RCP) {
+        status_phase("copy launcher exe");
+        tid = begin_delta("copy launcher exe");
         pid_t* pids = (pid_t*) SPAWN_MALLOC(children * sizeof(pid_t));
 
         for (i = 0; i < children; i++) {
@@ -3615,9 +6121,10 @@ session_start (session * s)
             int child_rank = t->child_ranks[i];
 
             /* lookup hostname of child from parameters */
-            const char* host = strmap_getf(s->params, "%d", child_rank);
+            const char* host = strmap_getf(s->hosts, "%d", child_rank);
             if (host == NULL) {
                 spawn_free(&spawn_cwd);
+                strmap_delete(&upmap);
                 session_destroy(s);
                 return -1;
             }
@@ -3629,17 +6136,47 @@ session_start (session * s)
         /* wait for all copies to complete */
         for (i = 0; i < children; i++) {
             int status;
-            waitpid(pids[i], &status, 0);
+            if (pids[i] > 0) {
+                waitpid(pids[i], &status, 0);
+            }
         }
 
         spawn_free(&pids);
-        if (!nodeid) { end_delta(tid); }
+        end_delta(tid);
     }
     clock_gettime(CLOCK_MONOTONIC_RAW, &t_copy_launcher_end);
 
+    /* otherwise serve our own copy of the launcher to the avaboot
+     * stub we start on each child host in place of the launcher */
+    const char* boot_exe = NULL;
+    if (copy_launcher == COPY_BOOT && children > 0) {
+        boot_exe = strmap_get(s->params, "BOOTEXE");
+        /* only our children may fetch the launcher, a child without
+         * a host fails in the launch loop below */
+        const char** child_hosts = (const char**) SPAWN_MALLOC(children * sizeof(char*));
+        int child_hosts_count = 0;
+        for (i = 0; i < children; i++) {
+            const char* host = strmap_getf(s->hosts, "%d", t->child_ranks[i]);
+            if (host != NULL) {
+                child_hosts[child_hosts_count++] = host;
+            }
+        }
+        char* hostname = spawn_hostname();
+        int rc = boot_start(spawn_exe, hostname, child_hosts, child_hosts_count);
+        spawn_free(&hostname);
+        spawn_free(&child_hosts);
+        if (rc != 0) {
+            spawn_free(&spawn_cwd);
+            strmap_delete(&upmap);
+            session_destroy(s);
+            return -1;
+        }
+    }
+
     /* launch children */
     clock_gettime(CLOCK_MONOTONIC_RAW, &t_children_launch_start);
-    if (!nodeid) { tid = begin_delta("launch children"); }
+    status_phase("launch children");
+    tid = begin_delta("launch children");
     for (i = 0; i < children; i++) {
         /* get rank of child */
         int child_rank = t->child_ranks[i];
@@ -3648,17 +6185,31 @@ session_start (session * s)
         strmap_setf(childmap, "%d=%d", child_rank, i);
 
         /* lookup hostname of child from parameters */
-        const char* host = strmap_getf(s->params, "%d", child_rank);
+        const char* host = strmap_getf(s->hosts, "%d", child_rank);
         if (host == NULL) {
+            boot_stop();
             spawn_free(&spawn_cwd);
+            strmap_delete(&upmap);
             session_destroy(s);
             return -1;
         }
 
-        /* build map of arguments */
+        /* build map of arguments, in direct mode the child learns its
+         * id and our address from its only argument, and with boot,
+         * avaboot runs first and execs the launcher with the rest */
         strmap* argmap = strmap_new();
-        strmap_setf(argmap, "ARG0=%s", spawn_exe);
-        strmap_setf(argmap, "ARGS=%d", 1);
+        int args = 0;
+        const char* exe = spawn_exe;
+        if (boot_exe != NULL) {
+            exe = boot_exe;
+            strmap_setf(argmap, "ARG%d=%s", args++, boot_exe);
+            strmap_setf(argmap, "ARG%d=%s", args++, boot_addr());
+        }
+        strmap_setf(argmap, "ARG%d=%s", args++, spawn_exe);
+        if (remote_direct) {
+            strmap_setf(argmap, "ARG%d=%s%d,%s", args++, SPAWN_CHILD_ARG, child_rank, s->ep_name);
+        }
+        strmap_setf(argmap, "ARGS=%d", args);
 
         /* build map of environment variables */
         strmap* envmap = strmap_new();
@@ -3667,15 +6218,16 @@ session_start (session * s)
         strmap_setf(envmap, "ENVS=%d", 2);
 
         /* launch child process */
-        pid_t pid = fork_proc(host, s->params, spawn_cwd, spawn_exe, argmap, envmap);
+        pid_t pid = launch_proc(host, s->params, spawn_cwd, exe, argmap, envmap, NULL);
         t->child_hosts[i] = SPAWN_STRDUP(host);
         t->child_pids[i]  = pid;
+        status_add(STATUS_CHILDREN_LAUNCHED, 1);
 
         /* free the maps */
         strmap_delete(&envmap);
         strmap_delete(&argmap);
     }
-    if (!nodeid) { end_delta(tid); }
+    end_delta(tid);
     spawn_free(&spawn_cwd);
     clock_gettime(CLOCK_MONOTONIC_RAW, &t_children_launch_end);
 
@@ -3686,28 +6238,44 @@ session_start (session * s)
      */
 
     spawn_net_channel** chs = (spawn_net_channel**) SPAWN_MALLOC(children * sizeof(spawn_net_channel*));
+    strmap** idmaps = (strmap**) SPAWN_MALLOC(children * sizeof(strmap*));
+    int64_t* clock_recvs = (int64_t*) SPAWN_MALLOC(children * sizeof(int64_t));
 
     clock_gettime(CLOCK_MONOTONIC_RAW, &t_children_connect_start);
-    if (!nodeid) { tid = begin_delta("accept children"); }
+    status_phase("accept children");
+    tid = begin_delta("accept children");
     for (i = 0; i < children; i++) {
         /* TODO: would be good to authenticate connections as they are
          * made.  However, for now we just accept as fast as possible */
         chs[i] = spawn_net_accept(s->ep);
+
+        /* read child's id as soon as it connects, so the time we
+         * note for its clock sync is when the id arrived rather
+         * than when we get around to answering it below */
+        idmaps[i] = strmap_new();
+        spawn_net_read_strmap(chs[i], idmaps[i]);
+        clock_recvs[i] = trace_now();
+
+        status_add(STATUS_CHILDREN_CONNECTED, 1);
     }
-    if (!nodeid) { end_delta(tid); }
+    end_delta(tid);
     clock_gettime(CLOCK_MONOTONIC_RAW, &t_children_connect_end);
 
+    /* every child booted before it connected back */
+    boot_stop();
+
     clock_gettime(CLOCK_MONOTONIC_RAW, &t_children_params_start);
-    if (!nodeid) { tid = begin_delta("send params to children"); }
+    status_phase("send params to children");
+    tid = begin_delta("send params to children");
     for (i = 0; i < children; i++) {
         /* TODO: once we determine which child we're accepting,
          * save pointer to connection in tree structure */
         /* accept child connection */
         spawn_net_channel* ch = chs[i];
 
-        /* read strmap from child */
-        strmap* idmap = strmap_new();
-        spawn_net_read_strmap(ch, idmap);
+        /* take strmap we read from child when it connected */
+        strmap* idmap = idmaps[i];
+        int64_t clock_recv = clock_recvs[i];
 
         /* read global id from child */
         const char* str = strmap_get(idmap, "ID");
@@ -3731,20 +6299,43 @@ session_start (session * s)
         /* record channel for child */
         t->child_chs[index] = ch;
 
-        /* send parameters to child */
+        /* send parameters to child, followed by just the hosts in
+         * its subtree rather than the whole host table */
+        strmap* hostmap = strmap_new();
+        tree_subtree_hosts(t, t->child_ranks[index], s->hosts, hostmap);
+        virt_strmap_delay(s->params, hostmap);
         spawn_net_write_strmap(ch, s->params);
+        spawn_net_write_strmap(ch, hostmap);
+        strmap_delete(&hostmap);
+
+        /* send times on root's clock when we got child's id and when
+         * we answered, so child can sync its clock to root's */
+        strmap* clockmap = strmap_new();
+        strmap_setf(clockmap, "RECV=%lld",  (long long) clock_recv);
+        strmap_setf(clockmap, "REPLY=%lld", (long long) trace_now());
+        spawn_net_write_strmap(ch, clockmap);
+        strmap_delete(&clockmap);
+
+        /* child has its params, count it as up */
+        if (status_path != NULL) {
+            strmap_setf(upmap, "%d=1", t->child_ranks[index]);
+            status_tree_levels(t, upmap, 1);
+        }
     }
-    if (!nodeid) { end_delta(tid); }
+    end_delta(tid);
     clock_gettime(CLOCK_MONOTONIC_RAW, &t_children_params_end);
 
+    spawn_free(&clock_recvs);
+    spawn_free(&idmaps);
     spawn_free(&chs);
 
     /* delete child global-to-local id map */
     strmap_delete(&childmap);
+    strmap_delete(&upmap);
 
     /* signal root to let it know tree is done */
-    signal_to_root(s);
-    if (!nodeid) { end_delta(tid_tree); }
+    sync_to_root(s);
+    end_delta(tid_tree);
 
     /**********************
      * Gather pids for all spawn procs
@@ -3754,13 +6345,17 @@ session_start (session * s)
     strmap* spawnproc_strmap = strmap_new();
 
     /* wait for signal from root before we start to gather proc info */
-    if (!nodeid) { tid = begin_delta("gather spawn pids **"); }
-    signal_from_root(s);
+    status_phase("gather spawn pids");
+    tid = begin_delta("gather spawn pids **");
+    sync_from_root(s);
     pid_t pid = getpid();
     strmap_setf(spawnproc_strmap, "%d=%ld", s->tree->rank, (long)pid);
     gather_strmap(spawnproc_strmap, s->tree);
-    signal_to_root(s);
-    if (!nodeid) { end_delta(tid); }
+    sync_to_root(s);
+    end_delta(tid);
+
+    /* root now has an entry for every spawn proc in the tree */
+    status_tree_levels(t, spawnproc_strmap, t->ranks);
 
     if (nodeid == 0) {
 //        printf("Spawn pid map:\n");
@@ -3782,7 +6377,7 @@ session_start (session * s)
                 MPIR_PROCDESC* desc = &MPIR_proctable[i];
 
                 /* fill in host name */
-                const char* host = strmap_getf(s->params, "%d", i);
+                const char* host = strmap_getf(s->hosts, "%d", i);
                 desc->host_name = (char*) host;
 
                 /* fill in exe name */
@@ -3805,63 +6400,10 @@ session_start (session * s)
 
     strmap_delete(&spawnproc_strmap);
 
-    /**********************
-     * Gather endpoints of all spawns and measure some other costs
-     * (unnecessary, but interesting to measure anyway)
-     **********************/
-
-    /* wait for signal from root before we start spawn ep exchange */
-    if (!nodeid) { tid = begin_delta("spawn endpoint exchange **"); }
-    signal_from_root(s);
-
-    /* add our endpoint into strmap and do an allgather */
-    strmap* spawnep_strmap = strmap_new();
-    strmap_setf(spawnep_strmap, "%d=%s", s->tree->rank, s->ep_name);
-    allgather_strmap(spawnep_strmap, s->tree);
-
-    /* signal root to let it know spawn ep bcast has completed */
-    signal_to_root(s);
-    if (!nodeid) { end_delta(tid); }
-
-    /* print map from rank 0 */
-    if (nodeid == 0) {
-//        printf("Spawn endpoints map:\n");
-//        strmap_print(spawnep_strmap);
-//        printf("\n");
-    }
-
-#if 1
-    /* measure pack/unpack cost of strmap */
-    if (nodeid == 0) {
-        if (!nodeid) { tid = begin_delta("pack/unpack strmap x1000 **"); }
-        for (i = 0; i < 1000; i++) {
-            size_t pack_size = strmap_pack_size(spawnep_strmap);
-            void* pack_buf = SPAWN_MALLOC(pack_size);
-
-            strmap_pack(pack_buf, spawnep_strmap);
-
-            strmap* tmpmap = strmap_new();
-            strmap_unpack(pack_buf, tmpmap);
-            strmap_delete(&tmpmap);
-
-            spawn_free(&pack_buf);
-        }
-        if (!nodeid) { end_delta(tid); }
-    }
-#endif
-
-    strmap_delete(&spawnep_strmap);
-
-#if 1
-    /* measure cost of signal propagation */
-    signal_from_root(s);
-    if (!nodeid) { tid = begin_delta("signal costs x1000 **"); }
-    for (i = 0; i < 1000; i++) {
-        signal_to_root(s);
-        signal_from_root(s);
+    /* measure costs that don't matter to a launch, only if asked */
+    if (bench_enabled) {
+        measure_costs(s);
     }
-    if (!nodeid) { end_delta(tid); }
-#endif
 
     /**********************
      * Create app procs
@@ -3884,14 +6426,87 @@ session_start (session * s)
         strmap_set(appmap, "CWD", appcwd);
         spawn_free(&appcwd);
 
-        /* set number of procs each spawn should start */
+        /* set number of procs each spawn should start, hosts with
+         * slots in the hostfile start that many plus MV2_SPAWN_PPN
+         * for each of their lines without slots, others start
+         * MV2_SPAWN_PPN, list this for each spawn proc in rank order */
+        int ppn = 1;
         char* value = getenv("MV2_SPAWN_PPN");
         if (value != NULL) {
-            strmap_set(appmap, "PPN", value);
+            ppn = atoi(value);
+        }
+        int nodes = s->tree->ranks;
+        int* ppns = (int*) SPAWN_MALLOC(nodes * sizeof(int));
+        for (i = 0; i < nodes; i++) {
+            const char* slots = strmap_getf(s->hosts, "S%d", i);
+            const char* lines = strmap_getf(s->hosts, "L%d", i);
+            if (slots == NULL && lines == NULL) {
+                ppns[i] = ppn;
+                continue;
+            }
+            ppns[i] = 0;
+            if (slots != NULL) {
+                ppns[i] += atoi(slots);
+            }
+            if (lines != NULL) {
+                ppns[i] += atoi(lines) * ppn;
+            }
+        }
+
+        /* pick how ranks are mapped to procs, a map file sets the
+         * number of procs on each spawn proc by itself */
+        value = getenv("MV2_SPAWN_MAPFILE");
+        if (value != NULL) {
+            int count;
+            int* rank_node = mapfile_read(s, value, &count);
+            if (rank_node == NULL) {
+                _exit(EXIT_FAILURE);
+            }
+            for (i = 0; i < nodes; i++) {
+                ppns[i] = 0;
+            }
+            for (i = 0; i < count; i++) {
+                ppns[rank_node[i]]++;
+            }
+            char* rank_list = hostlist_encode_ints(rank_node, count);
+            strmap_set(appmap, "MAP", KEY_MAP_FILE);
+            strmap_set(appmap, "RANKMAP", rank_list);
+            spawn_free(&rank_list);
+            spawn_free(&rank_node);
+        } else if ((value = getenv("MV2_SPAWN_MAP")) != NULL) {
+            strmap_set(appmap, "MAP", value);
+        } else {
+            strmap_set(appmap, "MAP", KEY_MAP_BLOCK);
+        }
+
+        /* detect how app procs should be bound */
+        value = getenv("MV2_SPAWN_BIND");
+        if (value != NULL) {
+            strmap_set(appmap, "BIND", value);
         } else {
-            strmap_set(appmap, "PPN", "1");
+            strmap_set(appmap, "BIND", "none");
+        }
+        value = getenv("MV2_SPAWN_BIND_REPORT");
+        if (value != NULL) {
+            strmap_set(appmap, "BIND_REPORT", value);
+        }
+
+        /* detect whether we should fork app procs from a zygote */
+        value = getenv("MV2_SPAWN_ZYGOTE");
+        if (value != NULL && atoi(value) != 0) {
+            value = getenv("MV2_SPAWN_ZYGOTE_LIB");
+            if (value != NULL) {
+                strmap_set(appmap, "ZYGOTE", value);
+            } else {
+                strmap_set(appmap, "ZYGOTE", AVALAUNCH_LIBDIR "/libavazygote.so");
+            }
         }
 
+        char* ppn_list = hostlist_encode_ints(ppns, nodes);
+        strmap_set(appmap, "PPN", ppn_list);
+        spawn_free(&ppn_list);
+        spawn_free(&ppns);
+
         /* detect whether we should run PMI */
         value = getenv("MV2_SPAWN_PMI");
         if (value != NULL) {
@@ -3921,7 +6536,8 @@ session_start (session * s)
         if (value != NULL) {
             strmap_set(appmap, "BCAST_BIN_CHUNK_SZ", value);
         } else {
-            strmap_set(appmap, "BCAST_BIN_CHUNK_SZ", "0");
+            /* use tuned chunk size if we have one, 0 for whole file */
+            strmap_setf(appmap, "BCAST_BIN_CHUNK_SZ=%d", (int) (profile_chunk >> 20));
         }
 
         /* define bcast directory */
@@ -3982,10 +6598,11 @@ session_start (session * s)
     }
 
     /* broadcast parameters to start app procs */
-    if (!nodeid) { tid = begin_delta("broadcast app params"); }
+    status_phase("broadcast app params");
+    tid = begin_delta("broadcast app params");
     bcast_strmap(appmap, s->tree);
-    signal_to_root(s);
-    if (!nodeid) { end_delta(tid); }
+    sync_to_root(s);
+    end_delta(tid);
 
     /* start the application processes if we have an executable */
     const char* appexe = strmap_get(appmap, "EXE");
@@ -4031,8 +6648,37 @@ session_destroy (session * s)
     }
 
     /* wait until we get the go ahead from root */
+    status_phase("teardown");
     signal_from_root(s);
 
+    /* collect phase times of all spawn procs */
+    reduce_deltas(s);
+
+    /* fold costs of this launch into the profile for the next one */
+    if (!nodeid) {
+        profile_update(s);
+    }
+
+    /* gather launch phases of all spawn procs and write trace */
+    if (trace_enabled) {
+        char* host = spawn_hostname();
+        int parent = tree_parent(t, nodeid);
+        size_t size;
+        void* buf = trace_pack(nodeid, parent, host, &size);
+
+        void* all;
+        size_t all_size;
+        gather_bytes(buf, size, t, &all, &all_size);
+        if (!nodeid) {
+            trace_write(trace_file, all, all_size);
+            trace_critical_path(all, all_size, TRACE_TOP_CONTRIBUTORS, stdout);
+            spawn_free(&all);
+        }
+
+        spawn_free(&buf);
+        spawn_free(&host);
+    }
+
     /* tear down our tree connections */
     if (!nodeid) { tid = begin_delta("disconnect tree (root cost)"); }
     tree_disconnect(s->tree);
@@ -4055,17 +6701,25 @@ session_destroy (session * s)
     while (children > get_num_exited());
     if (!nodeid) { end_delta(tid); }
 
+    /* launch is over, stop serving status */
+    status_stop();
+
     /* free tree data structure */
     tree_delete(&(s->tree));
     spawn_free(&(s->spawn_id));
     spawn_free(&(s->spawn_parent));
 
     strmap_delete(&(s->params));
+    strmap_delete(&(s->hosts));
     strmap_delete(&(s->name2group));
     strmap_delete(&(s->pid2name));
     strmap_delete(&(s->appmap));
 
     spawn_free(&(s->options.hostfile));
+    spawn_free(&trace_file);
+    spawn_free(&status_path);
+    spawn_free(&spawn_tmpdir);
+    spawn_free(&profile_file);
 
     spawn_free(&s);
 
@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+#define _GNU_SOURCE
+#include <status.h>
+
+#include "spawn.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* how long server thread waits for a client before checking
+ * whether it should exit, in msecs */
+#define STATUS_POLL_MSECS (250)
+
+/* size of buffer used to format a snapshot */
+#define STATUS_BUF_SIZE (8192)
+
+/* All values are written by the main thread or the PMI server
+ * thread and read by the status thread, so every access goes
+ * through an atomic builtin.  A snapshot is not taken under a lock,
+ * so two counters in the same snapshot may be a few updates apart. */
+static uint64_t counters[STATUS_COUNT];
+static uint64_t totals[STATUS_COUNT];
+static uint64_t level_up[STATUS_MAX_LEVELS];
+static uint64_t level_total[STATUS_MAX_LEVELS];
+
+static const char* phase = "start"; /* label of current phase */
+static int64_t phase_begin = 0;     /* time current phase started */
+static int64_t status_begin = 0;    /* time status was started */
+
+static int listen_fd = -1;        /* socket clients connect to */
+static char* socket_path = NULL;  /* path of socket */
+static pthread_t status_thread;   /* thread serving the socket */
+static int status_running = 0;    /* set to 0 to stop the thread */
+
+/* labels printed for each counter */
+static const char* counter_names[STATUS_COUNT] = {
+    "root children launched",
+    "root children connected",
+    "spawn procs up",
+    "root app procs launched",
+    "root app procs in pmi init",
+    "pmi barrier arrivals",
+    "pmi fences completed",
+    "pmi ring arrivals",
+    "pmi rings completed",
+    "bytes broadcast",
+};
+
+/* returns current time in nsecs */
+static int64_t
+status_now (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + (int64_t) ts.tv_nsec;
+}
+
+/* format a snapshot of all values into buf */
+static size_t
+status_format (char * buf, size_t bufsize)
+{
+    size_t n = 0;
+    int64_t now = status_now();
+
+    /* current phase and how long we've been in it */
+    const char* label = __atomic_load_n(&phase, __ATOMIC_ACQUIRE);
+    int64_t begin = __atomic_load_n(&phase_begin, __ATOMIC_RELAXED);
+    n += snprintf(buf + n, bufsize - n, "phase: %s (%.3f secs)\n",
+        label, (double) (now - begin) / 1.0e9);
+    n += snprintf(buf + n, bufsize - n, "elapsed: %.3f secs\n",
+        (double) (now - status_begin) / 1.0e9);
+
+    /* counters, along with the value we expect them to reach */
+    int i;
+    for (i = 0; i < STATUS_COUNT && n < bufsize; i++) {
+        uint64_t val   = __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+        uint64_t total = __atomic_load_n(&totals[i],   __ATOMIC_RELAXED);
+        if (total > 0) {
+            n += snprintf(buf + n, bufsize - n, "%s: %llu / %llu\n",
+                counter_names[i], (unsigned long long) val,
+                (unsigned long long) total);
+        } else {
+            n += snprintf(buf + n, bufsize - n, "%s: %llu\n",
+                counter_names[i], (unsigned long long) val);
+        }
+    }
+
+    /* spawn procs up at each level of the tree */
+    for (i = 0; i < STATUS_MAX_LEVELS && n < bufsize; i++) {
+        uint64_t total = __atomic_load_n(&level_total[i], __ATOMIC_RELAXED);
+        if (total == 0) {
+            continue;
+        }
+        uint64_t up = __atomic_load_n(&level_up[i], __ATOMIC_RELAXED);
+        n += snprintf(buf + n, bufsize - n, "level %d%s: %llu / %llu up\n",
+            i, (i == STATUS_MAX_LEVELS - 1) ? "+" : "",
+            (unsigned long long) up, (unsigned long long) total);
+    }
+
+    if (n > bufsize) {
+        n = bufsize;
+    }
+    return n;
+}
+
+/* write len bytes from buf to fd, giving up if the client goes away */
+static void
+status_write (int fd, const char * buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t rc = write(fd, buf, len);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        buf += rc;
+        len -= (size_t) rc;
+    }
+    return;
+}
+
+/* accept clients and write each one a snapshot until told to stop */
+static void *
+status_thread_main (void * arg)
+{
+    char* buf = (char*) SPAWN_MALLOC(STATUS_BUF_SIZE);
+
+    while (__atomic_load_n(&status_running, __ATOMIC_ACQUIRE)) {
+        /* wait a bit for a client so we notice when to stop */
+        struct pollfd pfd;
+        pfd.fd      = listen_fd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        int rc = poll(&pfd, 1, STATUS_POLL_MSECS);
+        if (rc <= 0) {
+            continue;
+        }
+
+        /* children are forked while we serve, keep clients out of them */
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+
+        size_t len = status_format(buf, STATUS_BUF_SIZE);
+        status_write(fd, buf, len);
+        close(fd);
+    }
+
+    spawn_free(&buf);
+    return NULL;
+}
+
+int
+status_start (const char * path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        SPAWN_ERR("Status socket path too long: `%s'", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    /* time everything from here */
+    status_begin = status_now();
+    __atomic_store_n(&phase_begin, status_begin, __ATOMIC_RELAXED);
+
+    /* remove socket left over from an earlier run */
+    unlink(path);
+
+    /* close on exec so rsh/ssh procs we start for children don't
+     * inherit the socket and hold it open for the whole job */
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        SPAWN_ERR("Failed to create status socket (%s)", strerror(errno));
+        return 1;
+    }
+
+    if (bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, 8) != 0)
+    {
+        SPAWN_ERR("Failed to open status socket: `%s' (%s)", path, strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        return 1;
+    }
+
+    socket_path = SPAWN_STRDUP(path);
+
+    __atomic_store_n(&status_running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&status_thread, NULL, status_thread_main, NULL) != 0) {
+        SPAWN_ERR("Failed to start status thread");
+        status_running = 0;
+        close(listen_fd);
+        listen_fd = -1;
+        unlink(socket_path);
+        spawn_free(&socket_path);
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+status_stop (void)
+{
+    if (listen_fd < 0) {
+        return;
+    }
+
+    /* thread notices this within one poll interval */
+    __atomic_store_n(&status_running, 0, __ATOMIC_RELEASE);
+    pthread_join(status_thread, NULL);
+
+    close(listen_fd);
+    listen_fd = -1;
+
+    unlink(socket_path);
+    spawn_free(&socket_path);
+
+    return;
+}
+
+void
+status_phase (const char * label)
+{
+    __atomic_store_n(&phase_begin, status_now(), __ATOMIC_RELAXED);
+    __atomic_store_n(&phase, label, __ATOMIC_RELEASE);
+    return;
+}
+
+void
+status_add (status_counter c, uint64_t n)
+{
+    __atomic_add_fetch(&counters[c], n, __ATOMIC_RELAXED);
+    return;
+}
+
+void
+status_set (status_counter c, uint64_t n)
+{
+    __atomic_store_n(&counters[c], n, __ATOMIC_RELAXED);
+    return;
+}
+
+void
+status_set_total (status_counter c, uint64_t n)
+{
+    __atomic_store_n(&totals[c], n, __ATOMIC_RELAXED);
+    return;
+}
+
+void
+status_level (int level, uint64_t up, uint64_t total)
+{
+    if (level >= STATUS_MAX_LEVELS) {
+        level = STATUS_MAX_LEVELS - 1;
+    }
+    __atomic_store_n(&level_up[level],    up,    __ATOMIC_RELAXED);
+    __atomic_store_n(&level_total[level], total, __ATOMIC_RELAXED);
+    return;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* Live launch status: the launcher bumps a set of counters and
+ * names its current phase as it runs.  On the root, a thread serves
+ * these on a Unix-domain socket, each client that connects gets a
+ * text snapshot and the socket is closed, e.g.,
+ *
+ *   socat - UNIX-CONNECT:/tmp/avalaunch.sock
+ *
+ * Counters for the whole tree are only as fresh as the last tree
+ * message that carried a subtree count up to the root.  While the
+ * tree unfurls, the root only hears from its own children, so the
+ * spawn procs up and the levels listed cover just the top two levels
+ * until the spawn pid gather that follows reports every spawn proc. */
+
+#ifndef SPAWN_STATUS_H
+#define SPAWN_STATUS_H 1
+
+#include <stdint.h>
+
+typedef enum status_counter_types {
+    STATUS_CHILDREN_LAUNCHED = 0, /* spawn children forked by root */
+    STATUS_CHILDREN_CONNECTED,    /* spawn children connected to root */
+    STATUS_SPAWN_UP,              /* spawn procs the root knows to be up */
+    STATUS_APPS_LAUNCHED,         /* app procs forked by root */
+    STATUS_PMI_INIT,              /* app procs on root that sent init */
+    STATUS_PMI_BARRIER,           /* arrivals in fence in progress */
+    STATUS_PMI_FENCES,            /* fences completed */
+    STATUS_PMI_RING,              /* arrivals in ring in progress */
+    STATUS_PMI_RINGS,             /* ring exchanges completed */
+    STATUS_BCAST_BYTES,           /* bytes broadcast from root */
+    STATUS_COUNT,
+} status_counter;
+
+/* max number of tree levels we track, deeper levels are
+ * counted in the last one */
+#define STATUS_MAX_LEVELS (32)
+
+/* open socket at path and start thread to serve it,
+ * returns 0 on success */
+int status_start (const char * path);
+
+/* stop thread, close socket, and remove it */
+void status_stop (void);
+
+/* record name of current phase, label must stay valid until the
+ * next call (string literals are fine) */
+void status_phase (const char * label);
+
+/* add n to counter, set counter to n, and set the value a counter
+ * is expected to reach (0 if unknown) */
+void status_add (status_counter c, uint64_t n);
+void status_set (status_counter c, uint64_t n);
+void status_set_total (status_counter c, uint64_t n);
+
+/* set number of spawn procs up and expected at given tree level */
+void status_level (int level, uint64_t up, uint64_t total);
+
+#endif
@@ -9,21 +9,39 @@
  * Please also read the LICENSE file.
 */
 
+#include <timer_util.h>
+
 #include <time.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <search.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 
 #define max_timestamps 200
 
+/* deltas live in an array that we grow as needed, so each spawn proc
+ * can record every phase it runs through, however many there are */
 static struct delta_t {
     struct timespec begin;
     struct timespec end;
     const char * label;
     int shift;
-} timestamp_deltas[max_timestamps];
+    delta_stats stats; /* time across spawn procs, if stats_set */
+    int stats_set;     /* 1 if stats holds reduced values */
+    uint64_t usage_begin[DELTA_USAGE_COUNT]; /* counters at begin */
+    uint64_t usage_end[DELTA_USAGE_COUNT];   /* counters at end */
+    int usage_valid;                         /* 1 if we sampled counters */
+    uint64_t usage_sum[DELTA_USAGE_COUNT];   /* total across spawn procs, if usage_set */
+    uint64_t usage_max[DELTA_USAGE_COUNT];   /* max across spawn procs, if usage_set */
+    int usage_set;                           /* 1 if usage_sum/max hold reduced values */
+} * timestamp_deltas = NULL;
 
 static size_t current_timestamp_delta = 0;
 static size_t current_timestamp_shift = 0;
+static size_t capacity_timestamp_delta = 0;
 
 static struct timestamp_t {
     struct timespec ts;
@@ -31,34 +49,528 @@ static struct timestamp_t {
 } timestamps[max_timestamps];
 
 static size_t current_timestamp = 0;
-static double delta[max_timestamps];
 
-static double delta_avg[max_timestamps];
-static double delta_min[max_timestamps];
-static double delta_max[max_timestamps];
+static int have_delta_stats = 0; /* 1 if any delta has reduced values */
+static int have_delta_usage = 0; /* 1 if any delta has reduced usage */
+
+/* column headers for usage counters, in order of delta_usage_type */
+static const char * usage_names[DELTA_USAGE_COUNT] = {
+    "minflt", "majflt", "nvcsw", "nivcsw",
+    "inblock", "oublock", "rd KB", "wr KB",
+};
+
+/* read a counter from /proc/self/io, which is only available when
+ * the kernel has task I/O accounting, return 0 if we can't find it */
+static uint64_t
+proc_io_value (const char * buf, const char * name)
+{
+    const char * ptr = strstr(buf, name);
+    if (ptr == NULL) {
+        return 0;
+    }
+    return strtoull(ptr + strlen(name), NULL, 10);
+}
+
+/* snapshot resource usage of this process (all threads) */
+static void
+sample_usage (uint64_t * usage)
+{
+    memset(usage, 0, DELTA_USAGE_COUNT * sizeof(uint64_t));
+
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+        usage[DELTA_USAGE_MINFLT]  = (uint64_t) ru.ru_minflt;
+        usage[DELTA_USAGE_MAJFLT]  = (uint64_t) ru.ru_majflt;
+        usage[DELTA_USAGE_NVCSW]   = (uint64_t) ru.ru_nvcsw;
+        usage[DELTA_USAGE_NIVCSW]  = (uint64_t) ru.ru_nivcsw;
+        usage[DELTA_USAGE_INBLOCK] = (uint64_t) ru.ru_inblock;
+        usage[DELTA_USAGE_OUBLOCK] = (uint64_t) ru.ru_oublock;
+    }
+
+    /* bytes this process caused to be fetched from or sent to
+     * storage, a page cache miss on the shared file system shows up
+     * here even when the block counters above stay at zero */
+    FILE * fp = fopen("/proc/self/io", "r");
+    if (fp != NULL) {
+        char buf[512];
+        size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+        buf[n] = '\0';
+        fclose(fp);
+        usage[DELTA_USAGE_RBYTES] = proc_io_value(buf, "\nread_bytes:");
+        usage[DELTA_USAGE_WBYTES] = proc_io_value(buf, "\nwrite_bytes:");
+    }
+}
+
+/* returns id of a new zeroed delta slot, or -1 if out of memory */
+static int
+new_delta (void)
+{
+    if (current_timestamp_delta == capacity_timestamp_delta) {
+        size_t capacity = capacity_timestamp_delta ?
+            capacity_timestamp_delta * 2 : max_timestamps;
+        struct delta_t * deltas = realloc(timestamp_deltas,
+                capacity * sizeof(struct delta_t));
+        if (deltas == NULL) {
+            return -1;
+        }
+        timestamp_deltas = deltas;
+        capacity_timestamp_delta = capacity;
+    }
+
+    struct delta_t * d = &timestamp_deltas[current_timestamp_delta];
+    d->begin.tv_sec  = 0;
+    d->begin.tv_nsec = 0;
+    d->end.tv_sec    = 0;
+    d->end.tv_nsec   = 0;
+    d->label   = NULL;
+    d->shift   = 0;
+    d->stats_set = 0;
+    d->usage_valid = 0;
+    d->usage_set   = 0;
 
-static size_t delta_index[max_timestamps];
-static size_t delta_shift[max_timestamps];
+    return current_timestamp_delta++;
+}
 
 int
 begin_delta (const char * label)
 {
-    if (!(current_timestamp_delta < max_timestamps)) {
+    int delta_id = new_delta();
+    if (delta_id < 0) {
         return -1;
     }
 
-    clock_gettime(CLOCK_MONOTONIC_RAW,
-            &timestamp_deltas[current_timestamp_delta].begin);
-    timestamp_deltas[current_timestamp_delta].label = label;
-    timestamp_deltas[current_timestamp_delta].shift = current_timestamp_shift++;
-    return current_timestamp_delta++;
+    /* sample usage before the clock so the cost of sampling
+     * doesn't land in the delta */
+    sample_usage(timestamp_deltas[delta_id].usage_begin);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &timestamp_deltas[delta_id].begin);
+    timestamp_deltas[delta_id].label = label;
+    timestamp_deltas[delta_id].shift = current_timestamp_shift++;
+    return delta_id;
 }
 
 void
 end_delta (int delta_id)
 {
-    clock_gettime(CLOCK_MONOTONIC_RAW, &timestamp_deltas[delta_id].end);
     current_timestamp_shift--;
+    if (delta_id < 0) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &timestamp_deltas[delta_id].end);
+    sample_usage(timestamp_deltas[delta_id].usage_end);
+    timestamp_deltas[delta_id].usage_valid = 1;
+}
+
+/* record a delta whose begin and end times were measured elsewhere,
+ * e.g., by another thread, nested under any open deltas */
+int
+record_delta (const char * label, const struct timespec * begin,
+        const struct timespec * end)
+{
+    int delta_id = new_delta();
+    if (delta_id < 0) {
+        return -1;
+    }
+
+    timestamp_deltas[delta_id].begin = *begin;
+    timestamp_deltas[delta_id].end   = *end;
+    timestamp_deltas[delta_id].label = label;
+    timestamp_deltas[delta_id].shift = current_timestamp_shift;
+    return delta_id;
+}
+
+int
+num_deltas (void)
+{
+    return (int) current_timestamp_delta;
+}
+
+const char *
+delta_label (int delta_id)
+{
+    return timestamp_deltas[delta_id].label;
+}
+
+/* nesting level of delta, 0 for outermost */
+int
+delta_depth (int delta_id)
+{
+    return timestamp_deltas[delta_id].shift;
+}
+
+/* start and stop times of delta, end is zero if delta is still open */
+const struct timespec *
+delta_begin (int delta_id)
+{
+    return &timestamp_deltas[delta_id].begin;
+}
+
+const struct timespec *
+delta_end (int delta_id)
+{
+    return &timestamp_deltas[delta_id].end;
+}
+
+uint64_t
+delta_nsecs (int delta_id)
+{
+    struct timespec * begin = &timestamp_deltas[delta_id].begin;
+    struct timespec * end   = &timestamp_deltas[delta_id].end;
+
+    int64_t secs  = (int64_t) end->tv_sec  - (int64_t) begin->tv_sec;
+    int64_t nsecs = (int64_t) end->tv_nsec - (int64_t) begin->tv_nsec;
+    int64_t total = secs * 1000000000LL + nsecs;
+
+    return (total > 0) ? (uint64_t) total : 0;
+}
+
+/* Histogram buckets hold 8 sub-buckets for each power of two, so
+ * a percentile read from the histogram is off by at most 1/16 of the
+ * true value, and any time fits in DELTA_HIST_BUCKETS buckets */
+int
+delta_hist_bucket (uint64_t nsecs)
+{
+    if (nsecs < 8) {
+        return (int) nsecs;
+    }
+
+    /* find most significant bit */
+    int msb = 63;
+    while (! (nsecs & (1ULL << msb))) {
+        msb--;
+    }
+
+    /* take next three bits as sub-bucket */
+    int sub = (int) ((nsecs >> (msb - 3)) & 7);
+    return (msb - 2) * 8 + sub;
+}
+
+/* returns value at middle of bucket */
+uint64_t
+delta_hist_value (int bucket)
+{
+    if (bucket < 8) {
+        return (uint64_t) bucket;
+    }
+
+    int msb = bucket / 8 + 2;
+    int sub = bucket % 8;
+    uint64_t low   = (uint64_t) (8 + sub) << (msb - 3);
+    uint64_t width = 1ULL << (msb - 3);
+    return low + width / 2;
+}
+
+/* Encoded statistics are strings of the form:
+ *   count sum min max max_node bucket:count bucket:count ...
+ * with times in nsecs and only non-empty buckets listed, this is
+ * compact for the handful of distinct times we see per phase and
+ * fits in the value of a strmap */
+
+typedef struct delta_accum_t {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    int max_node;
+    uint64_t hist[DELTA_HIST_BUCKETS];
+} delta_accum;
+
+static void
+accum_decode (const char * str, delta_accum * acc)
+{
+    memset(acc, 0, sizeof(delta_accum));
+
+    char * end;
+    acc->count    = strtoull(str, &end, 10);
+    acc->sum      = strtoull(end, &end, 10);
+    acc->min      = strtoull(end, &end, 10);
+    acc->max      = strtoull(end, &end, 10);
+    acc->max_node = (int) strtol(end, &end, 10);
+
+    while (*end != '\0') {
+        char * next;
+        long bucket = strtol(end, &next, 10);
+        if (next == end || *next != ':') {
+            break;
+        }
+        uint64_t count = strtoull(next + 1, &end, 10);
+        if (bucket >= 0 && bucket < DELTA_HIST_BUCKETS) {
+            acc->hist[bucket] += count;
+        }
+    }
+}
+
+static char *
+accum_encode (const delta_accum * acc)
+{
+    /* allow for header plus each non-empty bucket */
+    int buckets = 0;
+    int i;
+    for (i = 0; i < DELTA_HIST_BUCKETS; i++) {
+        if (acc->hist[i] > 0) {
+            buckets++;
+        }
+    }
+    size_t len = 5 * 21 + buckets * 2 * 21 + 1;
+    char * str = malloc(len);
+    if (str == NULL) {
+        return NULL;
+    }
+
+    size_t pos = snprintf(str, len, "%llu %llu %llu %llu %d",
+            (unsigned long long) acc->count,
+            (unsigned long long) acc->sum,
+            (unsigned long long) acc->min,
+            (unsigned long long) acc->max,
+            acc->max_node);
+    for (i = 0; i < DELTA_HIST_BUCKETS; i++) {
+        if (acc->hist[i] > 0) {
+            pos += snprintf(str + pos, len - pos, " %d:%llu",
+                    i, (unsigned long long) acc->hist[i]);
+        }
+    }
+
+    return str;
+}
+
+char *
+delta_stats_encode (uint64_t nsecs, int node)
+{
+    delta_accum acc;
+    memset(&acc, 0, sizeof(delta_accum));
+    acc.count    = 1;
+    acc.sum      = nsecs;
+    acc.min      = nsecs;
+    acc.max      = nsecs;
+    acc.max_node = node;
+    acc.hist[delta_hist_bucket(nsecs)] = 1;
+    return accum_encode(&acc);
+}
+
+char *
+delta_stats_merge (const char * a, const char * b)
+{
+    delta_accum acc_a, acc_b;
+    accum_decode(a, &acc_a);
+    accum_decode(b, &acc_b);
+
+    acc_a.count += acc_b.count;
+    acc_a.sum   += acc_b.sum;
+    if (acc_b.min < acc_a.min) {
+        acc_a.min = acc_b.min;
+    }
+    if (acc_b.max > acc_a.max) {
+        acc_a.max      = acc_b.max;
+        acc_a.max_node = acc_b.max_node;
+    }
+
+    int i;
+    for (i = 0; i < DELTA_HIST_BUCKETS; i++) {
+        acc_a.hist[i] += acc_b.hist[i];
+    }
+
+    return accum_encode(&acc_a);
+}
+
+/* returns value at given percentile from histogram,
+ * clamped to the exact min and max we tracked */
+static uint64_t
+accum_percentile (const delta_accum * acc, double pct)
+{
+    uint64_t rank = (uint64_t) (pct * (double) acc->count + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    uint64_t total = 0;
+    int i;
+    for (i = 0; i < DELTA_HIST_BUCKETS; i++) {
+        total += acc->hist[i];
+        if (total >= rank) {
+            uint64_t value = delta_hist_value(i);
+            if (value < acc->min) {
+                value = acc->min;
+            }
+            if (value > acc->max) {
+                value = acc->max;
+            }
+            return value;
+        }
+    }
+
+    return acc->max;
+}
+
+void
+delta_stats_decode (const char * str, delta_stats * stats)
+{
+    delta_accum acc;
+    accum_decode(str, &acc);
+
+    stats->count    = acc.count;
+    stats->min      = acc.min;
+    stats->mean     = (acc.count > 0) ? acc.sum / acc.count : 0;
+    stats->max      = acc.max;
+    stats->p50      = accum_percentile(&acc, 0.50);
+    stats->p99      = accum_percentile(&acc, 0.99);
+    stats->max_node = acc.max_node;
+}
+
+/* record time of delta across all spawn procs,
+ * which print_deltas reports next to our own time */
+void
+set_delta_stats (int delta_id, const delta_stats * stats)
+{
+    timestamp_deltas[delta_id].stats = *stats;
+    timestamp_deltas[delta_id].stats_set = 1;
+    have_delta_stats = 1;
+}
+
+/* Encoded usage is a string holding the total and the max of each
+ * counter across spawn procs:
+ *   sum0 max0 sum1 max1 ...
+ * in order of delta_usage_type */
+
+static void
+usage_decode (const char * str, uint64_t * sum, uint64_t * max)
+{
+    char * end = (char *) str;
+    int i;
+    for (i = 0; i < DELTA_USAGE_COUNT; i++) {
+        sum[i] = strtoull(end, &end, 10);
+        max[i] = strtoull(end, &end, 10);
+    }
+}
+
+static char *
+usage_encode (const uint64_t * sum, const uint64_t * max)
+{
+    size_t len = DELTA_USAGE_COUNT * 2 * 21 + 1;
+    char * str = malloc(len);
+    if (str == NULL) {
+        return NULL;
+    }
+
+    size_t pos = 0;
+    int i;
+    for (i = 0; i < DELTA_USAGE_COUNT; i++) {
+        pos += snprintf(str + pos, len - pos, "%s%llu %llu",
+                (i > 0) ? " " : "",
+                (unsigned long long) sum[i],
+                (unsigned long long) max[i]);
+    }
+
+    return str;
+}
+
+int
+delta_usage (int delta_id, uint64_t * usage)
+{
+    struct delta_t * d = &timestamp_deltas[delta_id];
+    if (! d->usage_valid) {
+        return 0;
+    }
+
+    int i;
+    for (i = 0; i < DELTA_USAGE_COUNT; i++) {
+        usage[i] = (d->usage_end[i] > d->usage_begin[i]) ?
+            d->usage_end[i] - d->usage_begin[i] : 0;
+    }
+    return 1;
+}
+
+char *
+delta_usage_encode (int delta_id)
+{
+    uint64_t usage[DELTA_USAGE_COUNT];
+    if (! delta_usage(delta_id, usage)) {
+        return NULL;
+    }
+    return usage_encode(usage, usage);
+}
+
+char *
+delta_usage_merge (const char * a, const char * b)
+{
+    uint64_t sum_a[DELTA_USAGE_COUNT], max_a[DELTA_USAGE_COUNT];
+    uint64_t sum_b[DELTA_USAGE_COUNT], max_b[DELTA_USAGE_COUNT];
+    usage_decode(a, sum_a, max_a);
+    usage_decode(b, sum_b, max_b);
+
+    int i;
+    for (i = 0; i < DELTA_USAGE_COUNT; i++) {
+        sum_a[i] += sum_b[i];
+        if (max_b[i] > max_a[i]) {
+            max_a[i] = max_b[i];
+        }
+    }
+
+    return usage_encode(sum_a, max_a);
+}
+
+/* record usage of delta across all spawn procs */
+void
+set_delta_usage (int delta_id, const char * str)
+{
+    struct delta_t * d = &timestamp_deltas[delta_id];
+    usage_decode(str, d->usage_sum, d->usage_max);
+    d->usage_set = 1;
+    have_delta_usage = 1;
+}
+
+/* print resource usage of each phase, with total and max across
+ * spawn procs if we have them, and our own otherwise */
+static void
+print_usage (FILE * fd)
+{
+    size_t counter;
+    int i;
+
+    if (have_delta_usage) {
+        fprintf(fd, "Launcher Resource Usage (total/max across nodes)\n%36s", "");
+    } else {
+        fprintf(fd, "Launcher Resource Usage\n%36s", "");
+    }
+    for (i = 0; i < DELTA_USAGE_COUNT; i++) {
+        fprintf(fd, "%16s", usage_names[i]);
+    }
+    fprintf(fd, "\n");
+
+    for (counter = 0; counter < current_timestamp_delta; counter++) {
+        struct delta_t * d = &timestamp_deltas[counter];
+
+        uint64_t sum[DELTA_USAGE_COUNT], max[DELTA_USAGE_COUNT];
+        if (d->usage_set) {
+            memcpy(sum, d->usage_sum, sizeof(sum));
+            memcpy(max, d->usage_max, sizeof(max));
+        } else if (delta_usage((int) counter, sum)) {
+            memcpy(max, sum, sizeof(max));
+        } else {
+            /* no usage for deltas recorded by other threads */
+            continue;
+        }
+
+        /* report bytes in KB */
+        sum[DELTA_USAGE_RBYTES] >>= 10;
+        max[DELTA_USAGE_RBYTES] >>= 10;
+        sum[DELTA_USAGE_WBYTES] >>= 10;
+        max[DELTA_USAGE_WBYTES] >>= 10;
+
+        fprintf(fd, "%*s%-*s", d->shift, "", 36 - d->shift, d->label);
+        for (i = 0; i < DELTA_USAGE_COUNT; i++) {
+            if (have_delta_usage) {
+                char pair[64];
+                snprintf(pair, sizeof(pair), "%llu/%llu",
+                        (unsigned long long) sum[i],
+                        (unsigned long long) max[i]);
+                fprintf(fd, "%16s", pair);
+            } else {
+                fprintf(fd, "%16llu", (unsigned long long) sum[i]);
+            }
+        }
+        fprintf(fd, "\n");
+    }
+
+    fprintf(fd, "\n");
 }
 
 void
@@ -66,7 +578,13 @@ print_deltas (FILE * fd)
 {
     size_t counter;
 
-    fprintf(fd, "\nLauncher Profiling\n%40s%15s\n", "", "Time (sec)");
+    if (have_delta_stats) {
+        fprintf(fd, "\nLauncher Profiling\n%40s%15s%13s%13s%13s%13s%13s%9s\n", "",
+                "Time (sec)", "Min (sec)", "Mean (sec)", "Max (sec)",
+                "P50 (sec)", "P99 (sec)", "Max node");
+    } else {
+        fprintf(fd, "\nLauncher Profiling\n%40s%15s\n", "", "Time (sec)");
+    }
 
     for (counter = 0; counter < current_timestamp_delta; counter++) {
         struct timespec temp;
@@ -81,16 +599,65 @@ print_deltas (FILE * fd)
             temp.tv_sec -= 1;
         }
 
-        fprintf(fd, "%*s%-*s %4lld.%.9lld\n",
+        fprintf(fd, "%*s%-*s %4lld.%.9lld",
                 timestamp_deltas[counter].shift,
                 "",
                 35 - timestamp_deltas[counter].shift,
                 timestamp_deltas[counter].label,
                 (long long)temp.tv_sec,
                 (long long)temp.tv_nsec);
+
+        if (timestamp_deltas[counter].stats_set) {
+            delta_stats * st = &timestamp_deltas[counter].stats;
+            fprintf(fd, " %12.6f %12.6f %12.6f %12.6f %12.6f %8d",
+                    (double) st->min  / 1e9,
+                    (double) st->mean / 1e9,
+                    (double) st->max  / 1e9,
+                    (double) st->p50  / 1e9,
+                    (double) st->p99  / 1e9,
+                    st->max_node);
+        }
+
+        fprintf(fd, "\n");
     }
 
     fprintf(fd, "\n");
 
-    return 0;
+    print_usage(fd);
+
+    return;
+}
+
+void
+write_deltas_csv (FILE * fd)
+{
+    size_t counter;
+
+    fprintf(fd, "phase,depth,secs,count,min,mean,max,p50,p99,max_node\n");
+
+    for (counter = 0; counter < current_timestamp_delta; counter++) {
+        struct delta_t * d = &timestamp_deltas[counter];
+
+        /* labels never hold quotes, but may hold commas */
+        fprintf(fd, "\"%s\",%d,%.9f", d->label, d->shift,
+                (double) delta_nsecs((int) counter) / 1e9);
+
+        if (d->stats_set) {
+            delta_stats * st = &d->stats;
+            fprintf(fd, ",%llu,%.9f,%.9f,%.9f,%.9f,%.9f,%d",
+                    (unsigned long long) st->count,
+                    (double) st->min  / 1e9,
+                    (double) st->mean / 1e9,
+                    (double) st->max  / 1e9,
+                    (double) st->p50  / 1e9,
+                    (double) st->p99  / 1e9,
+                    st->max_node);
+        } else {
+            fprintf(fd, ",,,,,,,");
+        }
+
+        fprintf(fd, "\n");
+    }
+
+    return;
 }
@@ -13,9 +13,74 @@
 #define SPAWN_TIMER_H 1
 
 #include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/* statistics of a delta across all spawn procs, times in nsecs */
+typedef struct delta_stats_t {
+    uint64_t count; /* number of procs that recorded the delta */
+    uint64_t min;
+    uint64_t mean;
+    uint64_t max;
+    uint64_t p50;
+    uint64_t p99;
+    int max_node;   /* rank of spawn proc that recorded max */
+} delta_stats;
+
+/* number of log-scale buckets used to estimate percentiles */
+#define DELTA_HIST_BUCKETS (496)
+
+/* resource usage counters sampled at begin and end of each delta */
+typedef enum delta_usage_types {
+    DELTA_USAGE_MINFLT = 0, /* minor page faults */
+    DELTA_USAGE_MAJFLT,     /* major page faults */
+    DELTA_USAGE_NVCSW,      /* voluntary context switches */
+    DELTA_USAGE_NIVCSW,     /* involuntary context switches */
+    DELTA_USAGE_INBLOCK,    /* block input operations */
+    DELTA_USAGE_OUBLOCK,    /* block output operations */
+    DELTA_USAGE_RBYTES,     /* bytes read from storage */
+    DELTA_USAGE_WBYTES,     /* bytes written to storage */
+    DELTA_USAGE_COUNT,
+} delta_usage_type;
 
 int begin_delta (const char * label);
 void end_delta (int delta_id);
+int record_delta (const char * label, const struct timespec * begin,
+        const struct timespec * end);
+int num_deltas (void);
+const char * delta_label (int delta_id);
+int delta_depth (int delta_id);
+const struct timespec * delta_begin (int delta_id);
+const struct timespec * delta_end (int delta_id);
+uint64_t delta_nsecs (int delta_id);
+
+int delta_hist_bucket (uint64_t nsecs);
+uint64_t delta_hist_value (int bucket);
+
+/* encode time recorded by node as a string, merge two such strings,
+ * and decode merged string into stats, encoded strings are allocated
+ * with malloc and should be freed with free */
+char * delta_stats_encode (uint64_t nsecs, int node);
+char * delta_stats_merge (const char * a, const char * b);
+void delta_stats_decode (const char * str, delta_stats * stats);
+
+void set_delta_stats (int delta_id, const delta_stats * stats);
+
+/* fill usage with change in each counter over delta, returns 0 if
+ * we have no counters for delta (e.g., it came from record_delta) */
+int delta_usage (int delta_id, uint64_t * usage);
+
+/* encode usage of delta as a string, merge two such strings, and
+ * record merged string with delta, encoded strings are allocated
+ * with malloc and should be freed with free, encode returns NULL
+ * if we have no counters for delta */
+char * delta_usage_encode (int delta_id);
+char * delta_usage_merge (const char * a, const char * b);
+void set_delta_usage (int delta_id, const char * str);
 void print_deltas (FILE * fd);
 
+/* write one CSV row per delta to fd for scripts to parse, along
+ * with stats across spawn procs where we have them */
+void write_deltas_csv (FILE * fd);
+
 #endif
@@ -0,0 +1,690 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+#include <trace.h>
+#include <timer_util.h>
+
+#include "spawn.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+/* Each spawn proc packs one record (all integers in host order,
+ * we assume a homogeneous machine):
+ *
+ *   uint32_t rank      rank of spawn proc in tree
+ *   int32_t  parent    rank of its parent in tree, -1 for root
+ *   uint32_t count     number of entries that follow
+ *   uint32_t hostlen   length of host name
+ *   char     host[hostlen]
+ *
+ * followed by count entries of:
+ *
+ *   int64_t  begin     start time in nsecs on root's clock
+ *   int64_t  end       stop time in nsecs on root's clock
+ *   uint32_t depth     nesting level of delta
+ *   uint32_t labellen  length of label
+ *   char     label[labellen] */
+
+static int64_t clock_offset = 0; /* add to our clock to get root's clock */
+
+void
+trace_set_offset (int64_t offset)
+{
+    clock_offset = offset;
+}
+
+int64_t
+trace_get_offset (void)
+{
+    return clock_offset;
+}
+
+int64_t
+trace_time (const struct timespec * ts)
+{
+    int64_t nsecs = (int64_t) ts->tv_sec * 1000000000LL + (int64_t) ts->tv_nsec;
+    return nsecs + clock_offset;
+}
+
+int64_t
+trace_now (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return trace_time(&ts);
+}
+
+int64_t
+trace_estimate_offset (int64_t t0, int64_t t1, int64_t t2, int64_t t3)
+{
+    /* assume the request and reply took equally long in flight,
+     * so the parent's clock read (t1 + t2) / 2 when ours read
+     * (t0 + t3) / 2 */
+    return ((t1 - t0) + (t2 - t3)) / 2;
+}
+
+/* copy size bytes from src to buffer at ptr, return updated ptr */
+static char *
+pack_bytes (char * ptr, const void * src, size_t size)
+{
+    memcpy(ptr, src, size);
+    return ptr + size;
+}
+
+/* copy size bytes from buffer at ptr to dst, return updated ptr */
+static const char *
+unpack_bytes (const char * ptr, void * dst, size_t size)
+{
+    memcpy(dst, ptr, size);
+    return ptr + size;
+}
+
+/* skip deltas which were never closed, e.g., the delta that
+ * brackets the teardown we're being called from */
+static int
+delta_is_closed (int id)
+{
+    const struct timespec * end = delta_end(id);
+    return (end->tv_sec != 0 || end->tv_nsec != 0);
+}
+
+void *
+trace_pack (int rank, int parent, const char * host, size_t * size)
+{
+    int num = num_deltas();
+
+    /* compute size of our record */
+    uint32_t count = 0;
+    size_t bytes = 4 * sizeof(uint32_t) + strlen(host);
+    int id;
+    for (id = 0; id < num; id++) {
+        if (delta_is_closed(id)) {
+            bytes += 2 * sizeof(int64_t) + 2 * sizeof(uint32_t);
+            bytes += strlen(delta_label(id));
+            count++;
+        }
+    }
+
+    char* buf = (char*) SPAWN_MALLOC(bytes);
+    char* ptr = buf;
+
+    /* pack our header */
+    uint32_t rank32   = (uint32_t) rank;
+    int32_t  parent32 = (int32_t) parent;
+    uint32_t hostlen  = (uint32_t) strlen(host);
+    ptr = pack_bytes(ptr, &rank32,   sizeof(uint32_t));
+    ptr = pack_bytes(ptr, &parent32, sizeof(int32_t));
+    ptr = pack_bytes(ptr, &count,    sizeof(uint32_t));
+    ptr = pack_bytes(ptr, &hostlen,  sizeof(uint32_t));
+    ptr = pack_bytes(ptr, host, hostlen);
+
+    /* pack each delta with its times on root's clock */
+    for (id = 0; id < num; id++) {
+        if (! delta_is_closed(id)) {
+            continue;
+        }
+
+        const char* label = delta_label(id);
+        int64_t begin     = trace_time(delta_begin(id));
+        int64_t end       = trace_time(delta_end(id));
+        uint32_t depth    = (uint32_t) delta_depth(id);
+        uint32_t labellen = (uint32_t) strlen(label);
+
+        ptr = pack_bytes(ptr, &begin,    sizeof(int64_t));
+        ptr = pack_bytes(ptr, &end,      sizeof(int64_t));
+        ptr = pack_bytes(ptr, &depth,    sizeof(uint32_t));
+        ptr = pack_bytes(ptr, &labellen, sizeof(uint32_t));
+        ptr = pack_bytes(ptr, label, labellen);
+    }
+
+    *size = bytes;
+    return buf;
+}
+
+/* write len bytes of str as a JSON string */
+static void
+write_json_string (FILE * fp, const char * str, size_t len)
+{
+    fputc('"', fp);
+    size_t i;
+    for (i = 0; i < len; i++) {
+        char c = str[i];
+        if (c == '"' || c == '\\') {
+            fputc('\\', fp);
+            fputc(c, fp);
+        } else if ((unsigned char) c < 0x20) {
+            fprintf(fp, "\\u%04x", (unsigned int) (unsigned char) c);
+        } else {
+            fputc(c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/* reads header of record at ptr, returns pointer to first entry */
+static const char *
+unpack_header (const char * ptr, uint32_t * rank, int32_t * parent,
+        uint32_t * count, uint32_t * hostlen, const char ** host)
+{
+    ptr = unpack_bytes(ptr, rank,    sizeof(uint32_t));
+    ptr = unpack_bytes(ptr, parent,  sizeof(int32_t));
+    ptr = unpack_bytes(ptr, count,   sizeof(uint32_t));
+    ptr = unpack_bytes(ptr, hostlen, sizeof(uint32_t));
+    *host = ptr;
+    return ptr + *hostlen;
+}
+
+/* reads entry at ptr, returns pointer to next entry */
+static const char *
+unpack_entry (const char * ptr, int64_t * begin, int64_t * end,
+        uint32_t * depth, uint32_t * labellen, const char ** label)
+{
+    ptr = unpack_bytes(ptr, begin,    sizeof(int64_t));
+    ptr = unpack_bytes(ptr, end,      sizeof(int64_t));
+    ptr = unpack_bytes(ptr, depth,    sizeof(uint32_t));
+    ptr = unpack_bytes(ptr, labellen, sizeof(uint32_t));
+    *label = ptr;
+    return ptr + *labellen;
+}
+
+int
+trace_write (const char * file, const void * buf, size_t size)
+{
+    const char* start = (const char*) buf;
+    const char* last  = start + size;
+
+    uint32_t rank, count, hostlen, depth, labellen;
+    int32_t parent;
+    const char* host;
+    const char* label;
+    int64_t begin, end;
+    uint32_t i;
+
+    /* find earliest time across all procs, we report times
+     * relative to that */
+    int64_t base = 0;
+    int have_base = 0;
+    const char* ptr = start;
+    while (ptr < last) {
+        ptr = unpack_header(ptr, &rank, &parent, &count, &hostlen, &host);
+        for (i = 0; i < count; i++) {
+            ptr = unpack_entry(ptr, &begin, &end, &depth, &labellen, &label);
+            if (! have_base || begin < base) {
+                base = begin;
+                have_base = 1;
+            }
+        }
+    }
+
+    FILE* fp = fopen(file, "w");
+    if (fp == NULL) {
+        SPAWN_ERR("Failed to open trace file `%s' (errno=%d %s)", file, errno, strerror(errno));
+        return 1;
+    }
+
+    /* chrome trace format expects times in usecs, each spawn proc
+     * shows up as its own process named by its rank and host */
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    int first = 1;
+    ptr = start;
+    while (ptr < last) {
+        ptr = unpack_header(ptr, &rank, &parent, &count, &hostlen, &host);
+
+        fprintf(fp, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":",
+            first ? "" : ",\n", rank);
+        char* name = SPAWN_STRDUPF("%u %.*s", rank, (int) hostlen, host);
+        write_json_string(fp, name, strlen(name));
+        spawn_free(&name);
+        fprintf(fp, "}},\n{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"sort_index\":%u}}",
+            rank, rank);
+        first = 0;
+
+        for (i = 0; i < count; i++) {
+            ptr = unpack_entry(ptr, &begin, &end, &depth, &labellen, &label);
+
+            fprintf(fp, ",\n{\"name\":");
+            write_json_string(fp, label, labellen);
+            fprintf(fp, ",\"ph\":\"X\",\"pid\":%u,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"depth\":%u}}",
+                rank,
+                (double) (begin - base) / 1000.0,
+                (double) (end - begin) / 1000.0,
+                depth);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+
+    if (fclose(fp) != 0) {
+        SPAWN_ERR("Failed to close trace file `%s' (errno=%d %s)", file, errno, strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+/*******************************
+ * Critical path analysis
+ ******************************/
+
+/* The root walks the gathered trace backwards through the tree to
+ * find which chain of spawn procs determined the length of each
+ * phase.  A phase that every proc runs (e.g., "unfurl tree" or
+ * "pmi exchange") can't end on a proc until it ends on the children
+ * that proc waits on, so for each phase we start at the root, find
+ * the child whose copy of the phase ended last, and charge the
+ * parent only for the time that child was not running.  We then
+ * repeat the process on that child over the window its phase
+ * overlapped with the parent's.  The time charged to a proc is split
+ * among its nested phases (e.g., "launch children" or "accept
+ * children"), so time spent waiting on rsh or accept shows up under
+ * those names.  We sum the charges by (proc, phase) and print the
+ * largest. */
+
+typedef struct trace_entry_t {
+    int64_t begin;  /* start time in nsecs on root's clock */
+    int64_t end;    /* stop time in nsecs on root's clock */
+    int depth;      /* nesting level */
+    char* label;    /* name of phase */
+    char* key;      /* label plus occurrence, e.g., "pmi fence#1" */
+} trace_entry;
+
+typedef struct trace_node_t {
+    int rank;             /* rank of spawn proc */
+    int parent;           /* rank of parent, -1 for root */
+    char* host;           /* host name of spawn proc */
+    int count;            /* number of entries */
+    trace_entry* entries; /* phases recorded by proc */
+    int children;         /* number of children */
+    int* child_ranks;     /* ranks of children */
+} trace_node;
+
+typedef struct trace_charge_t {
+    int rank;          /* spawn proc charged */
+    const char* label; /* phase charged */
+    int64_t nsecs;     /* time charged */
+} trace_charge;
+
+typedef struct trace_charges_t {
+    int count;
+    int capacity;
+    trace_charge* list;
+} trace_charges;
+
+/* unpack records of all procs into an array indexed by rank,
+ * returns number of slots in array in num */
+static trace_node *
+trace_load (const void * buf, size_t size, int * num)
+{
+    const char* start = (const char*) buf;
+    const char* last  = start + size;
+
+    uint32_t rank, count, hostlen, depth, labellen;
+    int32_t parent;
+    const char* host;
+    const char* label;
+    int64_t begin, end;
+    uint32_t i;
+
+    /* find max rank */
+    int ranks = 0;
+    const char* ptr = start;
+    while (ptr < last) {
+        ptr = unpack_header(ptr, &rank, &parent, &count, &hostlen, &host);
+        for (i = 0; i < count; i++) {
+            ptr = unpack_entry(ptr, &begin, &end, &depth, &labellen, &label);
+        }
+        if ((int) rank + 1 > ranks) {
+            ranks = (int) rank + 1;
+        }
+    }
+
+    trace_node* nodes = (trace_node*) SPAWN_MALLOC(ranks * sizeof(trace_node));
+    int r;
+    for (r = 0; r < ranks; r++) {
+        nodes[r].rank        = r;
+        nodes[r].parent      = -1;
+        nodes[r].host        = NULL;
+        nodes[r].count       = 0;
+        nodes[r].entries     = NULL;
+        nodes[r].children    = 0;
+        nodes[r].child_ranks = NULL;
+    }
+
+    /* fill in each node */
+    ptr = start;
+    while (ptr < last) {
+        ptr = unpack_header(ptr, &rank, &parent, &count, &hostlen, &host);
+
+        trace_node* n = &nodes[rank];
+        n->parent  = (int) parent;
+        n->host    = SPAWN_STRDUPF("%.*s", (int) hostlen, host);
+        n->count   = (int) count;
+        n->entries = (trace_entry*) SPAWN_MALLOC(count * sizeof(trace_entry));
+
+        /* number repeated labels the same way on every proc */
+        strmap* counts = strmap_new();
+        for (i = 0; i < count; i++) {
+            ptr = unpack_entry(ptr, &begin, &end, &depth, &labellen, &label);
+
+            trace_entry* e = &n->entries[i];
+            e->begin = begin;
+            e->end   = end;
+            e->depth = (int) depth;
+            e->label = SPAWN_STRDUPF("%.*s", (int) labellen, label);
+
+            int occur = 0;
+            const char* occur_str = strmap_get(counts, e->label);
+            if (occur_str != NULL) {
+                occur = atoi(occur_str);
+            }
+            strmap_setf(counts, "%s=%d", e->label, occur + 1);
+            e->key = SPAWN_STRDUPF("%s#%d", e->label, occur);
+        }
+        strmap_delete(&counts);
+    }
+
+    /* link each node to its children */
+    for (r = 0; r < ranks; r++) {
+        int p = nodes[r].parent;
+        if (p >= 0 && p < ranks) {
+            nodes[p].child_ranks = (int*) realloc(nodes[p].child_ranks,
+                (nodes[p].children + 1) * sizeof(int));
+            nodes[p].child_ranks[nodes[p].children] = r;
+            nodes[p].children++;
+        }
+    }
+
+    *num = ranks;
+    return nodes;
+}
+
+static void
+trace_unload (trace_node ** pnodes, int num)
+{
+    trace_node* nodes = *pnodes;
+    int r, i;
+    for (r = 0; r < num; r++) {
+        for (i = 0; i < nodes[r].count; i++) {
+            spawn_free(&nodes[r].entries[i].label);
+            spawn_free(&nodes[r].entries[i].key);
+        }
+        spawn_free(&nodes[r].entries);
+        spawn_free(&nodes[r].host);
+        free(nodes[r].child_ranks);
+    }
+    spawn_free(pnodes);
+}
+
+/* returns index of entry with given key, or -1 if not found */
+static int
+entry_find (const trace_node * n, const char * key)
+{
+    int i;
+    for (i = 0; i < n->count; i++) {
+        if (strcmp(n->entries[i].key, key) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* returns index one past the last phase nested in entry idx,
+ * nested phases follow their parent and have greater depth */
+static int
+entry_nested_end (const trace_node * n, int idx)
+{
+    int i = idx + 1;
+    while (i < n->count && n->entries[i].depth > n->entries[idx].depth) {
+        i++;
+    }
+    return i;
+}
+
+static void
+charge_add (trace_charges * charges, int rank, const char * label,
+        int64_t nsecs)
+{
+    int i;
+    for (i = 0; i < charges->count; i++) {
+        trace_charge* c = &charges->list[i];
+        if (c->rank == rank && strcmp(c->label, label) == 0) {
+            c->nsecs += nsecs;
+            return;
+        }
+    }
+
+    if (charges->count == charges->capacity) {
+        charges->capacity = charges->capacity ? charges->capacity * 2 : 64;
+        charges->list = (trace_charge*) realloc(charges->list,
+            charges->capacity * sizeof(trace_charge));
+    }
+
+    trace_charge* c = &charges->list[charges->count];
+    c->rank  = rank;
+    c->label = label;
+    c->nsecs = nsecs;
+    charges->count++;
+}
+
+static int
+int64_cmp (const void * a, const void * b)
+{
+    int64_t x = *(const int64_t*) a;
+    int64_t y = *(const int64_t*) b;
+    return (x > y) - (x < y);
+}
+
+/* charge the time from..to that proc n spent in phase idx to the
+ * deepest nested phase running at each point in that interval */
+static void
+charge_interval (const trace_node * n, int idx, int64_t from, int64_t to,
+        trace_charges * charges)
+{
+    if (to <= from) {
+        return;
+    }
+
+    /* cut interval at every nested phase boundary that falls in it */
+    int last = entry_nested_end(n, idx);
+    int64_t* cuts = (int64_t*) SPAWN_MALLOC((2 * (last - idx) + 2) * sizeof(int64_t));
+    int ncuts = 0;
+    cuts[ncuts++] = from;
+    cuts[ncuts++] = to;
+    int i;
+    for (i = idx + 1; i < last; i++) {
+        const trace_entry* e = &n->entries[i];
+        if (e->begin > from && e->begin < to) {
+            cuts[ncuts++] = e->begin;
+        }
+        if (e->end > from && e->end < to) {
+            cuts[ncuts++] = e->end;
+        }
+    }
+    qsort(cuts, ncuts, sizeof(int64_t), int64_cmp);
+
+    /* charge each piece to deepest phase covering it */
+    int j;
+    for (j = 0; j + 1 < ncuts; j++) {
+        int64_t x = cuts[j];
+        int64_t y = cuts[j + 1];
+        if (y <= x) {
+            continue;
+        }
+
+        int deepest = idx;
+        for (i = idx + 1; i < last; i++) {
+            const trace_entry* e = &n->entries[i];
+            if (e->begin <= x && e->end >= y &&
+                e->depth > n->entries[deepest].depth)
+            {
+                deepest = i;
+            }
+        }
+
+        charge_add(charges, n->rank, n->entries[deepest].label, y - x);
+    }
+
+    spawn_free(&cuts);
+}
+
+/* follow phase idx of proc n over window from..to down the tree,
+ * printing the procs we pass through and charging time to them */
+static void
+critical_walk (const trace_node * nodes, int num, const trace_node * n,
+        int idx, int64_t from, int64_t to, trace_charges * charges,
+        FILE * fd)
+{
+    const trace_entry* e = &n->entries[idx];
+
+    /* clip phase to window */
+    int64_t begin = (e->begin > from) ? e->begin : from;
+    int64_t end   = (e->end   < to)   ? e->end   : to;
+    if (end <= begin) {
+        return;
+    }
+
+    fprintf(fd, " -> %d (%s)", n->rank, n->host);
+
+    /* find child whose copy of this phase ended last in our window */
+    const trace_node* next = NULL;
+    int next_idx = -1;
+    int64_t next_begin = 0, next_end = 0;
+    int i;
+    for (i = 0; i < n->children; i++) {
+        int r = n->child_ranks[i];
+        if (r < 0 || r >= num) {
+            continue;
+        }
+        const trace_node* c = &nodes[r];
+        int cidx = entry_find(c, e->key);
+        if (cidx < 0) {
+            continue;
+        }
+        const trace_entry* ce = &c->entries[cidx];
+        int64_t cb = (ce->begin > begin) ? ce->begin : begin;
+        int64_t cend = (ce->end < end) ? ce->end : end;
+        if (cend > cb && (next == NULL || cend > next_end)) {
+            next       = c;
+            next_idx   = cidx;
+            next_begin = cb;
+            next_end   = cend;
+        }
+    }
+
+    if (next == NULL) {
+        /* we're a leaf of the path, all time is ours */
+        charge_interval(n, idx, begin, end, charges);
+        return;
+    }
+
+    /* charge time before child started and after it finished
+     * to ourself, then walk into the child */
+    charge_interval(n, idx, begin, next_begin, charges);
+    charge_interval(n, idx, next_end, end, charges);
+    critical_walk(nodes, num, next, next_idx, next_begin, next_end, charges, fd);
+}
+
+static int
+charge_cmp (const void * a, const void * b)
+{
+    const trace_charge* x = (const trace_charge*) a;
+    const trace_charge* y = (const trace_charge*) b;
+    return (y->nsecs > x->nsecs) - (y->nsecs < x->nsecs);
+}
+
+/* returns 1 if entry idx of root is the outermost phase that the
+ * root shares with its children, i.e., a child recorded it and no
+ * phase enclosing it was recorded by a child */
+static int
+is_shared_phase (const trace_node * nodes, int num, int idx)
+{
+    const trace_node* root = &nodes[0];
+
+    int shared = 0;
+    int i;
+    for (i = 0; i < root->children && !shared; i++) {
+        int r = root->child_ranks[i];
+        if (r >= 0 && r < num && entry_find(&nodes[r], root->entries[idx].key) >= 0) {
+            shared = 1;
+        }
+    }
+    if (! shared) {
+        return 0;
+    }
+
+    /* check whether an enclosing phase is shared */
+    int depth = root->entries[idx].depth;
+    for (i = idx - 1; i >= 0 && depth > 0; i--) {
+        if (root->entries[i].depth < depth) {
+            depth = root->entries[i].depth;
+            int j;
+            for (j = 0; j < root->children; j++) {
+                int r = root->child_ranks[j];
+                if (r >= 0 && r < num && entry_find(&nodes[r], root->entries[i].key) >= 0) {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+void
+trace_critical_path (const void * buf, size_t size, int top, FILE * fd)
+{
+    int num;
+    trace_node* nodes = trace_load(buf, size, &num);
+    if (num == 0) {
+        spawn_free(&nodes);
+        return;
+    }
+
+    trace_charges charges = { 0, 0, NULL };
+
+    /* walk each phase the root shares with the tree */
+    fprintf(fd, "\nLauncher Critical Path\n");
+    const trace_node* root = &nodes[0];
+    int64_t total = 0;
+    int i;
+    for (i = 0; i < root->count; i++) {
+        if (! is_shared_phase(nodes, num, i)) {
+            continue;
+        }
+
+        const trace_entry* e = &root->entries[i];
+        int64_t nsecs = e->end - e->begin;
+        total += nsecs;
+
+        fprintf(fd, "%-35s %4lld.%.9lld\n ", e->label,
+            (long long) (nsecs / 1000000000LL),
+            (long long) (nsecs % 1000000000LL));
+        critical_walk(nodes, num, root, i, e->begin, e->end, &charges, fd);
+        fprintf(fd, "\n");
+    }
+
+    /* print procs and phases that cost the most */
+    qsort(charges.list, charges.count, sizeof(trace_charge), charge_cmp);
+    fprintf(fd, "\nTop %d critical path contributors\n", top);
+    fprintf(fd, "%15s%8s%8s  %-20s %s\n", "Time (sec)", "%", "Rank", "Host", "Phase");
+    for (i = 0; i < charges.count && i < top; i++) {
+        const trace_charge* c = &charges.list[i];
+        double pct = (total > 0) ? 100.0 * (double) c->nsecs / (double) total : 0.0;
+        fprintf(fd, "%15.9f%8.1f%8d  %-20s %s\n",
+            (double) c->nsecs / 1000000000.0, pct,
+            c->rank, nodes[c->rank].host, c->label);
+    }
+    fprintf(fd, "\n");
+
+    free(charges.list);
+    trace_unload(&nodes, num);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* Launch trace: each spawn proc packs the deltas it recorded with
+ * timer_util into a compact binary record with times shifted onto
+ * the root's clock.  The records are gathered to the root through
+ * the spawn tree at teardown, and the root writes them out as a
+ * single Chrome trace JSON file (chrome://tracing or Perfetto),
+ * with one process row per spawn proc. */
+
+#ifndef SPAWN_TRACE_H
+#define SPAWN_TRACE_H 1
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* set offset in nsecs to add to our clock to get root's clock */
+void trace_set_offset (int64_t offset);
+
+/* returns offset in nsecs to add to our clock to get root's clock */
+int64_t trace_get_offset (void);
+
+/* convert a CLOCK_MONOTONIC_RAW time to nsecs on root's clock */
+int64_t trace_time (const struct timespec * ts);
+
+/* returns current time in nsecs on root's clock */
+int64_t trace_now (void);
+
+/* estimate offset to root's clock from a request sent to parent at
+ * local time t0, received by parent at t1, answered by parent at t2,
+ * and answer received at local time t3, where t1 and t2 are already
+ * on root's clock */
+int64_t trace_estimate_offset (int64_t t0, int64_t t1, int64_t t2,
+        int64_t t3);
+
+/* pack deltas recorded by this proc into a newly allocated buffer
+ * and return its size in size, parent is the rank of our parent in
+ * the spawn tree or -1 for the root, caller should free with
+ * spawn_free */
+void * trace_pack (int rank, int parent, const char * host,
+        size_t * size);
+
+/* given a buffer holding a series of records from trace_pack,
+ * write Chrome trace JSON to file, returns 0 on success */
+int trace_write (const char * file, const void * buf, size_t size);
+
+/* given a buffer holding a series of records from trace_pack,
+ * reconstruct the chain of spawn procs and phases that determined
+ * the length of each phase run across the tree, and print that
+ * chain along with the top (proc, phase) contributors to fd */
+void trace_critical_path (const void * buf, size_t size, int top,
+        FILE * fd);
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+#include <zygote.h>
+
+#include "spawn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+
+/* read size bytes from fd, returns 0 on success */
+static int
+read_full (int fd, void * buf, size_t size)
+{
+    char* ptr = (char*) buf;
+    while (size > 0) {
+        ssize_t n = read(fd, ptr, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 1;
+        }
+        ptr  += n;
+        size -= (size_t) n;
+    }
+    return 0;
+}
+
+/* write size bytes to fd, returns 0 on success */
+static int
+write_full (int fd, const void * buf, size_t size)
+{
+    const char* ptr = (const char*) buf;
+    while (size > 0) {
+        ssize_t n = write(fd, ptr, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 1;
+        }
+        ptr  += n;
+        size -= (size_t) n;
+    }
+    return 0;
+}
+
+/*******************************
+ * Spawn proc side
+ ******************************/
+
+int
+zygote_wait_ready (int fd, int msecs)
+{
+    struct pollfd pfd;
+    pfd.fd      = fd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    int rc;
+    do {
+        rc = poll(&pfd, 1, msecs);
+    } while (rc < 0 && errno == EINTR);
+    if (rc <= 0) {
+        return 1;
+    }
+
+    /* the template closes its end on exit, which reads as EOF */
+    uint32_t ready;
+    if (read_full(fd, &ready, sizeof(ready)) != 0 || ready != ZYGOTE_READY) {
+        return 1;
+    }
+    return 0;
+}
+
+pid_t
+zygote_fork (int fd, const char * const * envs, int count, const binding * bind)
+{
+    zygote_request req;
+    memset(&req, 0, sizeof(req));
+    req.type = ZYGOTE_FORK;
+    if (bind != NULL) {
+        req.bound = 1;
+        req.bind  = *bind;
+    }
+
+    /* pack env strings back to back */
+    size_t bytes = 0;
+    int i;
+    for (i = 0; i < count; i++) {
+        bytes += strlen(envs[i]) + 1;
+    }
+    req.env_bytes = (uint32_t) bytes;
+
+    char* buf = (char*) SPAWN_MALLOC(bytes + 1);
+    char* ptr = buf;
+    for (i = 0; i < count; i++) {
+        size_t len = strlen(envs[i]) + 1;
+        memcpy(ptr, envs[i], len);
+        ptr += len;
+    }
+
+    int32_t pid = -1;
+    if (write_full(fd, &req, sizeof(req)) != 0 ||
+        write_full(fd, buf, bytes) != 0 ||
+        read_full(fd, &pid, sizeof(pid)) != 0)
+    {
+        SPAWN_ERR("Lost connection to zygote (errno=%d %s)", errno, strerror(errno));
+        pid = -1;
+    }
+
+    spawn_free(&buf);
+    return (pid_t) pid;
+}
+
+int
+zygote_exit (int fd)
+{
+    zygote_request req;
+    memset(&req, 0, sizeof(req));
+    req.type = ZYGOTE_EXIT;
+    return write_full(fd, &req, sizeof(req));
+}
+
+/*******************************
+ * Zygote side
+ ******************************/
+
+/* sets up environment of a forked rank from env strings in buf */
+static void
+rank_environ (char * buf, size_t bytes)
+{
+    /* putenv keeps the strings, so buf is never freed */
+    char* ptr = buf;
+    while (ptr < buf + bytes) {
+        size_t len = strlen(ptr) + 1;
+        putenv(ptr);
+        ptr += len;
+    }
+
+    /* hide the zygote from the app and anything it execs */
+    const char* preload = getenv(ZYGOTE_PRELOAD_ENV);
+    if (preload != NULL) {
+        setenv("LD_PRELOAD", preload, 1);
+    } else {
+        unsetenv("LD_PRELOAD");
+    }
+    unsetenv(ZYGOTE_PRELOAD_ENV);
+    unsetenv(ZYGOTE_FD_ENV);
+}
+
+int
+zygote_serve (int fd)
+{
+    /* tell the spawn proc we got this far */
+    uint32_t ready = ZYGOTE_READY;
+    if (write_full(fd, &ready, sizeof(ready)) != 0) {
+        _exit(EXIT_FAILURE);
+    }
+
+    while (1) {
+        /* a closed socket means the spawn proc is gone */
+        zygote_request req;
+        if (read_full(fd, &req, sizeof(req)) != 0) {
+            _exit(EXIT_FAILURE);
+        }
+        if (req.type == ZYGOTE_EXIT) {
+            close(fd);
+            _exit(EXIT_SUCCESS);
+        }
+
+        char* buf = (char*) SPAWN_MALLOC(req.env_bytes + 1);
+        if (read_full(fd, buf, req.env_bytes) != 0) {
+            _exit(EXIT_FAILURE);
+        }
+        buf[req.env_bytes] = '\0';
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            /* rank returns to run the rest of the app */
+            close(fd);
+            rank_environ(buf, req.env_bytes);
+            if (req.bound) {
+                int rc = binding_apply(&req.bind);
+                if (rc != 0) {
+                    SPAWN_ERR("Failed to bind rank (errno=%d %s)", rc, strerror(rc));
+                }
+            }
+            return 0;
+        }
+        if (pid < 0) {
+            SPAWN_ERR("Zygote failed to fork rank (fork() errno=%d %s)",
+                errno, strerror(errno));
+        }
+        spawn_free(&buf);
+
+        int32_t reply = (int32_t) pid;
+        if (write_full(fd, &reply, sizeof(reply)) != 0) {
+            _exit(EXIT_FAILURE);
+        }
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* Application zygote: rather than exec the app once for each local
+ * rank, the spawn proc execs it once with libavazygote preloaded and
+ * ZYGOTE_FD_ENV naming one end of a socketpair.  By the time the
+ * library constructor runs, ld.so has loaded and relocated every
+ * library of the app (LD_BIND_NOW is set so symbols are bound up
+ * front too), and the constructor serves fork requests instead of
+ * returning.  Each request carries the environment variables specific
+ * to one rank and its binding, the zygote forks, the child sets those
+ * up and returns from the constructor into main, and the parent
+ * replies with the pid of the child.  After the last rank the zygote
+ * exits, and since the spawn proc is a child subreaper, the ranks are
+ * reparented to it, so it reaps them as it would procs it forked
+ * itself.
+ *
+ * Before serving, the zygote writes ZYGOTE_READY.  If that does not
+ * arrive, say the library is missing or the app is static so the
+ * constructor never runs, the spawn proc kills the template and execs
+ * each rank instead.
+ *
+ * Requests and replies are fixed size headers, a request is followed
+ * by env_bytes of NUL-terminated KEY=VALUE strings. */
+
+#ifndef SPAWN_ZYGOTE_H
+#define SPAWN_ZYGOTE_H 1
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "binding.h"
+
+/* names fd of zygote end of socketpair */
+#define ZYGOTE_FD_ENV "AVALAUNCH_ZYGOTE_FD"
+
+/* holds LD_PRELOAD to restore in each rank, unset if there was none */
+#define ZYGOTE_PRELOAD_ENV "AVALAUNCH_ZYGOTE_PRELOAD"
+
+#define ZYGOTE_FORK (1) /* fork a rank */
+#define ZYGOTE_EXIT (2) /* no more ranks, exit */
+#define ZYGOTE_READY (3) /* written by zygote once it serves requests */
+
+/* how long spawn proc waits for ZYGOTE_READY before giving up */
+#define ZYGOTE_READY_MSECS (30000)
+
+typedef struct zygote_request_t {
+    uint32_t type;      /* ZYGOTE_FORK or ZYGOTE_EXIT */
+    uint32_t env_bytes; /* length of env strings that follow */
+    int32_t bound;      /* whether child applies bind */
+    binding bind;       /* binding of child */
+} zygote_request;
+
+/* waits up to msecs for zygote on fd to say it is ready,
+ * returns 0 if it did */
+int zygote_wait_ready (int fd, int msecs);
+
+/* asks zygote on fd to fork a rank with count env strings in envs
+ * and binding bind if not NULL, returns pid of rank or -1 on error */
+pid_t zygote_fork (int fd, const char * const * envs, int count, const binding * bind);
+
+/* tells zygote on fd to exit, returns 0 on success */
+int zygote_exit (int fd);
+
+/* serves requests on fd, returns 0 in each forked rank after setting
+ * up its environment, and never returns in the zygote */
+int zygote_serve (int fd);
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667270.
+ * All rights reserved.
+ * This file is part of the Avalaunch process launcher.
+ * For details, see https://github.com/hpc/avalaunch
+ * Please also read the LICENSE file.
+*/
+
+/* Constructor of libavazygote, which the spawn proc preloads into the
+ * app it starts as a zygote, see zygote.h.  Without ZYGOTE_FD_ENV set
+ * the library does nothing. */
+
+#include <zygote.h>
+
+#include <stdlib.h>
+
+static void zygote_init (void) __attribute__((constructor));
+
+static void
+zygote_init (void)
+{
+    const char* value = getenv(ZYGOTE_FD_ENV);
+    if (value == NULL) {
+        return;
+    }
+
+    /* only returns in forked ranks */
+    zygote_serve(atoi(value));
+}